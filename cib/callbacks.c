@@ -471,11 +471,11 @@ forward_request(xmlNode * request, cib_client_t * cib_client, int call_options)
 
     if (host != NULL) {
         crm_trace("Forwarding %s op to %s", op, host);
-        send_cluster_message(host, crm_msg_cib, request, FALSE);
+        cib_send_peer_message(host, request, FALSE);
 
     } else {
         crm_trace("Forwarding %s op to master instance", op);
-        send_cluster_message(NULL, crm_msg_cib, request, FALSE);
+        cib_send_peer_message(NULL, request, FALSE);
     }
 
     /* Return the request to its original state */
@@ -486,6 +486,69 @@ forward_request(xmlNode * request, cib_client_t * cib_client, int call_options)
     }
 }
 
+/* Peers (by uname) that have told us they verify diffs using the tree digest */
+static GHashTable *tree_digest_peers = NULL;
+
+gboolean
+cib_send_peer_message(const char *node, xmlNode * msg, gboolean local)
+{
+    crm_xml_add(msg, F_CIB_TREE_DIGEST, XML_BOOLEAN_TRUE);
+    return send_cluster_message(node, crm_msg_cib, msg, local);
+}
+
+static void
+cib_peer_digest_update(const char *peer, xmlNode * msg)
+{
+    if (tree_digest_peers == NULL) {
+        tree_digest_peers = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                  g_hash_destroy_str, NULL);
+    }
+
+    if (crm_is_true(crm_element_value(msg, F_CIB_TREE_DIGEST))) {
+        if (g_hash_table_lookup(tree_digest_peers, peer) == NULL) {
+            crm_trace("%s verifies updates with the tree digest", peer);
+            g_hash_table_insert(tree_digest_peers, crm_strdup(peer), GINT_TO_POINTER(TRUE));
+        }
+
+    } else {
+        g_hash_table_remove(tree_digest_peers, peer);
+    }
+}
+
+void
+cib_peer_digest_forget(const char *peer)
+{
+    if (tree_digest_peers != NULL && peer != NULL) {
+        g_hash_table_remove(tree_digest_peers, peer);
+    }
+}
+
+static gboolean
+cib_peers_need_legacy_digest(void)
+{
+    GHashTableIter iter;
+    crm_node_t *node = NULL;
+
+    if (crm_peer_cache == NULL) {
+        return TRUE;
+    }
+
+    /* Peers we have not heard from yet may be running older software */
+    g_hash_table_iter_init(&iter, crm_peer_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & node)) {
+        if (node->uname == NULL || safe_str_eq(node->uname, cib_our_uname)
+            || crm_is_peer_active(node) == FALSE) {
+            continue;
+
+        } else if (tree_digest_peers == NULL
+                   || g_hash_table_lookup(tree_digest_peers, node->uname) == NULL) {
+            crm_trace("Including the legacy digest for %s", node->uname);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 static void
 send_peer_reply(xmlNode * msg, xmlNode * result_diff, const char *originator, gboolean broadcast)
 {
@@ -518,23 +581,35 @@ send_peer_reply(xmlNode * msg, xmlNode * result_diff, const char *originator, gb
         crm_xml_add(msg, F_CIB_GLOBAL_UPDATE, XML_BOOLEAN_TRUE);
         crm_xml_add(msg, F_CIB_OPERATION, CIB_OP_APPLY_DIFF);
 
-        /* Its safe to always use the latest version since the election
+        /* Older peers only know about the legacy digest and would
+         * otherwise skip verifying the diff altogether
+         *
+         * Its safe to always use the latest version since the election
          * ensures the software on this node is the oldest node in the cluster
          */
-        digest = calculate_xml_versioned_digest(the_cib, FALSE, TRUE, CRM_FEATURE_SET);
-        crm_xml_add(result_diff, XML_ATTR_DIGEST, digest);
-        crm_log_xml_trace(the_cib, digest);
+        if (cib_peers_need_legacy_digest()) {
+            digest = calculate_xml_versioned_digest(the_cib, FALSE, TRUE, CRM_FEATURE_SET);
+            crm_xml_add(result_diff, XML_ATTR_DIGEST, digest);
+            crm_log_xml_trace(the_cib, digest);
+            crm_free(digest);
+        }
+
+        /* Peers that understand it verify this instead, only the paths
+         * changed by this update need to be rehashed to produce it
+         */
+        digest = calculate_xml_tree_digest(the_cib);
+        crm_xml_add(result_diff, XML_ATTR_TREE_DIGEST, digest);
         crm_free(digest);
 
         add_message_xml(msg, F_CIB_UPDATE_DIFF, result_diff);
         crm_log_xml_trace(msg, "copy");
-        send_cluster_message(NULL, crm_msg_cib, msg, TRUE);
+        cib_send_peer_message(NULL, msg, TRUE);
 
     } else if (originator != NULL) {
         /* send reply via HA to originating node */
         crm_trace("Sending request result to originator only");
         crm_xml_add(msg, F_CIB_ISREPLY, originator);
-        send_cluster_message(originator, crm_msg_cib, msg, FALSE);
+        cib_send_peer_message(originator, msg, FALSE);
     }
 }
 
@@ -763,6 +838,8 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
     xmlNode *output = NULL;
     xmlNode *result_cib = NULL;
     xmlNode *current_cib = NULL;
+    cib_txn_t *txn = NULL;
+    cib_txn_t **in_place = &txn;
 
 #if ENABLE_ACL
     xmlNode *filtered_current_cib = NULL;
@@ -858,9 +935,19 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
             manage_counters = FALSE;
         }
 
-        rc = cib_perform_op(op, call_options, cib_op_func(call_type), FALSE,
-                            section, request, input, manage_counters, &config_changed,
-                            current_cib, &result_cib, cib_diff, &output);
+        if (call_options & cib_dryrun) {
+            in_place = NULL;
+        }
+#if ENABLE_ACL
+        if (acl_enabled(config_hash) == TRUE) {
+            /* acl_check_diff() needs the unmodified CIB */
+            in_place = NULL;
+        }
+#endif
+
+        rc = cib_perform_op_txn(op, call_options, cib_op_func(call_type), FALSE,
+                                section, request, input, manage_counters, &config_changed,
+                                current_cib, &result_cib, cib_diff, &output, in_place);
 
 #if ENABLE_ACL
         if (acl_enabled(config_hash) == TRUE
@@ -965,6 +1052,9 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
         free_xml(result_cib);
     }
 
+    /* Any in-place changes have been activated by now */
+    cib_txn_commit(txn);
+
     if ((call_options & cib_inhibit_notify) == 0) {
         const char *call_id = crm_element_value(request, F_CIB_CALLID);
         const char *client = crm_element_value(request, F_CIB_CLIENTNAME);
@@ -1071,6 +1161,8 @@ cib_peer_callback(xmlNode * msg, void *private_data)
         crm_xml_add(msg, F_CIB_CLIENTNAME, originator);
     }
 
+    cib_peer_digest_update(originator, msg);
+
     /* crm_log_xml_trace("Peer[inbound]", msg); */
     cib_process_request(msg, FALSE, TRUE, TRUE, NULL);
     return;
@@ -1288,7 +1380,7 @@ initiate_exit(void)
     crm_xml_add(leaving, F_TYPE, "cib");
     crm_xml_add(leaving, F_CIB_OPERATION, "cib_shutdown_req");
 
-    send_cluster_message(NULL, crm_msg_cib, leaving, TRUE);
+    cib_send_peer_message(NULL, leaving, TRUE);
     free_xml(leaving);
 
     g_timeout_add(crm_get_msec("5s"), cib_force_exit, NULL);
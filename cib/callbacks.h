@@ -84,6 +84,8 @@ extern void cib_ha_peer_callback(HA_Message * msg, void *private_data);
 extern void cib_peer_callback(xmlNode * msg, void *private_data);
 extern void cib_client_status_callback(const char *node, const char *client,
                                        const char *status, void *private);
+extern void cib_peer_digest_forget(const char *peer);
+extern gboolean cib_send_peer_message(const char *node, xmlNode * msg, gboolean local);
 extern void cib_common_callback_worker(xmlNode * op_request, cib_client_t * cib_client, gboolean privileged);
 
 void cib_shutdown(int nsig);
@@ -223,6 +223,17 @@ cibmon_diff(const char *event, xmlNode * msg)
         log_cib_diff(log_level, diff, op);
     }
 
+    if (diff != NULL) {
+        cib_diff_class_t *classes = cib_diff_classify(diff);
+
+        do_crm_log(log_level, "[%s] %s%s: %d node(s), %d resource op(s) updated, %d op(s) removed",
+                   event, op, classes->config_changed ? " (configuration changed)" : "",
+                   g_list_length(classes->added[cib_diff_node_state]),
+                   g_list_length(classes->added[cib_diff_lrm_rsc_op]),
+                   g_list_length(classes->removed[cib_diff_lrm_rsc_op]));
+        cib_diff_class_free(classes);
+    }
+
     if (log_updates && update != NULL) {
         crm_log_xml_trace(update, "raw_update");
     }
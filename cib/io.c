@@ -38,6 +38,7 @@
 #include <crm/common/xml.h>
 #include <crm/common/util.h>
 #include <crm/common/cluster.h>
+#include "common.h"
 
 #define CIB_SERIES "cib"
 
@@ -71,6 +72,36 @@ xmlNode *status_search = NULL;
 
 extern enum cib_errors cib_status;
 
+/* Write-behind state
+ *
+ * cib_write_delay (PCMK_cib_write_delay, in ms) allows bursts of changes
+ * to be coalesced into at most one disk write per interval.  The default
+ * of 0 writes as soon as the mainloop gets to it.
+ */
+static int cib_write_delay = -1;
+static guint cib_write_timer = 0;
+static GPid cib_write_pid = 0;
+static guint cib_write_watch = 0;
+static GTimer *cib_write_clock = NULL;
+static unsigned int cib_write_pending = 0;
+
+/* Per-write overhead, reported after every write */
+static unsigned int cib_write_count = 0;
+static unsigned int cib_write_coalesced = 0;
+static double cib_write_total_ms = 0;
+static double cib_write_max_ms = 0;
+
+/* What the last successful write left on disk, used to tell if someone
+ * else modified cib.xml without having to re-read and re-digest it
+ */
+static struct stat cib_last_written;
+static gboolean cib_last_written_valid = FALSE;
+
+/* How long to wait for an outstanding write when exiting */
+#define CIB_WRITE_FLUSH_TIMEOUT 30 /* seconds */
+
+static void cib_diskwrite_complete(GPid pid, gint status, gpointer user_data);
+
 int set_connected_peers(xmlNode * xml_obj);
 void GHFunc_count_peers(gpointer key, gpointer value, gpointer user_data);
 int write_cib_contents(gpointer p);
@@ -423,6 +454,88 @@ get_the_CIB(void)
     return the_cib;
 }
 
+/* Whether the file described by buf is still exactly what our last write left */
+static gboolean
+cib_unchanged_on_disk(const struct stat *buf)
+{
+    if (cib_last_written_valid == FALSE
+        || buf->st_dev != cib_last_written.st_dev
+        || buf->st_ino != cib_last_written.st_ino
+        || buf->st_size != cib_last_written.st_size
+        || buf->st_mtime != cib_last_written.st_mtime
+        || buf->st_ctime != cib_last_written.st_ctime) {
+        return FALSE;
+    }
+#if HAVE_STRUCT_STAT_ST_MTIM
+    /* Catch a rewrite within the same second as our own write */
+    return buf->st_mtim.tv_nsec == cib_last_written.st_mtim.tv_nsec
+        && buf->st_ctim.tv_nsec == cib_last_written.st_ctim.tv_nsec;
+#else
+    /* Whole seconds cannot tell our write from one right after it */
+    return FALSE;
+#endif
+}
+
+static void
+cib_write_flush(void)
+{
+    if (cib_write_timer) {
+        g_source_remove(cib_write_timer);
+        cib_write_timer = 0;
+    }
+
+    if (cib_write_pending == 0 || the_cib == NULL) {
+        return;
+
+    } else if (cib_writes_enabled == FALSE || cib_status != cib_ok) {
+        return;
+    }
+
+    if (cib_write_pid > 0) {
+        int lpc = 0;
+        int status = 0;
+        GPid pid = cib_write_pid;
+
+        crm_info("Waiting for disk write process %d to complete", pid);
+
+        /* Reap it ourselves rather than re-entering the mainloop, which
+         * would also dispatch everything else while we are shutting down
+         */
+        if (cib_write_watch) {
+            g_source_remove(cib_write_watch);
+            cib_write_watch = 0;
+        }
+
+        for (lpc = 0; lpc < CIB_WRITE_FLUSH_TIMEOUT * 10; lpc++) {
+            int rc = waitpid(pid, &status, WNOHANG);
+
+            if (rc == pid) {
+                cib_diskwrite_complete(pid, status, NULL);
+                break;
+
+            } else if (rc < 0 && errno != EINTR) {
+                crm_perror(LOG_WARNING, "Could not wait for disk write process %d", pid);
+                cib_last_written_valid = FALSE;
+                cib_write_pid = 0;
+                break;
+            }
+            usleep(100000);
+        }
+
+        if (cib_write_pid > 0) {
+            crm_err("Disk write process %d did not complete within %ds,"
+                    " discarding %u pending CIB update%s", pid, CIB_WRITE_FLUSH_TIMEOUT,
+                    cib_write_pending, cib_write_pending == 1 ? "" : "s");
+            return;
+        }
+    }
+
+    crm_notice("Writing %u pending CIB update%s to disk before exiting",
+               cib_write_pending, cib_write_pending == 1 ? "" : "s");
+    write_cib_contents(the_cib);
+    cib_write_pending = 0;
+}
+
 gboolean
 uninitializeCib(void)
 {
@@ -433,6 +546,12 @@ uninitializeCib(void)
         return FALSE;
     }
 
+    cib_write_flush();
+
+#if ENABLE_ACL
+    acl_cache_flush();
+#endif
+
     initialized = FALSE;
     the_cib = NULL;
     node_search = NULL;
@@ -491,17 +610,63 @@ sync_directory(const char *name)
     }
 }
 
+static gboolean
+cib_write_delayed(gpointer data)
+{
+    cib_write_timer = 0;
+    mainloop_set_trigger(cib_writer);
+    return FALSE;
+}
+
+static void
+cib_schedule_write(const char *op)
+{
+    if (cib_write_delay < 0) {
+        const char *value = getenv("PCMK_cib_write_delay");
+
+        cib_write_delay = value ? crm_get_msec(value) : 0;
+        if (cib_write_delay < 0) {
+            cib_write_delay = 0;
+        }
+        crm_debug("Coalescing CIB writes for up to %dms", cib_write_delay);
+    }
+
+    cib_write_pending++;
+
+    if (cib_write_delay == 0) {
+        crm_debug("Triggering CIB write for %s op", op);
+        mainloop_set_trigger(cib_writer);
+
+    } else if (cib_write_timer == 0) {
+        crm_debug("Scheduling CIB write in %dms for %s op", cib_write_delay, op);
+        cib_write_timer = g_timeout_add(cib_write_delay, cib_write_delayed, NULL);
+
+    } else {
+        crm_trace("CIB write for %s op coalesced with %u others", op, cib_write_pending - 1);
+    }
+}
+
 /*
  * This method will free the old CIB pointer on success and the new one
  * on failure.
+ *
+ * If the CIB was modified in-place (new_cib == the_cib) there is nothing
+ * to swap and only the disk write is scheduled.
  */
 int
 activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op)
 {
     xmlNode *saved_cib = the_cib;
 
-    CRM_ASSERT(new_cib != saved_cib);
-    if (initializeCib(new_cib) == FALSE) {
+#if ENABLE_ACL
+    /* Anything compiled against the old CIB is about to be stale */
+    acl_cache_flush();
+#endif
+
+    if (new_cib != NULL && new_cib == saved_cib) {
+        crm_trace("CIB was modified in-place by %s op", op);
+
+    } else if (initializeCib(new_cib) == FALSE) {
         free_xml(new_cib);
         crm_err("Ignoring invalid or NULL CIB");
 
@@ -518,12 +683,13 @@ activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op)
             crm_crit("Could not write out new CIB and no saved" " version to revert to");
         }
         return cib_ACTIVATION;
+
+    } else {
+        free_xml(saved_cib);
     }
 
-    free_xml(saved_cib);
     if (cib_writes_enabled && cib_status == cib_ok && to_disk) {
-        crm_debug("Triggering CIB write for %s op", op);
-        mainloop_set_trigger(cib_writer);
+        cib_schedule_write(op);
     }
 
     return cib_ok;
@@ -548,6 +714,33 @@ static void cib_diskwrite_complete(GPid pid, gint status, gpointer user_data)
         cib_writes_enabled = FALSE;
     }
 
+    if(exitcode == 0) {
+        char *primary_file = crm_concat(cib_root, "cib.xml", '/');
+
+        cib_last_written_valid = (stat(primary_file, &cib_last_written) == 0);
+        crm_free(primary_file);
+
+    } else {
+        cib_last_written_valid = FALSE;
+    }
+
+    if(cib_write_clock != NULL && pid == cib_write_pid) {
+        double elapsed = 1000 * g_timer_elapsed(cib_write_clock, NULL);
+
+        cib_write_total_ms += elapsed;
+        if(elapsed > cib_write_max_ms) {
+            cib_write_max_ms = elapsed;
+        }
+        crm_info("Disk write %u took %.0fms for %ld bytes"
+                 " (average %.0fms, max %.0fms, %u updates coalesced so far)",
+                 cib_write_count, elapsed,
+                 cib_last_written_valid ? (long)cib_last_written.st_size : 0L,
+                 cib_write_total_ms / cib_write_count, cib_write_max_ms,
+                 cib_write_coalesced);
+    }
+
+    cib_write_pid = 0;
+    cib_write_watch = 0;
     mainloop_trigger_complete(cib_writer);
 }
 
@@ -587,7 +780,19 @@ write_cib_contents(gpointer p)
 
         if (pid) {
             /* Parent */
-            g_child_watch_add(pid, cib_diskwrite_complete, NULL);
+            if (cib_write_pending > 1) {
+                cib_write_coalesced += cib_write_pending - 1;
+            }
+            cib_write_pending = 0;
+            cib_write_count++;
+            cib_write_pid = pid;
+
+            if (cib_write_clock == NULL) {
+                cib_write_clock = g_timer_new();
+            }
+            g_timer_start(cib_write_clock);
+
+            cib_write_watch = g_child_watch_add(pid, cib_diskwrite_complete, NULL);
             return -1; /* -1 means 'still work to do' */
         }
         
@@ -596,10 +801,11 @@ write_cib_contents(gpointer p)
         /* Don't log anything unless strictly necessary */
         set_crm_log_level(LOG_ERR);
 
-        /* In theory we can scribble on "the_cib" here and not affect the parent
-         * But lets be safe anyway
+        /* The child has its own copy-on-write image of the parent's
+         * memory, so we can scribble on "the_cib" without affecting it
+         * and avoid duplicating the whole tree here.
          */
-        local_cib = copy_xml(the_cib);
+        local_cib = the_cib;
     }
 
     epoch = crm_element_value(local_cib, XML_ATTR_GENERATION);
@@ -619,8 +825,15 @@ write_cib_contents(gpointer p)
         int rc = 0;
         int seq = get_last_sequence(cib_root, CIB_SERIES);
 
-        /* check the admin didnt modify it underneath us */
-        if (validate_on_disk_cib(primary_file, NULL) == FALSE) {
+        /* check the admin didnt modify it underneath us
+         *
+         * If the file is exactly as our last write left it, there is
+         * no need to parse and digest it all over again
+         */
+        if (cib_unchanged_on_disk(&buf)) {
+            crm_trace("%s is unchanged since our last write", primary_file);
+
+        } else if (validate_on_disk_cib(primary_file, NULL) == FALSE) {
             crm_err("%s was manually modified while the cluster was active!", primary_file);
             exit_rc = 1;
             goto cleanup;
@@ -660,13 +873,13 @@ write_cib_contents(gpointer p)
      * So delete the status section before we write it out
      */
     crm_debug("Writing CIB to disk");
+    cib_status_root = find_xml_node(local_cib, XML_CIB_TAG_STATUS, FALSE);
     if (p == NULL) {
-        cib_status_root = find_xml_node(local_cib, XML_CIB_TAG_STATUS, TRUE);
         CRM_LOG_ASSERT(cib_status_root != NULL);
+    }
 
-        if (cib_status_root != NULL) {
-            free_xml_from_parent(local_cib, cib_status_root);
-        }
+    if (cib_status_root != NULL) {
+        free_xml_from_parent(local_cib, cib_status_root);
     }
 
     tmp1 = mktemp(tmp1);        /* cib    */
@@ -690,8 +903,10 @@ write_cib_contents(gpointer p)
     }
     crm_debug("Wrote digest %s to disk", digest);
     CRM_ASSERT(retrieveCib(tmp1, tmp2, FALSE) != NULL);
-    sync_directory(cib_root);
 
+    /* Both temporary files have already been fsync'd, so a single
+     * directory sync after the renames is enough to make them durable
+     */
     crm_debug("Activating %s", tmp1);
     cib_rename(tmp1, primary_file);
     cib_rename(tmp2, digest_file);
@@ -706,9 +921,10 @@ write_cib_contents(gpointer p)
     crm_free(tmp2);
     crm_free(tmp1);
 
-    free_xml(local_cib);
+    if (p != NULL) {
+        free_xml(local_cib);
 
-    if (p == NULL) {
+    } else {
         /* exit() could potentially affect the parent by closing things it shouldn't
          * Use _exit instead
          */
@@ -420,6 +420,11 @@ cib_peer_update_callback(enum crm_status_type type, crm_node_t * node, const voi
         return;
     }
 #endif
+    if (node->uname != NULL && crm_is_peer_active(node) == FALSE) {
+        /* Whatever it runs when it comes back, it has to tell us again */
+        cib_peer_digest_forget(node->uname);
+    }
+
     if(cib_shutdown_flag && crm_active_peers() < 2 && g_hash_table_size(client_list) == 0) {
         crm_info("No more peers");
         terminate_cib(__FUNCTION__, FALSE);
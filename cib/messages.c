@@ -269,7 +269,7 @@ cib_server_process_diff(const char *op, int options, const char *section, xmlNod
         crm_xml_add(sync_me, F_CIB_OPERATION, CIB_OP_SYNC_ONE);
         crm_xml_add(sync_me, F_CIB_DELEGATED, cib_our_uname);
 
-        if (send_cluster_message(NULL, crm_msg_cib, sync_me, FALSE) == FALSE) {
+        if (cib_send_peer_message(NULL, sync_me, FALSE) == FALSE) {
             rc = cib_not_connected;
         }
         free_xml(sync_me);
@@ -446,7 +446,7 @@ sync_our_cib(xmlNode * request, gboolean all)
     crm_xml_add(replace_request, F_CIB_GLOBAL_UPDATE, XML_BOOLEAN_TRUE);
     add_message_xml(replace_request, F_CIB_CALLDATA, the_cib);
 
-    if (send_cluster_message(all ? NULL : host, crm_msg_cib, replace_request, FALSE) == FALSE) {
+    if (cib_send_peer_message(all ? NULL : host, replace_request, FALSE) == FALSE) {
         result = cib_not_connected;
     }
     free_xml(replace_request);
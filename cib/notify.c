@@ -239,6 +239,15 @@ cib_diff_notify(int options, const char *client, const char *call_id, const char
                    add_admin_epoch, add_epoch, add_updates, cib_error2string(result));
     }
 
+    if (result == cib_ok && (options & cib_dryrun) == 0
+        && crm_element_value(diff, XML_ATTR_TREE_DIGEST) == NULL) {
+        /* Only the paths changed by this update need to be rehashed */
+        char *digest = calculate_xml_tree_digest(the_cib);
+
+        crm_xml_add(diff, XML_ATTR_TREE_DIGEST, digest);
+        crm_free(digest);
+    }
+
     do_cib_notify(options, op, update, result, diff, T_CIB_DIFF_NOTIFY);
 }
 
@@ -730,6 +730,7 @@ pe_cluster_option crmd_opts[] = {
 	{ "crmd-integration-timeout", NULL, "time", NULL, "3min", &check_timer, "*** Advanced Use Only ***.", "If need to adjust this value, it probably indicates the presence of a bug." },
 	{ "crmd-finalization-timeout", NULL, "time", NULL, "30min", &check_timer, "*** Advanced Use Only ***.", "If you need to adjust this value, it probably indicates the presence of a bug." },
 	{ "crmd-transition-delay", NULL, "time", NULL, "0s", &check_timer, "*** Advanced Use Only ***\nEnabling this option will slow down cluster recovery under all conditions", "Delay cluster recovery for the configured interval to allow for additional/related events to occur.\nUseful if your configuration is sensitive to the order in which ping updates arrive." },
+	{ "crmd-lrm-update-delay", NULL, "time", NULL, "0s", &check_time, "*** Advanced Use Only ***\nHow long to collect completed resource operations before recording them in the CIB", "Results that complete within this window are sent to the CIB as a single update.  Zero (the default) records each result as soon as it completes.  Only enable this once every node runs a version that processes batched updates, older DCs ignore the results in them while no actions are pending." },
 	{ XML_ATTR_EXPECTED_VOTES, NULL, "integer", NULL, "2", &check_number, "The number of nodes expected to be in the cluster", "Used to calculate quorum in openais based clusters." },
 };
 /* *INDENT-ON* */
@@ -802,6 +803,9 @@ config_query_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void
     value = crmd_pref(config_hash, "crmd-transition-delay");
     transition_timer->period_ms = crm_get_msec(value);
 
+    value = crmd_pref(config_hash, "crmd-lrm-update-delay");
+    rsc_update_delay = crm_get_msec(value);
+
     value = crmd_pref(config_hash, "crmd-integration-timeout");
     integration_timer->period_ms = crm_get_msec(value);
 
@@ -19,3 +19,6 @@
 extern gboolean verify_stopped(enum crmd_fsa_state cur_state, int log_level);
 extern void lrm_connection_destroy(gpointer user_data);
 extern void lrm_clear_last_failure(const char *rsc_id);
+
+extern int rsc_update_delay;
+extern int flush_rsc_updates(void);
@@ -252,6 +252,8 @@ do_lrm_control(long long action,
             }
         }
 
+        flush_rsc_updates();
+
         if (is_set(fsa_input_register, R_LRM_CONNECTED)) {
             clear_bit_inplace(fsa_input_register, R_LRM_CONNECTED);
 
@@ -925,6 +927,9 @@ delete_rsc_entry(ha_msg_input_t * input, const char *rsc_id, GHashTableIter *rsc
     if (rc == HA_OK) {
         char *rsc_id_copy = crm_strdup(rsc_id);
 
+        /* Otherwise a pending result could re-create the entry */
+        flush_rsc_updates();
+
         if (rsc_gIter)
             g_hash_table_iter_remove(rsc_gIter);
         else
@@ -960,6 +965,8 @@ delete_op_entry(lrm_op_t * op, const char *rsc_id, const char *key, int call_id)
 {
     xmlNode *xml_top = NULL;
 
+    flush_rsc_updates();
+
     if (op != NULL) {
         xml_top = create_xml_node(NULL, XML_LRM_TAG_RSC_OP);
         crm_xml_add_int(xml_top, XML_LRM_ATTR_CALLID, op->call_id);
@@ -1322,6 +1329,7 @@ do_lrm_invoke(long long action,
 
         crm_info("Forcing a local LRM refresh");
 
+        flush_rsc_updates();
         fsa_cib_update(XML_CIB_TAG_STATUS, fragment, cib_quorum_override, rc, user_name);
         free_xml(fragment);
 
@@ -1870,20 +1878,76 @@ copy_lrm_rsc(const lrm_rsc_t * rsc)
 static void
 cib_rsc_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data)
 {
+    const char *ops = user_data;
+
     switch (rc) {
         case cib_ok:
         case cib_diff_failed:
         case cib_diff_resync:
-            crm_trace("Resource update %d complete: rc=%d", call_id, rc);
+            crm_trace("Resource update %d complete: rc=%d (%s)", call_id, rc, crm_str(ops));
             break;
         default:
             crm_warn("Resource update %d failed: (rc=%d) %s", call_id, rc, cib_error2string(rc));
+            if (ops) {
+                /* A batched update carries several results, report each of them */
+                int lpc = 0;
+                char **op_list = g_strsplit(ops, ", ", 0);
+
+                for (lpc = 0; op_list[lpc] != NULL; lpc++) {
+                    crm_warn("Update %d failed to record %s", call_id, op_list[lpc]);
+                }
+                g_strfreev(op_list);
+            }
     }
+    crm_free(user_data);
 }
 
-static int
-do_update_resource(lrm_rsc_t * rsc, lrm_op_t * op)
+/* Completed operations waiting to be recorded in the CIB as one update */
+int rsc_update_delay = 0;
+
+static xmlNode *rsc_update_batch = NULL;
+static xmlNode *rsc_update_resources = NULL;
+static char *rsc_update_ops = NULL;
+static int rsc_update_count = 0;
+static guint rsc_update_timer = 0;
+
+/* Results whose log message has to wait for the call id of the batch */
+struct rsc_update_event_s {
+    int log_level;
+    char *op_key;
+    int call_id;
+    int rc;
+    int op_status;
+    gboolean removed;
+};
+
+static GList *rsc_update_events = NULL;
+
+static void
+log_lrm_event(int log_level, const char *op_key, int call_id, int rc, int op_status,
+              int update_id, gboolean removed)
+{
+    if (op_status == LRM_OP_DONE) {
+        do_crm_log(log_level,
+                   "LRM operation %s (call=%d, rc=%d, cib-update=%d, confirmed=%s) %s",
+                   op_key, call_id, rc, update_id, removed ? "true" : "false",
+                   execra_code2string(rc));
+    } else {
+        do_crm_log(log_level,
+                   "LRM operation %s (call=%d, status=%d, cib-update=%d, confirmed=%s) %s",
+                   op_key, call_id, op_status, update_id, removed ? "true" : "false",
+                   op_status2text(op_status));
+    }
+}
+
+static void
+add_rsc_update(xmlNode * xml_rsc, lrm_op_t * op)
 {
+    int len = 0;
+    int offset = 0;
+    char *op_key = NULL;
+    xmlNode *existing = NULL;
+
 /*
   <status>
   <nodes_status id=uname>
@@ -1892,45 +1956,71 @@ do_update_resource(lrm_rsc_t * rsc, lrm_op_t * op)
   <lrm_resource id=...>
   </...>
 */
-    int rc = cib_ok;
-    xmlNode *update, *iter = NULL;
-    int call_opt = cib_quorum_override;
+    if (rsc_update_batch == NULL) {
+        xmlNode *iter = create_xml_node(NULL, XML_CIB_TAG_STATUS);
 
-    CRM_CHECK(op != NULL, return 0);
+        rsc_update_batch = iter;
+        iter = create_xml_node(iter, XML_CIB_TAG_STATE);
 
-    if (fsa_state == S_ELECTION || fsa_state == S_PENDING) {
-        crm_info("Sending update to local CIB in state: %s", fsa_state2string(fsa_state));
-        call_opt |= cib_scope_local;
+        set_uuid(iter, XML_ATTR_UUID, fsa_our_uname);
+        crm_xml_add(iter, XML_ATTR_UNAME, fsa_our_uname);
+        crm_xml_add(iter, XML_ATTR_ORIGIN, "do_update_resource");
+
+        iter = create_xml_node(iter, XML_CIB_TAG_LRM);
+        crm_xml_add(iter, XML_ATTR_ID, fsa_our_uuid);
+
+        rsc_update_resources = create_xml_node(iter, XML_LRM_TAG_RESOURCES);
     }
 
-    iter = create_xml_node(iter, XML_CIB_TAG_STATUS);
-    update = iter;
-    iter = create_xml_node(iter, XML_CIB_TAG_STATE);
+    existing = find_entity(rsc_update_resources, XML_LRM_TAG_RESOURCE, op->rsc_id);
+    if (existing == NULL) {
+        add_node_copy(rsc_update_resources, xml_rsc);
 
-    set_uuid(iter, XML_ATTR_UUID, fsa_our_uname);
-    crm_xml_add(iter, XML_ATTR_UNAME, fsa_our_uname);
-    crm_xml_add(iter, XML_ATTR_ORIGIN, __FUNCTION__);
+    } else {
+        /* Later results replace earlier ones outright, rather than
+         * inheriting any attributes the newer result does not set
+         */
+        xml_child_iter_filter(xml_rsc, xml_op, XML_LRM_TAG_RSC_OP,
+                              xmlNode *old = find_entity(existing, XML_LRM_TAG_RSC_OP, ID(xml_op));
 
-    iter = create_xml_node(iter, XML_CIB_TAG_LRM);
-    crm_xml_add(iter, XML_ATTR_ID, fsa_our_uuid);
+                              if (old != NULL) {
+                                  free_xml_from_parent(existing, old);
+                              }
+                              add_node_copy(existing, xml_op);
+            );
+    }
 
-    iter = create_xml_node(iter, XML_LRM_TAG_RESOURCES);
-    iter = create_xml_node(iter, XML_LRM_TAG_RESOURCE);
-    crm_xml_add(iter, XML_ATTR_ID, op->rsc_id);
+    op_key = generate_op_key(op->rsc_id, op->op_type, op->interval);
+    if (rsc_update_ops) {
+        offset = strlen(rsc_update_ops);
+    }
+    len = offset + strlen(op_key) + 20;
+    crm_realloc(rsc_update_ops, len);
+    snprintf(rsc_update_ops + offset, len - offset, "%s%s:%d", offset ? ", " : "", op_key,
+             op->call_id);
+    crm_free(op_key);
 
-    build_operation_update(iter, rsc, op, __FUNCTION__);
+    rsc_update_count++;
+}
 
-    if (rsc) {
-        crm_xml_add(iter, XML_ATTR_TYPE, rsc->type);
-        crm_xml_add(iter, XML_AGENT_ATTR_CLASS, rsc->class);
-        crm_xml_add(iter, XML_AGENT_ATTR_PROVIDER, rsc->provider);
+int
+flush_rsc_updates(void)
+{
+    int rc = cib_ok;
+    int call_opt = cib_quorum_override;
 
-        CRM_CHECK(rsc->type != NULL, crm_err("Resource %s has no value for type", op->rsc_id));
-        CRM_CHECK(rsc->class != NULL, crm_err("Resource %s has no value for class", op->rsc_id));
+    if (rsc_update_timer != 0) {
+        g_source_remove(rsc_update_timer);
+        rsc_update_timer = 0;
+    }
 
-    } else {
-        crm_warn("Resource %s no longer exists in the lrmd", op->rsc_id);
-        goto cleanup;
+    if (rsc_update_batch == NULL) {
+        return rc;
+    }
+
+    if (fsa_state == S_ELECTION || fsa_state == S_PENDING) {
+        crm_info("Sending update to local CIB in state: %s", fsa_state2string(fsa_state));
+        call_opt |= cib_scope_local;
     }
 
     /* make it an asyncronous call and be done with it
@@ -1950,15 +2040,97 @@ do_update_resource(lrm_rsc_t * rsc, lrm_op_t * op)
      * the alternative however means blocking here for too long, which
      * isnt acceptable
      */
-    fsa_cib_update(XML_CIB_TAG_STATUS, update, call_opt, rc, NULL);
+    fsa_cib_update(XML_CIB_TAG_STATUS, rsc_update_batch, call_opt, rc, NULL);
 
     /* the return code is a call number, not an error code */
-    crm_trace("Sent resource state update message: %d", rc);
-    fsa_cib_conn->cmds->register_callback(fsa_cib_conn, rc, 60, FALSE, NULL, "cib_rsc_callback",
-                                          cib_rsc_callback);
+    crm_trace("Sent resource state update message: %d (%d operations)", rc, rsc_update_count);
+    if (rsc_update_count > 1) {
+        crm_debug("Resource update %d contains %d operations: %s",
+                  rc, rsc_update_count, rsc_update_ops);
+    }
 
-  cleanup:
-    free_xml(update);
+    /* In the order the operations completed */
+    rsc_update_events = g_list_reverse(rsc_update_events);
+    while (rsc_update_events != NULL) {
+        struct rsc_update_event_s *event = rsc_update_events->data;
+
+        log_lrm_event(event->log_level, event->op_key, event->call_id, event->rc,
+                      event->op_status, rc, event->removed);
+
+        rsc_update_events = g_list_delete_link(rsc_update_events, rsc_update_events);
+        crm_free(event->op_key);
+        crm_free(event);
+    }
+
+    if (fsa_cib_conn != NULL) {
+        fsa_cib_conn->cmds->register_callback(fsa_cib_conn, rc, 60, FALSE, rsc_update_ops,
+                                              "cib_rsc_callback", cib_rsc_callback);
+    } else {
+        crm_free(rsc_update_ops);
+    }
+
+    free_xml(rsc_update_batch);
+    rsc_update_batch = NULL;
+    rsc_update_resources = NULL;
+    rsc_update_ops = NULL;
+    rsc_update_count = 0;
+    return rc;
+}
+
+static gboolean
+rsc_update_timeout(gpointer data)
+{
+    rsc_update_timer = 0;
+    flush_rsc_updates();
+    return FALSE;
+}
+
+/*
+ * Returns the call id of the CIB update, or 0 if none was sent.  If the
+ * result was added to a batch instead, *batched is set and the call id is
+ * only known once flush_rsc_updates() sends it.
+ */
+static int
+do_update_resource(lrm_rsc_t * rsc, lrm_op_t * op, gboolean * batched)
+{
+    int rc = cib_ok;
+    xmlNode *xml_rsc = NULL;
+
+    *batched = FALSE;
+    CRM_CHECK(op != NULL, return 0);
+
+    if (rsc == NULL) {
+        crm_warn("Resource %s no longer exists in the lrmd", op->rsc_id);
+        return rc;
+    }
+
+    xml_rsc = create_xml_node(NULL, XML_LRM_TAG_RESOURCE);
+    crm_xml_add(xml_rsc, XML_ATTR_ID, op->rsc_id);
+
+    build_operation_update(xml_rsc, rsc, op, __FUNCTION__);
+
+    crm_xml_add(xml_rsc, XML_ATTR_TYPE, rsc->type);
+    crm_xml_add(xml_rsc, XML_AGENT_ATTR_CLASS, rsc->class);
+    crm_xml_add(xml_rsc, XML_AGENT_ATTR_PROVIDER, rsc->provider);
+
+    CRM_CHECK(rsc->type != NULL, crm_err("Resource %s has no value for type", op->rsc_id));
+    CRM_CHECK(rsc->class != NULL, crm_err("Resource %s has no value for class", op->rsc_id));
+
+    /* Results are merged, in the order they completed, into a single
+     * update that is sent once the batching window closes
+     */
+    add_rsc_update(xml_rsc, op);
+    free_xml(xml_rsc);
+
+    if (rsc_update_delay <= 0) {
+        rc = flush_rsc_updates();
+
+    } else {
+        *batched = TRUE;
+        if (rsc_update_timer == 0) {
+            rsc_update_timer = g_timeout_add(rsc_update_delay, rsc_update_timeout, NULL);
+        }
+    }
     return rc;
 }
 
@@ -1979,6 +2151,7 @@ process_lrm_event(lrm_op_t * op)
     int update_id = 0;
     int log_level = LOG_ERR;
     gboolean removed = FALSE;
+    gboolean batched = FALSE;
     lrm_rsc_t *rsc = NULL;
 
     struct recurring_op_s *pending = NULL;
@@ -2025,7 +2198,7 @@ process_lrm_event(lrm_op_t * op)
             /* Keep notify ops out of the CIB */
             send_direct_ack(NULL, NULL, NULL, op, op->rsc_id);
         } else {
-            update_id = do_update_resource(rsc, op);
+            update_id = do_update_resource(rsc, op, &batched);
         }
 
         if (op->interval != 0) {
@@ -2057,16 +2230,22 @@ process_lrm_event(lrm_op_t * op)
     }
 
   out:
-    if (op->op_status == LRM_OP_DONE) {
-        do_crm_log(log_level,
-                   "LRM operation %s (call=%d, rc=%d, cib-update=%d, confirmed=%s) %s",
-                   op_key, op->call_id, op->rc, update_id, removed ? "true" : "false",
-                   execra_code2string(op->rc));
+    if (batched) {
+        /* Logged, with the call id, once the batch is sent */
+        struct rsc_update_event_s *event = NULL;
+
+        crm_malloc0(event, sizeof(struct rsc_update_event_s));
+        event->log_level = log_level;
+        event->op_key = crm_strdup(op_key);
+        event->call_id = op->call_id;
+        event->rc = op->rc;
+        event->op_status = op->op_status;
+        event->removed = removed;
+        rsc_update_events = g_list_prepend(rsc_update_events, event);
+
     } else {
-        do_crm_log(log_level,
-                   "LRM operation %s (call=%d, status=%d, cib-update=%d, confirmed=%s) %s",
-                   op_key, op->call_id, op->op_status, update_id, removed ? "true" : "false",
-                   op_status2text(op->op_status));
+        log_lrm_event(log_level, op_key, op->call_id, op->rc, op->op_status, update_id,
+                      removed);
     }
 
     if (op->rc != 0 && op->output != NULL) {
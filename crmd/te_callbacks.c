@@ -38,9 +38,6 @@ gboolean shuttingdown = FALSE;
 crm_graph_t *transition_graph;
 crm_trigger_t *transition_trigger = NULL;
 
-/* #define rsc_op_template "//"XML_TAG_DIFF_ADDED"//"XML_TAG_CIB"//"XML_CIB_TAG_STATE"[@uname='%s']"//"XML_LRM_TAG_RSC_OP"[@id='%s]" */
-#define rsc_op_template "//"XML_TAG_DIFF_ADDED"//"XML_TAG_CIB"//"XML_LRM_TAG_RSC_OP"[@id='%s']"
-
 static const char *
 get_node_id(xmlNode * rsc_op)
 {
@@ -74,6 +71,32 @@ process_resource_updates(xmlXPathObject * xpathObj)
     }
 }
 
+/*
+ * Whether every resource in the update came from a node batching the
+ * results of its operations (see do_update_resource()), as opposed to a
+ * refresh of its entire LRM history.  Failures in a batch still need to
+ * reach process_graph_event() so that their fail-counts are updated.
+ */
+static gboolean
+is_batched_lrm_update(cib_diff_class_t * classes)
+{
+    GList *gIter = NULL;
+
+    for (gIter = classes->added[cib_diff_lrm_resource]; gIter != NULL; gIter = gIter->next) {
+        xmlNode *node = gIter->data;
+
+        while (node != NULL && safe_str_neq(XML_CIB_TAG_STATE, TYPE(node))) {
+            node = node->parent;
+        }
+
+        if (node == NULL
+            || safe_str_neq(crm_element_value(node, XML_ATTR_ORIGIN), "do_update_resource")) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 void
 te_update_diff(const char *event, xmlNode * msg)
 {
@@ -81,7 +104,8 @@ te_update_diff(const char *event, xmlNode * msg)
     const char *op = NULL;
 
     xmlNode *diff = NULL;
-    xmlXPathObject *xpathObj = NULL;
+    GList *gIter = NULL;
+    cib_diff_class_t *classes = NULL;
 
     int diff_add_updates = 0;
     int diff_add_epoch = 0;
@@ -122,130 +146,100 @@ te_update_diff(const char *event, xmlNode * msg)
               diff_add_admin_epoch, diff_add_epoch, diff_add_updates, fsa_state2string(fsa_state));
     log_cib_diff(LOG_DEBUG_2, diff, op);
 
-    if (cib_config_changed(NULL, NULL, &diff)) {
+    if (diff == NULL) {
+        return;
+    }
+
+    /* Sort the diff once, rather than searching it once per question */
+    classes = cib_diff_classify(diff);
+
+    if (classes->config_changed) {
         abort_transition(INFINITY, tg_restart, "Non-status change", diff);
         goto bail;              /* configuration changed */
     }
 
     /* Tickets Attributes - Added/Updated */
-    xpathObj =
-        xpath_search(diff,
-                     "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_ADDED "//" XML_CIB_TAG_TICKETS);
-    if (xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-        xmlNode *aborted = getXpathResult(xpathObj, 0);
+    if (classes->added[cib_diff_tickets]) {
+        xmlNode *aborted = classes->added[cib_diff_tickets]->data;
 
         abort_transition(INFINITY, tg_restart, "Ticket attribute: update", aborted);
         goto bail;
-
-    } else if (xpathObj) {
-        xmlXPathFreeObject(xpathObj);
     }
 
     /* Tickets Attributes - Removed */
-    xpathObj =
-        xpath_search(diff,
-                     "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_REMOVED "//" XML_CIB_TAG_TICKETS);
-    if (xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-        xmlNode *aborted = getXpathResult(xpathObj, 0);
+    if (classes->removed[cib_diff_tickets]) {
+        xmlNode *aborted = classes->removed[cib_diff_tickets]->data;
 
         abort_transition(INFINITY, tg_restart, "Ticket attribute: removal", aborted);
         goto bail;
-
-    } else if (xpathObj) {
-        xmlXPathFreeObject(xpathObj);
     }
 
     /* Transient Attributes - Added/Updated */
-    xpathObj =
-        xpath_search(diff,
-                     "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_ADDED "//"
-                     XML_TAG_TRANSIENT_NODEATTRS "//" XML_CIB_TAG_NVPAIR);
-    if (xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-        int lpc;
-
-        for (lpc = 0; lpc < xpathObj->nodesetval->nodeNr; lpc++) {
-            xmlNode *attr = getXpathResult(xpathObj, lpc);
-            const char *name = crm_element_value(attr, XML_NVPAIR_ATTR_NAME);
-            const char *value = NULL;
-
-            if (safe_str_eq(CRM_OP_PROBED, name)) {
-                value = crm_element_value(attr, XML_NVPAIR_ATTR_VALUE);
-            }
+    for (gIter = classes->added[cib_diff_transient_nvpairs]; gIter != NULL; gIter = gIter->next) {
+        xmlNode *attr = gIter->data;
+        const char *name = crm_element_value(attr, XML_NVPAIR_ATTR_NAME);
+        const char *value = NULL;
 
-            if (crm_is_true(value) == FALSE) {
-                abort_transition(INFINITY, tg_restart, "Transient attribute: update", attr);
-                crm_log_xml_trace(attr, "Abort");
-                goto bail;
-            }
+        if (safe_str_eq(CRM_OP_PROBED, name)) {
+            value = crm_element_value(attr, XML_NVPAIR_ATTR_VALUE);
         }
 
-    } else if (xpathObj) {
-        xmlXPathFreeObject(xpathObj);
+        if (crm_is_true(value) == FALSE) {
+            abort_transition(INFINITY, tg_restart, "Transient attribute: update", attr);
+            crm_log_xml_trace(attr, "Abort");
+            goto bail;
+        }
     }
 
     /* Transient Attributes - Removed */
-    xpathObj =
-        xpath_search(diff,
-                     "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_REMOVED "//"
-                     XML_TAG_TRANSIENT_NODEATTRS);
-    if (xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-        xmlNode *aborted = getXpathResult(xpathObj, 0);
+    if (classes->removed[cib_diff_transient_attrs]) {
+        xmlNode *aborted = classes->removed[cib_diff_transient_attrs]->data;
 
         abort_transition(INFINITY, tg_restart, "Transient attribute: removal", aborted);
         goto bail;
-
-    } else if (xpathObj) {
-        xmlXPathFreeObject(xpathObj);
     }
 
     /* Check for node state updates... possibly from a shutdown we requested */
-    xpathObj =
-        xpath_search(diff, "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_ADDED "//" XML_CIB_TAG_STATE);
-    if (xpathObj) {
-        int lpc = 0, max = xpathObj->nodesetval->nodeNr;
-
-        for (lpc = 0; lpc < max; lpc++) {
-            xmlNode *node = getXpathResult(xpathObj, lpc);
-            const char *event_node = crm_element_value(node, XML_ATTR_ID);
-            const char *ccm_state = crm_element_value(node, XML_CIB_ATTR_INCCM);
-            const char *ha_state = crm_element_value(node, XML_CIB_ATTR_HASTATE);
-            const char *shutdown_s = crm_element_value(node, XML_CIB_ATTR_SHUTDOWN);
-            const char *crmd_state = crm_element_value(node, XML_CIB_ATTR_CRMDSTATE);
-
-            if (safe_str_eq(ccm_state, XML_BOOLEAN_FALSE)
-                || safe_str_eq(ha_state, DEADSTATUS)
-                || safe_str_eq(crmd_state, CRMD_JOINSTATE_DOWN)) {
-                crm_action_t *shutdown = match_down_event(0, event_node, NULL);
-
-                if (shutdown != NULL) {
-                    const char *task = crm_element_value(shutdown->xml, XML_LRM_ATTR_TASK);
-
-                    if (safe_str_neq(task, CRM_OP_FENCE)) {
-                        /* Wait for stonithd to tell us it is complete via tengine_stonith_callback() */
-                        crm_debug("Confirming %s op %d", task, shutdown->id);
-                        /* match->confirmed = TRUE; */
-                        stop_te_timer(shutdown->timer);
-                        update_graph(transition_graph, shutdown);
-                        trigger_graph();
-                    }
-
-                } else {
-                    crm_info("Stonith/shutdown of %s not matched", event_node);
-                    abort_transition(INFINITY, tg_restart, "Node failure", node);
+    for (gIter = classes->added[cib_diff_node_state]; gIter != NULL; gIter = gIter->next) {
+        xmlNode *node = gIter->data;
+        const char *event_node = crm_element_value(node, XML_ATTR_ID);
+        const char *ccm_state = crm_element_value(node, XML_CIB_ATTR_INCCM);
+        const char *ha_state = crm_element_value(node, XML_CIB_ATTR_HASTATE);
+        const char *shutdown_s = crm_element_value(node, XML_CIB_ATTR_SHUTDOWN);
+        const char *crmd_state = crm_element_value(node, XML_CIB_ATTR_CRMDSTATE);
+
+        if (safe_str_eq(ccm_state, XML_BOOLEAN_FALSE)
+            || safe_str_eq(ha_state, DEADSTATUS)
+            || safe_str_eq(crmd_state, CRMD_JOINSTATE_DOWN)) {
+            crm_action_t *shutdown = match_down_event(0, event_node, NULL);
+
+            if (shutdown != NULL) {
+                const char *task = crm_element_value(shutdown->xml, XML_LRM_ATTR_TASK);
+
+                if (safe_str_neq(task, CRM_OP_FENCE)) {
+                    /* Wait for stonithd to tell us it is complete via tengine_stonith_callback() */
+                    crm_debug("Confirming %s op %d", task, shutdown->id);
+                    /* match->confirmed = TRUE; */
+                    stop_te_timer(shutdown->timer);
+                    update_graph(transition_graph, shutdown);
+                    trigger_graph();
                 }
-                fail_incompletable_actions(transition_graph, event_node);
+
+            } else {
+                crm_info("Stonith/shutdown of %s not matched", event_node);
+                abort_transition(INFINITY, tg_restart, "Node failure", node);
             }
+            fail_incompletable_actions(transition_graph, event_node);
+        }
 
-            if (shutdown_s) {
-                int shutdown = crm_parse_int(shutdown_s, NULL);
+        if (shutdown_s) {
+            int shutdown = crm_parse_int(shutdown_s, NULL);
 
-                if (shutdown > 0) {
-                    crm_info("Aborting on " XML_CIB_ATTR_SHUTDOWN " attribute for %s", event_node);
-                    abort_transition(INFINITY, tg_restart, "Shutdown request", node);
-                }
+            if (shutdown > 0) {
+                crm_info("Aborting on " XML_CIB_ATTR_SHUTDOWN " attribute for %s", event_node);
+                abort_transition(INFINITY, tg_restart, "Shutdown request", node);
             }
         }
-        xmlXPathFreeObject(xpathObj);
     }
 
     /*
@@ -256,92 +250,57 @@ te_update_diff(const char *event, xmlNode * msg)
      * Otherwise we could miss updates we're waiting for and stall 
      *
      */
-    xpathObj = NULL;
     if (transition_graph->pending == 0) {
-        xpathObj =
-            xpath_search(diff,
-                         "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_ADDED "//"
-                         XML_LRM_TAG_RESOURCE);
-    }
+        int updates = g_list_length(classes->added[cib_diff_lrm_resource]);
 
-    if (xpathObj) {
-        int updates = xpathObj->nodesetval->nodeNr;
-
-        if (updates > 1) {
+        if (updates > 1 && is_batched_lrm_update(classes) == FALSE) {
             /* Updates by, or in response to, TE actions will never contain updates
-             * for more than one resource at a time
+             * for more than one resource at a time while nothing is pending
              */
             crm_debug("Detected LRM refresh - %d resources updated: Skipping all resource events",
                      updates);
             crm_log_xml_trace(diff, "lrm-refresh");
             abort_transition(INFINITY, tg_restart, "LRM Refresh", NULL);
             goto bail;
+
+        } else if (updates > 1) {
+            crm_debug("Processing %d batched resource updates", updates);
         }
-        xmlXPathFreeObject(xpathObj);
     }
 
     /* Process operation updates */
-    xpathObj =
-        xpath_search(diff,
-                     "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_ADDED "//" XML_LRM_TAG_RSC_OP);
-    if (xpathObj) {
-        process_resource_updates(xpathObj);
-        xmlXPathFreeObject(xpathObj);
+    for (gIter = classes->added[cib_diff_lrm_rsc_op]; gIter != NULL; gIter = gIter->next) {
+        xmlNode *rsc_op = gIter->data;
+
+        process_graph_event(rsc_op, get_node_id(rsc_op));
     }
 
     /* Detect deleted (as opposed to replaced or added) actions - eg. crm_resource -C */
-    xpathObj = xpath_search(diff, "//" XML_TAG_DIFF_REMOVED "//" XML_LRM_TAG_RSC_OP);
-    if (xpathObj) {
-        int lpc = 0, max = xpathObj->nodesetval->nodeNr;
-
-        for (lpc = 0; lpc < max; lpc++) {
-            int max = 0;
-            const char *op_id = NULL;
-            char *rsc_op_xpath = NULL;
-            xmlXPathObject *op_match = NULL;
-            xmlNode *match = getXpathResult(xpathObj, lpc);
-
-            CRM_CHECK(match != NULL, continue);
-
-            op_id = ID(match);
-
-            max = strlen(rsc_op_template) + strlen(op_id) + 1;
-            crm_malloc0(rsc_op_xpath, max);
-            snprintf(rsc_op_xpath, max, rsc_op_template, op_id);
-
-            op_match = xpath_search(diff, rsc_op_xpath);
-            if (op_match == NULL || op_match->nodesetval->nodeNr == 0) {
-                /* Prevent false positives by matching cancelations too */
-                const char *node = get_node_id(match);
-                crm_action_t *cancelled = get_cancel_action(op_id, node);
-
-                if (cancelled == NULL) {
-                    crm_debug("No match for deleted action %s (%s on %s)", rsc_op_xpath, op_id,
-                              node);
-                    abort_transition(INFINITY, tg_restart, "Resource op removal", match);
-                    if (op_match) {
-                        xmlXPathFreeObject(op_match);
-                    }
-                    crm_free(rsc_op_xpath);
-                    goto bail;
-
-                } else {
-                    crm_debug("Deleted lrm_rsc_op %s on %s was for graph event %d",
-                              op_id, node, cancelled->id);
-                }
-            }
+    for (gIter = classes->removed[cib_diff_lrm_rsc_op]; gIter != NULL; gIter = gIter->next) {
+        xmlNode *match = gIter->data;
+        const char *op_id = ID(match);
 
-            if (op_match) {
-                xmlXPathFreeObject(op_match);
+        CRM_CHECK(op_id != NULL, continue);
+
+        if (cib_diff_find_added(classes, cib_diff_lrm_rsc_op, op_id) == NULL) {
+            /* Prevent false positives by matching cancelations too */
+            const char *node = get_node_id(match);
+            crm_action_t *cancelled = get_cancel_action(op_id, node);
+
+            if (cancelled == NULL) {
+                crm_debug("No match for deleted action %s on %s", op_id, node);
+                abort_transition(INFINITY, tg_restart, "Resource op removal", match);
+                goto bail;
+
+            } else {
+                crm_debug("Deleted lrm_rsc_op %s on %s was for graph event %d",
+                          op_id, node, cancelled->id);
             }
-            crm_free(rsc_op_xpath);
         }
     }
 
   bail:
-    if (xpathObj) {
-        xmlXPathFreeObject(xpathObj);
-    }
+    cib_diff_class_free(classes);
 }
 
 gboolean
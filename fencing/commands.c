@@ -533,17 +533,280 @@ static int stonith_device_action(xmlNode *msg, char **output)
     return rc;
 }
 
-static gboolean can_fence_host_with_device(stonith_device_t *dev, const char *host)
+/*
+ * Searching for the devices capable of fencing a host
+ *
+ * Devices that need to run their agent to answer (dynamic-list and status)
+ * are probed asynchronously and in parallel.  The search completes, and its
+ * callback is called, once every probe has finished or the search's own
+ * deadline has passed, whichever is sooner.  Probes that are still running
+ * at the deadline continue in the background so their results can be cached.
+ */
+typedef struct device_search_s device_search_t;
+
+struct device_search_s 
+{
+	char *host;
+	GListPtr capable;	/* ids of the devices that can fence host */
+
+	int pending;		/* devices not yet checked */
+	int probe_timeout;	/* ms */
+	guint timer;
+	gboolean replied;
+
+	void (*callback)(GListPtr devices, void *user_data);
+	void *user_data;
+};
+
+typedef struct device_probe_s 
+{
+	async_command_t cmd;	/* Must be first, see st_probe_done() */
+	GListPtr searches;	/* device_search_t's waiting for the result */
+} device_probe_t;
+
+static void search_devices_done(device_search_t *search)
+{
+    GListPtr gIter = NULL;
+    GListPtr devices = NULL;
+
+    if(search->replied == FALSE) {
+	search->replied = TRUE;
+	if(search->timer) {
+	    g_source_remove(search->timer);
+	    search->timer = 0;
+	}
+
+	/* Devices may have been removed while we were waiting */
+	for(gIter = search->capable; gIter != NULL; gIter = gIter->next) {
+	    stonith_device_t *dev = g_hash_table_lookup(device_list, gIter->data);
+	    if(dev) {
+		devices = g_list_append(devices, dev);
+	    }
+	}
+	search->callback(devices, search->user_data);
+    }
+
+    if(search->pending == 0) {
+	slist_basic_destroy(search->capable);
+	crm_free(search->host);
+	crm_free(search);
+    }
+}
+
+static gboolean search_devices_timeout(gpointer user_data)
+{
+    device_search_t *search = user_data;
+
+    search->timer = 0;
+    crm_info("%d devices did not report whether they can fence %s in time",
+	     search->pending, search->host);
+    search_devices_done(search);
+    return FALSE;
+}
+
+static void search_report(device_search_t *search, const char *id, gboolean can, const char *check_type)
+{
+    const char *alias = NULL;
+    stonith_device_t *dev = g_hash_table_lookup(device_list, id);
+
+    if(search->host && dev && g_hash_table_lookup(dev->aliases, search->host)) {
+	alias = g_hash_table_lookup(dev->aliases, search->host);
+    }
+
+    if(check_type == NULL) {
+	/* Nothing to log */
+
+    } else if(alias == NULL || safe_str_eq(search->host, alias)) {
+	crm_info("%s can%s fence %s: %s", id, can?"":" not", search->host, check_type);
+    } else {
+	crm_info("%s can%s fence %s (aka. '%s'): %s", id, can?"":" not", search->host, alias, check_type);
+    }
+
+    if(can && search->replied == FALSE) {
+	search->capable = g_list_append(search->capable, crm_strdup(id));
+    }
+
+    search->pending--;
+    if(search->pending == 0) {
+	search_devices_done(search);
+    }
+}
+
+static char *read_child_output(int fd);
+
+static int device_list_ttl(stonith_device_t *dev)
 {
+    const char *value = g_hash_table_lookup(dev->params, STONITH_ATTR_LIST_TTL);
+
+    if(value) {
+	return crm_get_msec(value) / 1000;
+    }
+    return STONITH_DEFAULT_LIST_TTL;
+}
+
+static void st_probe_done(GPid pid, gint status, gpointer user_data) 
+{
+    int rc = st_err_generic;
     gboolean can = FALSE;
+    GListPtr gIter = NULL;
+    char *output = NULL;
+    const char *check_type = NULL;
+    device_probe_t *probe = user_data;
+    stonith_device_t *dev = NULL;
+
+    if(probe->cmd.timer_sigterm) {
+	g_source_remove(probe->cmd.timer_sigterm);
+    }
+    if(probe->cmd.timer_sigkill) {
+	g_source_remove(probe->cmd.timer_sigkill);
+    }
+
+    if(WIFSIGNALED(status)) {
+	crm_notice("Child process %d performing action '%s' with '%s' terminated with signal %d",
+		   pid, probe->cmd.action, probe->cmd.device, WTERMSIG(status));
+
+    } else if(WIFEXITED(status)) {
+	rc = WEXITSTATUS(status);
+	crm_debug("Child process %d performing action '%s' with '%s' exited with rc %d",
+		  pid, probe->cmd.action, probe->cmd.device, rc);
+    }
+
+    if(probe->cmd.stdout) {
+	output = read_child_output(probe->cmd.stdout);
+	close(probe->cmd.stdout);
+	probe->cmd.stdout = 0;
+    }
+
+    dev = g_hash_table_lookup(device_list, probe->cmd.device);
+
+    if(safe_str_eq(probe->cmd.action, "list")) {
+	check_type = "dynamic-list";
+
+	if(dev == NULL || dev->list_probe != probe) {
+	    crm_trace("Discarding stale port list for %s", probe->cmd.device);
+	    dev = NULL;
+
+	} else if(rc != 0 && dev->active_pid == 0) {
+	    /* This device probably only supports a single
+	     * connection, which appears to already be in use,
+	     * likely involved in a montior or (less likely)
+	     * metadata operation.
+	     *
+	     * Avoid disabling port list queries in the hope that
+	     * the op would succeed next time
+	     */
+	    crm_info("Couldn't query ports for %s. Call failed with rc=%d and active_pid=%d: %s",
+		     dev->agent, rc, dev->active_pid, output);
+
+	} else if(rc != 0) {
+	    crm_notice("Disabling port list queries for %s (%d): %s",
+		       dev->id, rc, output);
+	    dev->targets_age = -1;
+
+	    /* Fall back to status */
+	    g_hash_table_replace(dev->params, crm_strdup(STONITH_ATTR_HOSTCHECK), crm_strdup("status"));
+
+	} else {
+	    crm_info("Refreshing port list for %s", dev->id);
+	    slist_basic_destroy(dev->targets);
+	    dev->targets = parse_host_list(output);
+	    dev->targets_age = time(NULL);
+	}
+
+	if(dev) {
+	    dev->list_probe = NULL;
+	}
+
+	for(gIter = probe->searches; gIter != NULL; gIter = gIter->next) {
+	    device_search_t *search = gIter->data;
+	    const char *alias = search->host;
+
+	    if(dev && g_hash_table_lookup(dev->aliases, search->host)) {
+		alias = g_hash_table_lookup(dev->aliases, search->host);
+	    }
+	    can = FALSE;
+	    if(dev && string_in_list(dev->targets, alias)) {
+		can = TRUE;
+	    }
+	    search_report(search, probe->cmd.device, can, check_type);
+	}
+
+    } else {
+	/* The status operation for the device/target combination
+	 * Will cause problems if the device doesn't return 2 for down'd nodes or
+	 *  (for virtual nodes) if the device doesn't return 1 for guests that
+	 *  have been moved to another host
+	 */
+	check_type = "status";
+
+	if(rc == 1 /* unkown */) {
+	    crm_trace("Host %s is not known by %s", probe->cmd.victim, probe->cmd.device);
+	    
+	} else if(rc == 0 /* active */ || rc == 2 /* inactive */) {
+	    can = TRUE;
+
+	} else {
+	    crm_notice("Unkown result when testing if %s can fence %s: rc=%d",
+		       probe->cmd.device, probe->cmd.victim, rc);
+	}
+
+	for(gIter = probe->searches; gIter != NULL; gIter = gIter->next) {
+	    search_report(gIter->data, probe->cmd.device, can, check_type);
+	}
+    }
+
+    g_list_free(probe->searches);
+    crm_free(probe->cmd.device);
+    crm_free(probe->cmd.action);
+    crm_free(probe->cmd.victim);
+    crm_free(probe);
+    crm_free(output);
+}
+
+static device_probe_t *start_device_probe(
+    stonith_device_t *dev, const char *action, const char *host, int timeout, device_search_t *search)
+{
+    int rc = 0;
+    int exec_rc = 0;
+    device_probe_t *probe = NULL;
+
+    crm_malloc0(probe, sizeof(device_probe_t));
+    probe->cmd.device = crm_strdup(dev->id);
+    probe->cmd.action = crm_strdup(action);
+    probe->cmd.victim = host?crm_strdup(host):NULL;
+    probe->cmd.timeout = timeout;
+    probe->cmd.done = st_probe_done;
+
+    exec_rc = run_stonith_agent(dev->agent, action, host, dev->params, host?dev->aliases:NULL,
+				&rc, NULL, &probe->cmd);
+    if(exec_rc <= 0) {
+	crm_err("Could not invoke %s: rc=%d", dev->id, exec_rc);
+	crm_free(probe->cmd.device);
+	crm_free(probe->cmd.action);
+	crm_free(probe->cmd.victim);
+	crm_free(probe);
+	return NULL;
+    }
+
+    crm_trace("Probing %s with '%s' (pid %d)", dev->id, action, exec_rc);
+    if(search) {
+	probe->searches = g_list_append(probe->searches, search);
+    }
+    return probe;
+}
+
+static void can_fence_host_with_device(stonith_device_t *dev, device_search_t *search)
+{
+    gboolean can = FALSE;
+    const char *host = search->host;
     const char *alias = host;
     const char *check_type = NULL;
 
-    if(dev == NULL) {
-	return FALSE;
+    search->pending++;
 
-    } else if(host == NULL) {
-	return TRUE;
+    if(host == NULL) {
+	search_report(search, dev->id, TRUE, NULL);
+	return;
     }
 
     if(g_hash_table_lookup(dev->aliases, host)) {
@@ -576,53 +839,36 @@ static gboolean can_fence_host_with_device(stonith_device_t *dev, const char *ho
 
     } else if(safe_str_eq(check_type, "dynamic-list")) {
 	time_t now = time(NULL);
+	int ttl = device_list_ttl(dev);
 
 	/* Host/alias must be in the list output to be eligable to be fenced
 	 *
 	 * Will cause problems if down'd nodes aren't listed or (for virtual nodes)
 	 *  if the guest is still listed despite being moved to another machine
+	 *
+	 * A list older than the TTL is still used while a new one is obtained
+	 * in the background, but only up to twice the TTL
 	 */
 	
 	if(dev->targets_age < 0) {
 	    crm_trace("Port list queries disabled for %s", dev->id);
-	    
-	} else if(dev->targets == NULL || dev->targets_age + 60 < now) {
-	    char *output = NULL;
-	    int rc = stonith_ok;
-	    int exec_rc = stonith_ok;
-	    
-	    /* Check for the target's presence in the output of the 'list' command */
-	    slist_basic_destroy(dev->targets);
-	    dev->targets = NULL;
-	    
-	    exec_rc = run_stonith_agent(dev->agent, "list", NULL, dev->params, NULL, &rc, &output, NULL);
-            if(rc != 0 && dev->active_pid == 0) {
-                /* This device probably only supports a single
-                 * connection, which appears to already be in use,
-                 * likely involved in a montior or (less likely)
-                 * metadata operation.
-                 *
-                 * Avoid disabling port list queries in the hope that
-                 * the op would succeed next time
-                 */
-                crm_info("Couldn't query ports for %s. Call failed with rc=%d and active_pid=%d: %s",
-                         dev->agent, rc, dev->active_pid, output);
-
-	    } else if(exec_rc < 0 || rc != 0) {
-		crm_notice("Disabling port list queries for %s (%d/%d): %s",
-				dev->id, exec_rc, rc, output);
-		dev->targets_age = -1;
-
-                /* Fall back to status */
-                g_hash_table_replace(dev->params, crm_strdup(STONITH_ATTR_HOSTCHECK), crm_strdup("status"));
-		
+
+	} else if(dev->targets == NULL || dev->targets_age + 2*ttl < now) {
+	    if(dev->list_probe == NULL) {
+		dev->list_probe = start_device_probe(dev, "list", NULL, search->probe_timeout, search);
+		if(dev->list_probe) {
+		    return;
+		}
+
 	    } else {
-		crm_info("Refreshing port list for %s", dev->id);
-		dev->targets = parse_host_list(output);
-		dev->targets_age = now;
+		crm_trace("Waiting for the port list of %s", dev->id);
+		dev->list_probe->searches = g_list_append(dev->list_probe->searches, search);
+		return;
 	    }
-	
-	    crm_free(output);
+
+	} else if(dev->targets_age + ttl < now && dev->list_probe == NULL) {
+	    crm_debug("Refreshing port list for %s in the background", dev->id);
+	    dev->list_probe = start_device_probe(dev, "list", NULL, search->probe_timeout, NULL);
 	}
 	
 	if(string_in_list(dev->targets, alias)) {
@@ -630,114 +876,155 @@ static gboolean can_fence_host_with_device(stonith_device_t *dev, const char *ho
 	}
 
     } else if(safe_str_eq(check_type, "status")) {
-	int rc = 0;
-	int exec_rc = 0;
+	if(start_device_probe(dev, "status", host, search->probe_timeout, search)) {
+	    return;
+	}
 
-	/* Run the status operation for the device/target combination
-	 * Will cause problems if the device doesn't return 2 for down'd nodes or
-	 *  (for virtual nodes) if the device doesn't return 1 for guests that
-	 *  have been moved to another host
-	 */
+    } else {
+	crm_err("Unknown check type: %s", check_type);
+    }
 
-	exec_rc = run_stonith_agent(
-	    dev->agent, "status", host, dev->params, dev->aliases, &rc, NULL, NULL);
+    search_report(search, dev->id, can, check_type);
+}
 
-	if(exec_rc != 0) {
-	    crm_err("Could not invoke %s: rc=%d", dev->id, exec_rc);
+/*
+ * callback is passed the matching devices and becomes responsible for the list
+ *
+ * Devices that have not answered within timeout (ms) are assumed to be
+ * incapable, any probes are allowed to run for probe_timeout (ms).
+ */
+static void search_devices(
+    const char *host, int timeout, int probe_timeout,
+    void (*callback)(GListPtr devices, void *user_data), void *user_data)
+{
+    GHashTableIter iter;
+    stonith_device_t *dev = NULL;
+    device_search_t *search = NULL;
+
+    crm_malloc0(search, sizeof(device_search_t));
+    search->host = host?crm_strdup(host):NULL;
+    search->callback = callback;
+    search->user_data = user_data;
+    search->probe_timeout = probe_timeout;
+
+    if(timeout <= 0) {
+	timeout = STONITH_DEFAULT_TIMEOUT * 1000;
+    }
+    if(search->probe_timeout <= 0) {
+	search->probe_timeout = STONITH_DEFAULT_TIMEOUT * 1000;
+    }
 
-	} else if(rc == 1 /* unkown */) {
-	    crm_trace("Host %s is not known by %s", host, dev->id);
-	    
-	} else if(rc == 0 /* active */ || rc == 2 /* inactive */) {
-	    can = TRUE;
+    /* Hold a reference so that we can't complete mid-loop */
+    search->pending = 1;
 
-	} else {
-	    crm_notice("Unkown result when testing if %s can fence %s: rc=%d", dev->id, host, rc);
-	}
+    g_hash_table_iter_init(&iter, device_list);
+    while(g_hash_table_iter_next(&iter, NULL, (void**)&dev)) {
+	can_fence_host_with_device(dev, search);
+    }
 
-    } else {
-	crm_err("Unknown check type: %s", check_type);
+    if(search->pending > 1) {
+	/* Leave time to reply within the requester's own timeout */
+	search->timer = g_timeout_add(timeout, search_devices_timeout, search);
     }
 
-    if(safe_str_eq(host, alias)) {
-	crm_info("%s can%s fence %s: %s", dev->id, can?"":" not", host, check_type);
-    } else {
-	crm_info("%s can%s fence %s (aka. '%s'): %s", dev->id, can?"":" not", host, alias, check_type);
+    search->pending--;
+    if(search->pending == 0) {
+	search_devices_done(search);
     }
-    return can;
 }
 
+typedef struct st_query_s 
+{
+	xmlNode *request;
+	char *remote;
+} st_query_t;
 
-struct device_search_s 
+static void stonith_send_reply(xmlNode *request, const char *remote, int rc, xmlNode *data) 
 {
-	const char *host;
-	GListPtr capable;
-};
+    int call_options = 0;
+    xmlNode *reply = stonith_construct_reply(request, NULL, data, rc);
 
-static void search_devices(
-    gpointer key, gpointer value, gpointer user_data) 
+    crm_element_value_int(request, F_STONITH_CALLOPTS, &call_options);
+    if(remote) {
+	send_cluster_message(remote, crm_msg_stonith_ng, reply, FALSE);
+
+    } else {
+	do_local_reply(reply, crm_element_value(request, F_STONITH_CLIENTID),
+		       call_options & st_opt_sync_call, FALSE);
+    }
+    free_xml(reply);
+}
+
+static void stonith_query_complete(GListPtr devices, void *user_data) 
 {
-    stonith_device_t *dev = value;
-    struct device_search_s *search = user_data;
-    if(can_fence_host_with_device(dev, search->host)) {
-	search->capable = g_list_append(search->capable, value);
+    st_query_t *query = user_data;
+    xmlNode *list = NULL;
+    xmlNode *dev = get_xpath_object("//@"F_STONITH_TARGET, query->request, LOG_DEBUG_3);
+    const char *host = crm_element_value(dev, F_STONITH_TARGET);
+    int available_devices = g_list_length(devices);
+    GListPtr lpc = NULL;
+
+    if(host) {
+	crm_debug("Found %d matching devices for '%s'", available_devices, host);
+    } else {
+	crm_debug("%d devices installed", available_devices);
+    }
+    
+    /* Pack the results into data */
+    list = create_xml_node(NULL, "stonith_query");
+    crm_xml_add(list, F_STONITH_TARGET, host);
+    crm_xml_add_int(list, "st-available-devices", available_devices);
+    for(lpc = devices; lpc != NULL; lpc = lpc->next) {
+	stonith_device_t *device = (stonith_device_t*)lpc->data;
+	dev = create_xml_node(list, F_STONITH_DEVICE);
+	crm_xml_add(dev, XML_ATTR_ID, device->id);
+	crm_xml_add(dev, "namespace", device->namespace);
+	crm_xml_add(dev, "agent", device->agent);
+	if(host == NULL) {
+	    xmlNode *attrs = create_xml_node(dev, XML_TAG_ATTRS);
+	    g_hash_table_foreach(device->params, hash2field, attrs);
+	}
     }
+
+    stonith_send_reply(query->request, query->remote, available_devices, list);
+
+    g_list_free(devices);
+    free_xml(list);
+    free_xml(query->request);
+    crm_free(query->remote);
+    crm_free(query);
 }
 
-static int stonith_query(xmlNode *msg, xmlNode **list) 
+/* Replies once all devices have been checked */
+static void stonith_query(xmlNode *msg, const char *remote) 
 {
-    struct device_search_s search;
-    int available_devices = 0;
+    int timeout = 0;
+    st_query_t *query = NULL;
+    const char *host = NULL;
     xmlNode *dev = get_xpath_object("//@"F_STONITH_TARGET, msg, LOG_DEBUG_3);
 	
-    search.host = NULL;
-    search.capable = NULL;
-
     if(dev) {
         const char *device = crm_element_value(dev, F_STONITH_DEVICE);
-	search.host = crm_element_value(dev, F_STONITH_TARGET);
+	host = crm_element_value(dev, F_STONITH_TARGET);
         if(device && safe_str_eq(device, "manual_ack")) {
             /* No query necessary */
-            if(list) {
-                *list = NULL;
-            }
-            return stonith_ok;
+            return;
         }
     }
     
     crm_log_xml_debug(msg, "Query");
-	
-    g_hash_table_foreach(device_list, search_devices, &search);
-    available_devices = g_list_length(search.capable);
-    if(search.host) {
-	crm_debug("Found %d matching devices for '%s'",
-		 available_devices, search.host);
-    } else {
-	crm_debug("%d devices installed", available_devices);
-    }
-    
-    /* Pack the results into data */
-    if(list) {
-	GListPtr lpc = NULL;
-	*list = create_xml_node(NULL, __FUNCTION__);
-	crm_xml_add(*list, F_STONITH_TARGET, search.host);
-	crm_xml_add_int(*list, "st-available-devices", available_devices);
-	for(lpc = search.capable; lpc != NULL; lpc = lpc->next) {
-	    stonith_device_t *device = (stonith_device_t*)lpc->data;
-	    dev = create_xml_node(*list, F_STONITH_DEVICE);
-	    crm_xml_add(dev, XML_ATTR_ID, device->id);
-	    crm_xml_add(dev, "namespace", device->namespace);
-	    crm_xml_add(dev, "agent", device->agent);
-	    if(search.host == NULL) {
-		xmlNode *attrs = create_xml_node(dev, XML_TAG_ATTRS);
-		g_hash_table_foreach(device->params, hash2field, attrs);
-	    }
-	}
+
+    crm_element_value_int(msg, F_STONITH_TIMEOUT, &timeout);
+    if(timeout <= 0) {
+	timeout = STONITH_DEFAULT_TIMEOUT;
     }
-    
-    g_list_free(search.capable);
 
-    return available_devices;
+    crm_malloc0(query, sizeof(st_query_t));
+    query->request = copy_xml(msg);
+    query->remote = remote?crm_strdup(remote):NULL;
+
+    /* The requester only waits 1/10th of the operation's timeout for replies */
+    search_devices(host, 100 * timeout, 1000 * timeout, stonith_query_complete, query);
 }
 
 static void log_operation(async_command_t *cmd, int rc, int pid, const char *next, const char *output) 
@@ -775,12 +1062,37 @@ static void log_operation(async_command_t *cmd, int rc, int pid, const char *nex
 }
 
 #define READ_MAX 500
+static char *read_child_output(int fd) 
+{
+    int len = 0;
+    int more = 0;
+    char *output = NULL;
+
+    do {
+	char buffer[READ_MAX];
+
+	errno = 0;
+	if(fd > 0) {
+	    memset(&buffer, 0, READ_MAX);
+	    more = read(fd, buffer, READ_MAX-1);
+	    crm_trace("Got %d more bytes: %s", more, buffer);
+	}
+	
+	if(more > 0) {
+	    crm_realloc(output, len + more + 1);
+	    sprintf(output+len, "%s", buffer);
+	    len += more;
+	}
+	
+    } while (more == (READ_MAX-1) || (more < 0 && errno == EINTR));
+
+    return output;
+}
+
 static void st_child_done(GPid pid, gint status, gpointer user_data) 
 {
     int rc = st_err_generic;
 
-    int len = 0;
-    int more = 0;
     gboolean bcast = FALSE;
     
     char *output = NULL;  
@@ -823,23 +1135,7 @@ static void st_child_done(GPid pid, gint status, gpointer user_data)
 	mainloop_set_trigger(device->work);
     }
 
-    do {
-	char buffer[READ_MAX];
-
-	errno = 0;
-	if(cmd->stdout > 0) {
-	    memset(&buffer, 0, READ_MAX);
-	    more = read(cmd->stdout, buffer, READ_MAX-1);
-	    crm_trace("Got %d more bytes: %s", more, buffer);
-	}
-	
-	if(more > 0) {
-	    crm_realloc(output, len + more + 1);
-	    sprintf(output+len, "%s", buffer);
-	    len += more;
-	}
-	
-    } while (more == (READ_MAX-1) || (more < 0 && errno == EINTR));
+    output = read_child_output(cmd->stdout);
 
     if(cmd->stdout) {
 	close(cmd->stdout);
@@ -914,11 +1210,55 @@ static gint sort_device_priority(gconstpointer a, gconstpointer b)
     return 0;
 }
 
-static int stonith_fence(xmlNode *msg) 
+typedef struct st_fence_s 
+{
+	async_command_t *cmd;
+	xmlNode *request;
+	char *remote;
+} st_fence_t;
+
+static void stonith_fence_complete(GListPtr devices, void *user_data) 
+{
+    st_fence_t *fence = user_data;
+    async_command_t *cmd = fence->cmd;
+    stonith_device_t *device = NULL;
+
+    crm_info("Found %d matching devices for '%s'", g_list_length(devices), cmd->victim);
+        
+    if(g_list_length(devices) > 0) {
+	/* Order based on priority */
+	devices = g_list_sort(devices, sort_device_priority);
+            
+	device = devices->data;
+
+	/* TODO: Shouldn't we remove the element here? */
+	if(g_list_length(devices) > 1) {
+	    cmd->device_list = devices;
+	} else {
+	    g_list_free(devices);
+	}
+    }
+
+    if(device) {
+        cmd->device = device->id;
+        schedule_stonith_command(cmd, device);
+
+    } else {
+	stonith_send_reply(fence->request, fence->remote, st_err_none_available, NULL);
+	free_async_command(cmd);
+    }
+
+    free_xml(fence->request);
+    crm_free(fence->remote);
+    crm_free(fence);
+}
+
+static int stonith_fence(xmlNode *msg, const char *remote) 
 {
     int options = 0;
+    const char *host = NULL;
     const char *device_id = NULL;
-    struct device_search_s search;
+    st_fence_t *fence = NULL;
     stonith_device_t *device = NULL;
     async_command_t *cmd = create_async_command(msg);
     xmlNode *dev = get_xpath_object("//@"F_STONITH_TARGET, msg, LOG_ERR);
@@ -932,44 +1272,35 @@ static int stonith_fence(xmlNode *msg)
     device_id = crm_element_value(dev, F_STONITH_DEVICE);
     if(device_id) {
         device = g_hash_table_lookup(device_list, device_id);
-        
-    } else {
-        search.capable = NULL;
-        search.host = crm_element_value(dev, F_STONITH_TARGET);
-        
-        crm_element_value_int(msg, F_STONITH_CALLOPTS, &options);
-        if(options & st_opt_cs_nodeid) {
-            int nodeid = crm_atoi(search.host, NULL);
-            crm_node_t *node = crm_get_peer(nodeid, NULL);
-            if(node) {
-                search.host = node->uname;
-            }
+        if(device) {
+            cmd->device = device->id;
+            schedule_stonith_command(cmd, device);
+            return stonith_pending;
         }
-        
-        g_hash_table_foreach(device_list, search_devices, &search);
-        crm_info("Found %d matching devices for '%s'", g_list_length(search.capable), search.host);
-        
-        if(g_list_length(search.capable) > 0) {
-            /* Order based on priority */
-            search.capable = g_list_sort(search.capable, sort_device_priority);
-            
-            device = search.capable->data;
 
-            /* TODO: Shouldn't we remove the element here? */
-            if(g_list_length(search.capable) > 1) {
-                cmd->device_list = search.capable;
-            }
-        }
+        free_async_command(cmd);	
+        return st_err_none_available;
     }
 
-    if(device) {
-        cmd->device = device->id;
-        schedule_stonith_command(cmd, device);
-        return stonith_pending;
+    host = crm_element_value(dev, F_STONITH_TARGET);
+        
+    crm_element_value_int(msg, F_STONITH_CALLOPTS, &options);
+    if(options & st_opt_cs_nodeid) {
+        int nodeid = crm_atoi(host, NULL);
+        crm_node_t *node = crm_get_peer(nodeid, NULL);
+        if(node) {
+            host = node->uname;
+        }
     }
 
-    free_async_command(cmd);	
-    return st_err_none_available;
+    crm_malloc0(fence, sizeof(st_fence_t));
+    fence->cmd = cmd;
+    fence->request = copy_xml(msg);
+    fence->remote = remote?crm_strdup(remote):NULL;
+
+    /* The reply (or the fencing operation) follows once the search completes */
+    search_devices(host, cmd->timeout, cmd->timeout, stonith_fence_complete, fence);
+    return stonith_pending;
 }
 
 xmlNode *stonith_construct_reply(xmlNode *request, char *output, xmlNode *data, int rc) 
@@ -1078,11 +1409,8 @@ stonith_command(stonith_client_t *client, xmlNode *request, const char *remote)
 	
     } else if(crm_str_eq(op, STONITH_OP_QUERY, TRUE)) {
 	create_remote_stonith_op(client_id, request, TRUE); /* Record it for the future notification */
-	rc = stonith_query(request, &data);
-        always_reply = TRUE;
-        if(!data) {
-            return;
-        }
+	stonith_query(request, remote);
+	return;
         
     } else if(is_reply && crm_str_eq(op, T_STONITH_NOTIFY, TRUE)) {
 	process_remote_stonith_exec(request);
@@ -1115,7 +1443,7 @@ stonith_command(stonith_client_t *client, xmlNode *request, const char *remote)
     } else if(is_reply == FALSE && crm_str_eq(op, STONITH_OP_FENCE, TRUE)) {
 
         if(remote || stand_alone) {
-            rc = stonith_fence(request);
+            rc = stonith_fence(request, remote);
             
         } else if(call_options & st_opt_manual_ack) {
 	    remote_fencing_op_t *rop = initiate_remote_stonith_op(client, request, TRUE);
@@ -1,5 +1,9 @@
 #include <crm/common/mainloop.h>
 
+/* Seconds */
+#define STONITH_DEFAULT_TIMEOUT  60
+#define STONITH_DEFAULT_LIST_TTL 60
+
 typedef struct stonith_device_s {
     char *id;
     char *agent;
@@ -16,6 +20,9 @@ typedef struct stonith_device_s {
     GList *pending_ops;
     crm_trigger_t *work;
 
+    /* The port list query in progress, if any */
+    struct device_probe_s *list_probe;
+
 } stonith_device_t;
 
 typedef struct stonith_client_s {
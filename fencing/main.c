@@ -736,6 +736,12 @@ main(int argc, char ** argv)
 	printf("    <content type=\"string\" default=\"dynamic-list\"/>\n");
 	printf("  </parameter>\n");
 
+	printf("  <parameter name=\"%s\" unique=\"0\">\n", STONITH_ATTR_LIST_TTL);
+	printf("    <shortdesc lang=\"en\">How long the output of the list command can be used before it is refreshed.</shortdesc>\n");
+	printf("    <longdesc lang=\"en\">Only applies when %s=dynamic-list.  The list is refreshed in the background once it is this old and is not used once it is twice this old.</longdesc>\n", STONITH_ATTR_HOSTCHECK);
+	printf("    <content type=\"time\" default=\"60s\"/>\n");
+	printf("  </parameter>\n");
+
 	for(lpc = 0; lpc < DIMOF(actions); lpc++) {
 	    printf("  <parameter name=\"pcmk_%s_action\" unique=\"0\">\n", actions[lpc]);
 	    printf("    <shortdesc lang=\"en\">Advanced use only: An alternate command to run instead of '%s'</shortdesc>\n", actions[lpc]);
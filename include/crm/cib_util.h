@@ -46,6 +46,33 @@ extern gboolean cib_diff_version_details(xmlNode * diff, int *admin_epoch, int *
 
 extern gboolean cib_version_details(xmlNode * cib, int *admin_epoch, int *epoch, int *updates);
 
+/* Elements of interest in a CIB diff, sorted in a single pass */
+enum cib_diff_kind {
+    cib_diff_tickets = 0,
+    cib_diff_transient_attrs,   /* transient_attributes */
+    cib_diff_transient_nvpairs, /* nvpairs within transient_attributes */
+    cib_diff_node_state,
+    cib_diff_lrm_resource,
+    cib_diff_lrm_rsc_op,
+
+    cib_diff_kind_max,
+};
+
+typedef struct cib_diff_class_s {
+    gboolean config_changed;
+
+    /* in document order, as xpath_search() would return them */
+    GList *added[cib_diff_kind_max];
+    GList *removed[cib_diff_kind_max];
+
+    GHashTable *added_index[cib_diff_kind_max];
+} cib_diff_class_t;
+
+extern cib_diff_class_t *cib_diff_classify(xmlNode * diff);
+extern xmlNode *cib_diff_find_added(cib_diff_class_t * classes, enum cib_diff_kind kind,
+                                    const char *id);
+extern void cib_diff_class_free(cib_diff_class_t * classes);
+
 extern enum cib_errors update_attr_delegate(cib_t * the_cib, int call_options,
                                             const char *section, const char *node_uuid,
                                             const char *set_type, const char *set_name,
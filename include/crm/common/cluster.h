@@ -87,6 +87,7 @@ extern GFDSource *ais_source;
 gboolean crm_is_corosync_peer_active(const crm_node_t * node);
 extern gboolean send_ais_text(int class, const char *data, gboolean local,
                               const char *node, enum crm_ais_msg_types dest);
+extern void crm_cs_queue_stats(guint * depth, time_t * max_latency);
 extern gboolean get_ais_nodeid(uint32_t * id, char **uname);
 #  endif
 
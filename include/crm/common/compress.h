@@ -0,0 +1,86 @@
+/* 
+ * Copyright (C) 2012 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef CRM_COMMON_COMPRESS__H
+#  define CRM_COMMON_COMPRESS__H
+
+#  include <crm/crm.h>
+
+/*
+ * The values are sent over the wire as the is_compressed field of cluster
+ * messages.  Older peers treat any non-zero value there as bzip2, so
+ * crm_codec_bz2 must remain 1 and other codecs may only be sent to peers
+ * that have advertised support for them (see crm_codecs_supported()).
+ */
+enum crm_codec {
+    crm_codec_none = 0,
+    crm_codec_bz2  = 1,
+    crm_codec_lz4  = 2,
+    crm_codec_zstd = 3,
+    crm_codec_max
+};
+
+#  define crm_codec_bit(codec) (1 << (codec))
+
+/* What the data is, so that each can use the most appropriate codec */
+enum crm_compress_class {
+    crm_compress_cluster = 0,   /* latency sensitive cluster messages */
+    crm_compress_file    = 1,   /* on-disk archives */
+    crm_compress_class_max
+};
+
+extern const char *crm_codec2text(enum crm_codec codec);
+extern enum crm_codec crm_text2codec(const char *text);
+
+/* Bitmask of the codecs this build can decompress */
+extern uint32_t crm_codecs_supported(void);
+
+/* The codec used for class, from PCMK_<class>_compression if set */
+extern enum crm_codec crm_codec_for(enum crm_compress_class cls);
+
+/* File name extension (without the '.'), and the reverse lookup */
+extern const char *crm_codec_extension(enum crm_codec codec);
+extern enum crm_codec crm_codec_from_filename(const char *filename);
+
+/*
+ * Whether a payload of size bytes is worth compressing with codec.
+ * The threshold adapts to the ratios achieved by recent compressions.
+ */
+extern gboolean crm_compress_wanted(enum crm_codec codec, unsigned int size);
+
+/*
+ * Buffer to buffer (de)compression
+ *
+ * crm_compress() allocates *out, which the caller must free.
+ * crm_decompress() expects out to hold at least *out_len bytes (the
+ * original size) and sets *out_len to the number actually produced.
+ */
+extern gboolean crm_compress(enum crm_codec codec, const char *in, unsigned int in_len,
+                             char **out, unsigned int *out_len);
+
+extern gboolean crm_decompress(enum crm_codec codec, const char *in, unsigned int in_len,
+                               char *out, unsigned int *out_len);
+
+/*
+ * For data whose original size is not known (eg. files), returns a
+ * newly allocated, NULL terminated, buffer
+ */
+extern char *crm_decompress_all(enum crm_codec codec, const char *in, unsigned int in_len,
+                                unsigned int *out_len);
+
+#endif
@@ -63,6 +63,7 @@ ssize_t crm_ipcs_send(qb_ipcs_connection_t *c, xmlNode *msg, enum ipcs_send_flag
 xmlNode *crm_ipcs_recv(qb_ipcs_connection_t *c, void *data, size_t size);
 int crm_ipcs_client_pid(qb_ipcs_connection_t *c);
 void crm_ipcs_send_ack(qb_ipcs_connection_t *c, const char *tag, const char *function, int line);
+void crm_ipcs_queue_stats(size_t *queued_bytes, unsigned int *evictions);
 
 #include <qb/qbipcc.h>
 typedef struct crm_ipc_s crm_ipc_t;
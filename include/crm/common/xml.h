@@ -141,6 +141,22 @@ extern xmlNode *string2xml(const char *input);
 
 extern int write_xml_file(xmlNode * xml_node, const char *filename, gboolean compress);
 
+/*
+ * Append-only archives of a series of related documents
+ *
+ * If base (the previous document in the series) is supplied, xml is
+ * stored as a diff against it whenever that diff reproduces xml exactly.
+ *
+ * Individual entries are addressed as "archive@sequence", omitting the
+ * sequence selects the most recent one.
+ */
+#  define XML_ARCHIVE_SEPARATOR '@'
+
+extern int append_xml_archive(const char *archive, int sequence, xmlNode * xml, xmlNode * base,
+                              gboolean * is_delta);
+
+extern xmlNode *archive2xml(const char *spec);
+
 extern char *dump_xml_formatted(xmlNode * msg);
 
 extern char *dump_xml_unformatted(xmlNode * msg);
@@ -155,6 +171,25 @@ extern xmlNode *subtract_xml_object(xmlNode * parent, xmlNode * left, xmlNode *
 
 extern gboolean can_prune_leaf(xmlNode * xml_node);
 
+/*
+ * Record which elements of xml's document are changed from here on, so
+ * that diff_xml_object(old, xml, ...) only has to visit the changed parts.
+ * The document must not have been modified since it was copied from old.
+ */
+extern void xml_track_changes(xmlNode * xml);
+extern gboolean xml_tracking_changes(xmlNode * xml);
+
+/*
+ * Stop tracking changes and forget those already recorded
+ */
+extern void xml_accept_changes(xmlNode * xml);
+
+/*
+ * For callers that modify xml directly with libxml2 instead of the
+ * functions here: flags the change and discards any cached digests
+ */
+extern void xml_node_changed(xmlNode * xml);
+
 extern void print_xml_diff(FILE * where, xmlNode * diff);
 extern void log_xml_diff(unsigned int log_level, xmlNode * diff, const char *function);
 
@@ -201,6 +236,13 @@ extern char *calculate_operation_digest(xmlNode * local_cib, const char *version
 extern char *calculate_xml_versioned_digest(xmlNode * input, gboolean sort, gboolean do_filter,
                                             const char *version);
 
+/*
+ * Filtered digest built from per-element hashes which are cached and
+ * only recalculated along the paths changed since the previous call.
+ * Not comparable with any of the versioned digests above.
+ */
+extern char *calculate_xml_tree_digest(xmlNode * input);
+
 extern gboolean validate_xml(xmlNode * xml_blob, const char *validation, gboolean to_logs);
 extern gboolean validate_xml_verbose(xmlNode * xml_blob);
 extern int update_validation(xmlNode ** xml_blob, int *best, gboolean transform, gboolean to_logs);
@@ -47,6 +47,7 @@
 
 #  define XML_ATTR_CRM_VERSION		"crm_feature_set"
 #  define XML_ATTR_DIGEST			"digest"
+#  define XML_ATTR_TREE_DIGEST		"digest-tree"
 #  define XML_ATTR_VALIDATION		"validate-with"
 
 #  define XML_ATTR_QUORUM_PANIC		"no-quorum-panic"
@@ -46,4 +46,12 @@ extern void unpack_instance_attributes(xmlNode * top, xmlNode * xml_obj, const c
                                        const char *always_first, gboolean overwrite,
                                        ha_time_t * now);
 
+/*
+ * Keep the compiled form of rules and attribute sets from input's document
+ * until pe_rules_cache_flush().  The document must not be changed or freed
+ * in the meantime.
+ */
+extern void pe_rules_cache_enable(xmlNode * input);
+extern void pe_rules_cache_flush(void);
+
 #endif
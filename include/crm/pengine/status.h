@@ -27,6 +27,7 @@ typedef struct pe_action_s action_t;
 typedef struct pe_action_s pe_action_t;
 typedef struct resource_s resource_t;
 typedef struct ticket_s ticket_t;
+typedef struct pe_arena_s pe_arena_t;
 
 typedef enum no_quorum_policy_e {
     no_quorum_freeze,
@@ -114,6 +115,19 @@ typedef struct pe_working_set_s {
 
     GHashTable *template_rsc_sets;
 
+    /* Lookup indexes for pe_find_resource() and friends, built by cluster_status() */
+    GHashTable *resource_index; /* id, long_name or clone_name => resource_t* */
+    GHashTable *node_index_id;  /* id => node_t* */
+    GHashTable *node_index_uname;       /* uname => node_t* */
+    GHashTable *action_index;   /* uuid => GListPtr of action_t*, see pe_index_action() */
+
+    /* Storage for objects that live until cleanup_calculations(), see pe_arena_alloc() */
+    pe_arena_t *arena;
+
+    /* Threads available for processing the status section, see pe_run_parallel() */
+    int threads;
+    GHashTable *sorted_ops;     /* lrm_resource => GListPtr of lrm_rsc_op, see pe_sorted_op_list() */
+
 } pe_working_set_t;
 
 struct node_shared_s {
@@ -229,6 +243,7 @@ struct resource_s {
     GListPtr rsc_cons;          /* rsc_colocation_t* */
     GListPtr rsc_location;      /* rsc_to_node_t*    */
     GListPtr actions;           /* action_t*         */
+    GHashTable *action_index;   /* uuid => GListPtr of action_t*, see pe_index_action() */
     GListPtr rsc_tickets;       /* rsc_ticket*       */
 
     node_t *allocated_to;
@@ -277,6 +292,8 @@ struct pe_action_s {
 
     GListPtr actions_before;    /* action_warpper_t* */
     GListPtr actions_after;     /* action_warpper_t* */
+
+    GHashTable *actions_after_index;    /* action_t* => GListPtr of action_warpper_t*, see order_actions() */
 };
 
 typedef struct notify_data_s {
@@ -349,6 +366,9 @@ struct action_wrapper_s {
 gboolean cluster_status(pe_working_set_t * data_set);
 extern void set_working_set_defaults(pe_working_set_t * data_set);
 extern void cleanup_calculations(pe_working_set_t * data_set);
+
+/* Use this many threads regardless of the pe-threads cluster option (unless zero) */
+extern void pe_set_threads(int threads);
 extern resource_t *pe_find_resource(GListPtr rsc_list, const char *id_rh);
 extern node_t *pe_find_node(GListPtr node_list, const char *uname);
 extern node_t *pe_find_node_id(GListPtr node_list, const char *id);
@@ -110,6 +110,7 @@ enum stonith_errors {
 #define STONITH_ATTR_HOSTMAP	"pcmk_host_map"
 #define STONITH_ATTR_HOSTLIST	"pcmk_host_list"
 #define STONITH_ATTR_HOSTCHECK	"pcmk_host_check"
+#define STONITH_ATTR_LIST_TTL	"pcmk_list_cache_ttl"
 
 #define STONITH_ATTR_ACTION_OP	"option" /* To be replaced by 'action' at some point */
 
@@ -58,9 +58,102 @@ static gboolean update_xml_perms(xmlNode * xml, acl_obj_t * acl_obj, GHashTable
 static gboolean update_xml_children_perms(xmlNode * xml, const char *mode, GHashTable * xml_perms);
 static void free_xml_perm(gpointer xml_perm);
 
-static gboolean acl_filter_xml(xmlNode * xml, GHashTable * xml_perms);
+static xmlNode *acl_filtered_copy(xmlNode * parent, xmlNode * xml, GHashTable * xml_perms);
 static gboolean acl_check_diff_xml(xmlNode * xml, GHashTable * xml_perms);
 
+/*
+ * Everything derived from a user's ACLs and a particular CIB.  Queries
+ * from the same user are answered from here until the CIB changes (see
+ * acl_cache_flush()), rather than re-evaluating every XPath against the
+ * whole CIB each time.
+ */
+typedef struct acl_cache_s {
+    xmlNode *cib;
+    int admin_epoch;
+    int epoch;
+    int num_updates;
+
+    GListPtr user_acl;          /* unpack_user_acl() */
+
+    gboolean parsed;
+    GListPtr parsed_acl;        /* parse_acl_xpath() against cib */
+
+    gboolean filtered;
+    xmlNode *filtered_cib;      /* what the user may read of cib, NULL if nothing */
+} acl_cache_t;
+
+static GHashTable *acl_cache = NULL;
+
+static void
+free_acl_cache(gpointer data)
+{
+    acl_cache_t *cache = data;
+
+    free_acl(cache->user_acl);
+    free_acl(cache->parsed_acl);
+    free_xml(cache->filtered_cib);
+    crm_free(cache);
+}
+
+void
+acl_cache_flush(void)
+{
+    if (acl_cache != NULL && g_hash_table_size(acl_cache) > 0) {
+        crm_trace("Flushing compiled ACLs for %d users", g_hash_table_size(acl_cache));
+        g_hash_table_remove_all(acl_cache);
+    }
+}
+
+static acl_cache_t *
+acl_cache_lookup(xmlNode * xml_acls, const char *user, xmlNode * cib)
+{
+    int admin_epoch = -1;
+    int epoch = -1;
+    int num_updates = -1;
+    acl_cache_t *cache = NULL;
+
+    if (acl_cache == NULL) {
+        acl_cache =
+            g_hash_table_new_full(crm_str_hash, g_str_equal, g_hash_destroy_str, free_acl_cache);
+    }
+
+    crm_element_value_int(cib, XML_ATTR_GENERATION_ADMIN, &admin_epoch);
+    crm_element_value_int(cib, XML_ATTR_GENERATION, &epoch);
+    crm_element_value_int(cib, XML_ATTR_NUMUPDATES, &num_updates);
+
+    cache = g_hash_table_lookup(acl_cache, user);
+    if (cache != NULL
+        && cache->cib == cib
+        && cache->admin_epoch == admin_epoch
+        && cache->epoch == epoch && cache->num_updates == num_updates) {
+        crm_trace("Using compiled ACLs for user '%s'", user);
+        return cache;
+    }
+
+    crm_malloc0(cache, sizeof(acl_cache_t));
+    cache->cib = cib;
+    cache->admin_epoch = admin_epoch;
+    cache->epoch = epoch;
+    cache->num_updates = num_updates;
+    unpack_user_acl(xml_acls, user, &cache->user_acl);
+
+    g_hash_table_replace(acl_cache, crm_strdup(user), cache);
+    return cache;
+}
+
+static xmlNode *
+acl_filter_copy(xmlNode * xml, GListPtr user_acl)
+{
+    xmlNode *filtered = NULL;
+    GHashTable *xml_perms = NULL;
+
+    gen_xml_perms(xml, user_acl, &xml_perms);
+    filtered = acl_filtered_copy(NULL, xml, xml_perms);
+    g_hash_table_destroy(xml_perms);
+
+    return filtered;
+}
+
 gboolean
 acl_enabled(GHashTable * config_hash)
 {
@@ -84,7 +177,6 @@ acl_filter_cib(xmlNode * request, xmlNode * current_cib, xmlNode * orig_cib,
     xmlNode *xml_acls = NULL;
     xmlNode *tmp_cib = NULL;
     GListPtr user_acl = NULL;
-    GHashTable *xml_perms = NULL;
 
     *filtered_cib = NULL;
 
@@ -107,19 +199,28 @@ acl_filter_cib(xmlNode * request, xmlNode * current_cib, xmlNode * orig_cib,
     }
 
     user = crm_element_value(request, F_CIB_USER);
-    unpack_user_acl(xml_acls, user, &user_acl);
 
-    tmp_cib = copy_xml(orig_cib);
+    if (orig_cib == current_cib) {
+        acl_cache_t *cache = acl_cache_lookup(xml_acls, user, current_cib);
 
-    gen_xml_perms(tmp_cib, user_acl, &xml_perms);
+        if (cache->filtered == FALSE) {
+            cache->filtered_cib = acl_filter_copy(current_cib, cache->user_acl);
+            cache->filtered = TRUE;
+        }
+        tmp_cib = cache->filtered_cib;
+        if (tmp_cib != NULL) {
+            tmp_cib = copy_xml(tmp_cib);
+        }
 
-    if (acl_filter_xml(tmp_cib, xml_perms)) {
-        crm_warn("User '%s' doesn't have the permission for the whole CIB", user);
-        tmp_cib = NULL;
+    } else {
+        unpack_user_acl(xml_acls, user, &user_acl);
+        tmp_cib = acl_filter_copy(orig_cib, user_acl);
+        free_acl(user_acl);
     }
 
-    g_hash_table_destroy(xml_perms);
-    free_acl(user_acl);
+    if (tmp_cib == NULL) {
+        crm_warn("User '%s' doesn't have the permission for the whole CIB", user);
+    }
 
     *filtered_cib = tmp_cib;
     return TRUE;
@@ -133,6 +234,7 @@ acl_check_diff(xmlNode * request, xmlNode * current_cib, xmlNode * result_cib, x
     const char *user = NULL;
     xmlNode *xml_acls = NULL;
     GListPtr user_acl = NULL;
+    acl_cache_t *cache = NULL;
     xmlNode *orig_diff = NULL;
     xmlNode *diff_child = NULL;
     int rc = FALSE;
@@ -156,23 +258,32 @@ acl_check_diff(xmlNode * request, xmlNode * current_cib, xmlNode * result_cib, x
     }
 
     user = crm_element_value(request, F_CIB_USER);
-    unpack_user_acl(xml_acls, user, &user_acl);
+    cache = acl_cache_lookup(xml_acls, user, current_cib);
+    user_acl = cache->user_acl;
 
     orig_diff = diff_xml_object_orig(current_cib, result_cib, FALSE, diff);
 
     for (diff_child = __xml_first_child(orig_diff); diff_child; diff_child = __xml_next(diff_child)) {
         const char *tag = crm_element_name(diff_child);
         GListPtr parsed_acl = NULL;
+        GListPtr free_parsed = NULL;
         xmlNode *diff_cib = NULL;
 
         crm_debug("Preparing ACL checking on '%s'", tag);
 
         if (crm_str_eq(tag, XML_TAG_DIFF_REMOVED, TRUE)) {
-            crm_debug("Parsing any xpaths under the ACL according to the current CIB");
-            parse_acl_xpath(current_cib, user_acl, &parsed_acl);
+            if (cache->parsed == FALSE) {
+                crm_debug("Parsing any xpaths under the ACL according to the current CIB");
+                parse_acl_xpath(current_cib, user_acl, &cache->parsed_acl);
+                cache->parsed = TRUE;
+            }
+            parsed_acl = cache->parsed_acl;
+
         } else if (crm_str_eq(tag, XML_TAG_DIFF_ADDED, TRUE)) {
             crm_debug("Parsing any xpaths under the ACL according to the result CIB");
             parse_acl_xpath(result_cib, user_acl, &parsed_acl);
+            free_parsed = parsed_acl;
+
         } else {
             continue;
         }
@@ -187,15 +298,15 @@ acl_check_diff(xmlNode * request, xmlNode * current_cib, xmlNode * result_cib, x
             if (rc == FALSE) {
                 crm_warn("User '%s' doesn't have enough permission to modify the CIB objects",
                          user);
+                free_acl(free_parsed);
                 goto done;
             }
         }
-        free_acl(parsed_acl);
+        free_acl(free_parsed);
     }
 
   done:
     free_xml(orig_diff);
-    free_acl(user_acl);
     return rc;
 }
 
@@ -650,18 +761,33 @@ free_xml_perm(gpointer xml_perm)
 
 #define can_write(mode) crm_str_eq(mode, XML_ACL_TAG_WRITE, TRUE)
 
-/* rc = TRUE if the xml is filtered out*/
-static gboolean
-acl_filter_xml(xmlNode * xml, GHashTable * xml_perms)
+/*
+ * Returns the parts of xml that the user may read, as a new child of parent
+ * (or a new document when parent is NULL), or NULL if there are none.
+ *
+ * Rather than copying everything and then discarding what the user may
+ * not see, only the readable elements and attributes are ever copied.
+ */
+static xmlNode *
+acl_filtered_copy(xmlNode * parent, xmlNode * xml, GHashTable * xml_perms)
 {
     int children_counter = 0;
     xml_perm_t *perm = NULL;
     int allow_counter = 0;
+    xmlNode *copy = NULL;
     xmlNode *child = NULL;
+    xmlAttrPtr xIter = NULL;
 
-    for (child = __xml_first_child(xml); child; child = __xml_next(child)) {
-        if (acl_filter_xml(child, xml_perms) == FALSE) {
-            children_counter++;
+    copy = create_xml_node(parent, crm_element_name(xml));
+
+    for (child = xml->children; child; child = child->next) {
+        if (child->type == XML_ELEMENT_NODE) {
+            if (acl_filtered_copy(copy, child, xml_perms) != NULL) {
+                children_counter++;
+            }
+
+        } else if (child->type == XML_COMMENT_NODE) {
+            xmlAddChild(copy, xmlDocCopyNode(child, copy->doc, 1));
         }
     }
 
@@ -675,7 +801,7 @@ acl_filter_xml(xmlNode * xml, GHashTable * xml_perms)
 
     if (perm->attribute_perms == NULL) {
         if (can_read(perm->mode)) {
-            return FALSE;
+            goto keep_all;
         } else {
             crm_trace("No enough permission to read the element: element_mode=%s, tag=%s, id=%s",
                       perm->mode, crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID));
@@ -683,58 +809,67 @@ acl_filter_xml(xmlNode * xml, GHashTable * xml_perms)
         }
     }
 
-    if (xml) {
-        xmlAttrPtr xIter = xml->properties;
-
-        while (xIter) {
-            const char *prop_name = (const char *)xIter->name;
-            gpointer mode = NULL;
+    for (xIter = xml->properties; xIter; xIter = xIter->next) {
+        const char *prop_name = (const char *)xIter->name;
+        gpointer mode = NULL;
 
-            xIter = xIter->next;
-            if (g_hash_table_lookup_extended(perm->attribute_perms, prop_name, NULL, &mode)) {
-                if (can_read(mode)) {
-                    allow_counter++;
-                } else {
-                    xml_remove_prop(xml, prop_name);
-                    crm_trace
-                        ("Filtered out the attribute: attribute_mode=%s, tag=%s, id=%s, attribute=%s",
-                         (char *)mode, crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID),
-                         prop_name);
-                }
+        if (g_hash_table_lookup_extended(perm->attribute_perms, prop_name, NULL, &mode)) {
+            if (can_read(mode)) {
+                allow_counter++;
             } else {
-                if (can_read(perm->mode)) {
-                    allow_counter++;
-                } else if (crm_str_eq(prop_name, XML_ATTR_ID, TRUE) == FALSE) {
-                    xml_remove_prop(xml, prop_name);
-                    crm_trace
-                        ("Filtered out the attribute: element_mode=%s, tag=%s, id=%s, attribute=%s",
-                         perm->mode, crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID),
-                         prop_name);
-                }
+                crm_trace
+                    ("Filtered out the attribute: attribute_mode=%s, tag=%s, id=%s, attribute=%s",
+                     (char *)mode, crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID),
+                     prop_name);
+                continue;
+            }
+        } else {
+            if (can_read(perm->mode)) {
+                allow_counter++;
+            } else if (crm_str_eq(prop_name, XML_ATTR_ID, TRUE) == FALSE) {
+                crm_trace
+                    ("Filtered out the attribute: element_mode=%s, tag=%s, id=%s, attribute=%s",
+                     perm->mode, crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID),
+                     prop_name);
+                continue;
             }
         }
+        crm_xml_add(copy, prop_name, crm_element_value(xml, prop_name));
     }
 
-    if (allow_counter) {
-        return FALSE;
+    if (allow_counter || can_read(perm->mode)) {
+        return copy;
     }
 
-    if (can_read(perm->mode)) {
-        return FALSE;
+    if (children_counter) {
+        crm_trace
+            ("Don't filter out the element (tag=%s, id=%s) because user can read its children",
+             crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID));
+        return copy;
     }
+    goto discard;
 
   end_filter:
     if (children_counter) {
         crm_trace
             ("Don't filter out the element (tag=%s, id=%s) because user can read its children",
              crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID));
-        return FALSE;
+        goto keep_all;
     }
 
-    free_xml_from_parent(NULL, xml);
+  discard:
     crm_trace("Filtered out the element: tag=%s, id=%s",
               crm_element_name(xml), crm_element_value(xml, XML_ATTR_ID));
-    return TRUE;
+    free_xml_from_parent(parent, copy);
+    return NULL;
+
+  keep_all:
+    for (xIter = xml->properties; xIter; xIter = xIter->next) {
+        const char *prop_name = (const char *)xIter->name;
+
+        crm_xml_add(copy, prop_name, crm_element_value(xml, prop_name));
+    }
+    return copy;
 }
 
 static gboolean
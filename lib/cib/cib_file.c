@@ -29,6 +29,7 @@
 #include <crm/cib.h>
 #include <crm/msg_xml.h>
 #include <crm/common/ipc.h>
+#include <crm/common/compress.h>
 #include <cib_private.h>
 
 typedef struct cib_file_opaque_s {
@@ -175,7 +176,7 @@ cib_file_signoff(cib_t * cib)
 
     crm_debug("Signing out of the CIB Service");
 
-    if (strstr(private->filename, ".bz2") != NULL) {
+    if (crm_codec_from_filename(private->filename) != crm_codec_none) {
         rc = write_xml_file(in_mem_cib, private->filename, TRUE);
 
     } else {
@@ -748,7 +748,7 @@ gboolean
 cib_config_changed(xmlNode * last, xmlNode * next, xmlNode ** diff)
 {
     gboolean config_changes = FALSE;
-    xmlXPathObject *xpathObj = NULL;
+    cib_diff_class_t *classes = NULL;
 
     CRM_ASSERT(diff != NULL);
 
@@ -756,49 +756,13 @@ cib_config_changed(xmlNode * last, xmlNode * next, xmlNode ** diff)
         *diff = diff_xml_object(last, next, FALSE);
     }
     if (*diff == NULL) {
-        goto done;
+        return FALSE;
     }
 
-    xpathObj = xpath_search(*diff, "//" XML_CIB_TAG_CONFIGURATION);
-    if (xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-        config_changes = TRUE;
-        goto done;
+    classes = cib_diff_classify(*diff);
+    config_changes = classes->config_changed;
+    cib_diff_class_free(classes);
 
-    } else if (xpathObj) {
-        xmlXPathFreeObject(xpathObj);
-    }
-
-    xpathObj = xpath_search(*diff, "//" XML_TAG_DIFF_REMOVED "//" XML_TAG_CIB);
-    if (xpathObj) {
-        int lpc = 0, max = xpathObj->nodesetval->nodeNr;
-
-        for (lpc = 0; lpc < max; lpc++) {
-            xmlNode *top = getXpathResult(xpathObj, lpc);
-
-            if (crm_element_value(top, XML_ATTR_GENERATION) != NULL) {
-                config_changes = TRUE;
-                goto done;
-            }
-            if (crm_element_value(top, XML_ATTR_GENERATION_ADMIN) != NULL) {
-                config_changes = TRUE;
-                goto done;
-            }
-
-            if (crm_element_value(top, XML_ATTR_VALIDATION) != NULL) {
-                config_changes = TRUE;
-                goto done;
-            }
-            if (crm_element_value(top, XML_ATTR_CRM_VERSION) != NULL) {
-                config_changes = TRUE;
-                goto done;
-            }
-        }
-    }
-
-  done:
-    if (xpathObj) {
-        xmlXPathFreeObject(xpathObj);
-    }
     return config_changes;
 }
 
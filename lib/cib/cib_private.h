@@ -48,6 +48,8 @@ struct timer_rec_s {
 typedef enum cib_errors (*cib_op_t) (const char *, int, const char *, xmlNode *,
                                      xmlNode *, xmlNode *, xmlNode **, xmlNode **);
 
+typedef struct cib_txn_s cib_txn_t;
+
 extern cib_t *cib_new_variant(void);
 
 enum cib_errors
@@ -58,6 +60,15 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
                gboolean manage_counters, gboolean * config_changed,
                xmlNode * current_cib, xmlNode ** result_cib, xmlNode ** diff, xmlNode ** output);
 
+extern enum cib_errors cib_perform_op_txn(const char *op, int call_options, cib_op_t * fn,
+                                          gboolean is_query, const char *section, xmlNode * req,
+                                          xmlNode * input, gboolean manage_counters,
+                                          gboolean * config_changed, xmlNode * current_cib,
+                                          xmlNode ** result_cib, xmlNode ** diff,
+                                          xmlNode ** output, cib_txn_t ** txn);
+extern void cib_txn_commit(cib_txn_t * txn);
+extern void cib_txn_rollback(cib_txn_t * txn);
+
 extern xmlNode *cib_create_op(int call_id, const char *token, const char *op, const char *host,
                               const char *section, xmlNode * data, int call_options,
                               const char *user_name);
@@ -75,5 +86,6 @@ extern gboolean acl_filter_cib(xmlNode * request, xmlNode * current_cib, xmlNode
                                xmlNode ** filtered_cib);
 extern gboolean acl_check_diff(xmlNode * request, xmlNode * current_cib, xmlNode * result_cib,
                                xmlNode * diff);
+extern void acl_cache_flush(void);
 
 #endif
@@ -417,6 +417,130 @@ cib_diff_version_details(xmlNode * diff, int *admin_epoch, int *epoch, int *upda
     return TRUE;
 }
 
+static void
+cib_diff_classify_xml(cib_diff_class_t * classes, xmlNode * xml, gboolean added,
+                      gboolean in_transient)
+{
+    int kind = -1;
+    const char *name = crm_element_name(xml);
+
+    if (safe_str_eq(name, XML_CIB_TAG_CONFIGURATION)) {
+        classes->config_changed = TRUE;
+
+    } else if (added == FALSE && safe_str_eq(name, XML_TAG_CIB)) {
+        /* These only change along with the configuration */
+        if (crm_element_value(xml, XML_ATTR_GENERATION) != NULL
+            || crm_element_value(xml, XML_ATTR_GENERATION_ADMIN) != NULL
+            || crm_element_value(xml, XML_ATTR_VALIDATION) != NULL
+            || crm_element_value(xml, XML_ATTR_CRM_VERSION) != NULL) {
+            classes->config_changed = TRUE;
+        }
+
+    } else if (safe_str_eq(name, XML_CIB_TAG_TICKETS)) {
+        kind = cib_diff_tickets;
+
+    } else if (safe_str_eq(name, XML_TAG_TRANSIENT_NODEATTRS)) {
+        kind = cib_diff_transient_attrs;
+
+    } else if (in_transient && safe_str_eq(name, XML_CIB_TAG_NVPAIR)) {
+        kind = cib_diff_transient_nvpairs;
+
+    } else if (safe_str_eq(name, XML_CIB_TAG_STATE)) {
+        kind = cib_diff_node_state;
+
+    } else if (safe_str_eq(name, XML_LRM_TAG_RESOURCE)) {
+        kind = cib_diff_lrm_resource;
+
+    } else if (safe_str_eq(name, XML_LRM_TAG_RSC_OP)) {
+        kind = cib_diff_lrm_rsc_op;
+    }
+
+    if (kind >= 0 && added) {
+        classes->added[kind] = g_list_prepend(classes->added[kind], xml);
+
+    } else if (kind >= 0) {
+        classes->removed[kind] = g_list_prepend(classes->removed[kind], xml);
+    }
+
+    if (kind == cib_diff_transient_attrs) {
+        in_transient = TRUE;
+    }
+
+    xml_child_iter(xml, child, cib_diff_classify_xml(classes, child, added, in_transient));
+}
+
+/*
+ * Sorts everything callers of CIB diff notifications commonly look for
+ * into per-kind lists with one walk of the diff, rather than one
+ * xpath_search() per question.
+ *
+ * The caller should free the result with cib_diff_class_free()
+ */
+cib_diff_class_t *
+cib_diff_classify(xmlNode * diff)
+{
+    int kind = 0;
+    cib_diff_class_t *classes = NULL;
+
+    crm_malloc0(classes, sizeof(cib_diff_class_t));
+
+    xml_child_iter(diff, section,
+                   if (safe_str_eq(crm_element_name(section), XML_TAG_DIFF_ADDED)) {
+                       cib_diff_classify_xml(classes, section, TRUE, FALSE);
+
+                   } else if (safe_str_eq(crm_element_name(section), XML_TAG_DIFF_REMOVED)) {
+                       cib_diff_classify_xml(classes, section, FALSE, FALSE);
+                   }
+        );
+
+    for (kind = 0; kind < cib_diff_kind_max; kind++) {
+        classes->added[kind] = g_list_reverse(classes->added[kind]);
+        classes->removed[kind] = g_list_reverse(classes->removed[kind]);
+    }
+    return classes;
+}
+
+/* The first added element of the given kind with a matching id */
+xmlNode *
+cib_diff_find_added(cib_diff_class_t * classes, enum cib_diff_kind kind, const char *id)
+{
+    CRM_CHECK(classes != NULL && kind < cib_diff_kind_max && id != NULL, return NULL);
+
+    if (classes->added_index[kind] == NULL) {
+        GList *gIter = classes->added[kind];
+
+        classes->added_index[kind] = g_hash_table_new(crm_str_hash, g_str_equal);
+        for (; gIter != NULL; gIter = gIter->next) {
+            xmlNode *xml = gIter->data;
+            const char *xml_id = ID(xml);
+
+            if (xml_id && g_hash_table_lookup(classes->added_index[kind], xml_id) == NULL) {
+                g_hash_table_insert(classes->added_index[kind], (gpointer) xml_id, xml);
+            }
+        }
+    }
+    return g_hash_table_lookup(classes->added_index[kind], id);
+}
+
+void
+cib_diff_class_free(cib_diff_class_t * classes)
+{
+    int kind = 0;
+
+    if (classes == NULL) {
+        return;
+    }
+
+    for (kind = 0; kind < cib_diff_kind_max; kind++) {
+        g_list_free(classes->added[kind]);
+        g_list_free(classes->removed[kind]);
+        if (classes->added_index[kind]) {
+            g_hash_table_destroy(classes->added_index[kind]);
+        }
+    }
+    crm_free(classes);
+}
+
 /*
  * The caller should never free the return value
  */
@@ -595,15 +719,357 @@ fix_cib_diff(xmlNode * last, xmlNode * next, xmlNode * local_diff, gboolean chan
     crm_log_xml_trace(local_diff, "Repaired-diff");
 }
 
+/*
+ * In-place transactions
+ *
+ * Status updates from attrd and the crmd make up the bulk of the writes
+ * handled by the DC, and nearly all of them touch a single node_state.
+ * Rather than deep-copying the whole CIB for each one, modify and delete
+ * operations against the status section can be applied directly to the
+ * live tree.
+ *
+ * Beforehand we locate the subtree the operation will touch, using the
+ * same matching rules as update_xml_child() and replace_xml_child(), and
+ * copy only that.  The copy is enough to undo the change and to build a
+ * diff identical to the one diff_xml_object() would produce for the
+ * whole CIB, since everything outside the touched subtree is unchanged.
+ */
+struct cib_txn_s {
+    xmlNode *cib;               /* The live CIB being modified */
+    xmlNode *top;               /* Copy of the root element's attributes */
+    xmlNode *parent;            /* Live parent of the affected subtree */
+    xmlNode *target;            /* Live affected subtree (NULL if deleted) */
+    xmlNode *next;              /* Live sibling following a deleted subtree */
+    xmlNode *backup;            /* Pristine copy of the subtree (NULL if created) */
+    gboolean create;            /* A modify that will add a new child */
+};
+
+static xmlNode *
+cib_txn_copy_top(xmlNode * top)
+{
+    xmlNode *copy = create_xml_node(NULL, crm_element_name(top));
+
+    xml_prop_iter(top, name, value, xmlSetProp(copy, (const xmlChar *)name, (const xmlChar *)value));
+    return copy;
+}
+
+/* Mirrors the search performed by update_xml_child() */
+static xmlNode *
+cib_txn_find_update(xmlNode * root, xmlNode * update)
+{
+    xmlNode *child = NULL;
+
+    if (safe_str_neq(crm_element_name(update), crm_element_name(root)) == FALSE
+        && safe_str_neq(ID(update), ID(root)) == FALSE) {
+        return root;
+    }
+
+    for (child = __xml_first_child(root); child != NULL; child = __xml_next(child)) {
+        xmlNode *match = cib_txn_find_update(child, update);
+
+        if (match != NULL) {
+            return match;
+        }
+    }
+    return NULL;
+}
+
+/* Mirrors the search performed by replace_xml_child(..., delete_only=TRUE) */
+static xmlNode *
+cib_txn_find_delete(xmlNode * parent, xmlNode * child, xmlNode * update)
+{
+    gboolean can_delete = FALSE;
+    const char *up_id = ID(update);
+    xmlNode *child_of_child = NULL;
+
+    if (up_id == NULL || safe_str_eq(ID(child), up_id)) {
+        can_delete = TRUE;
+    }
+    if (safe_str_neq(crm_element_name(update), crm_element_name(child))) {
+        can_delete = FALSE;
+    }
+    if (can_delete) {
+        xml_prop_iter(update, prop_name, left_value,
+                      if (safe_str_neq(left_value, crm_element_value(child, prop_name))) {
+                          can_delete = FALSE;
+                      }
+            );
+    }
+
+    if (can_delete && parent != NULL) {
+        return child;
+    }
+
+    for (child_of_child = __xml_first_child(child); child_of_child != NULL;
+         child_of_child = __xml_next(child_of_child)) {
+        xmlNode *match = cib_txn_find_delete(child, child_of_child, update);
+
+        if (match != NULL) {
+            return match;
+        }
+    }
+    return NULL;
+}
+
+static cib_txn_t *
+cib_txn_begin(const char *op, int call_options, const char *section, xmlNode * input,
+              xmlNode * current_cib)
+{
+    xmlNode *obj_root = NULL;
+    xmlNode *target = NULL;
+    cib_txn_t *txn = NULL;
+
+    if (input == NULL || current_cib == NULL || (call_options & cib_xpath)) {
+        return NULL;
+
+    } else if (safe_str_neq(section, XML_CIB_TAG_STATUS)) {
+        return NULL;
+
+    } else if (safe_str_neq(op, CIB_OP_MODIFY) && safe_str_neq(op, CIB_OP_DELETE)) {
+        return NULL;
+    }
+
+    obj_root = get_object_root(section, current_cib);
+    if (obj_root == NULL) {
+        return NULL;
+    }
+
+    crm_malloc0(txn, sizeof(cib_txn_t));
+    txn->cib = current_cib;
+    txn->top = cib_txn_copy_top(current_cib);
+
+    if (safe_str_eq(op, CIB_OP_MODIFY)) {
+        target = cib_txn_find_update(obj_root, input);
+        if (target == NULL) {
+            txn->parent = obj_root;
+            txn->create = TRUE;
+
+        } else {
+            txn->parent = target->parent;
+            txn->target = target;
+            txn->backup = copy_xml(target);
+        }
+
+    } else {
+        target = cib_txn_find_delete(NULL, obj_root, input);
+        if (target == NULL) {
+            txn->parent = obj_root;
+
+        } else {
+            txn->parent = target->parent;
+            txn->next = target->next;
+            txn->backup = copy_xml(target);
+        }
+    }
+
+    crm_trace("Performing %s in-place on <%s id=%s>", op,
+              crm_element_name(target ? target : obj_root), crm_str(ID(target)));
+    return txn;
+}
+
+static void
+cib_txn_free(cib_txn_t * txn)
+{
+    free_xml(txn->top);
+    free_xml(txn->backup);
+    crm_free(txn);
+}
+
+void
+cib_txn_commit(cib_txn_t * txn)
+{
+    if (txn != NULL) {
+        cib_txn_free(txn);
+    }
+}
+
+void
+cib_txn_rollback(cib_txn_t * txn)
+{
+    xmlDoc *doc = NULL;
+    xmlAttrPtr attr = NULL;
+
+    if (txn == NULL) {
+        return;
+    }
+
+    /* Restore the counters and anything else set on the root */
+    attr = txn->cib->properties;
+    while (attr != NULL) {
+        xmlAttrPtr next = attr->next;
+
+        xmlRemoveProp(attr);
+        attr = next;
+    }
+    xml_prop_iter(txn->top, name, value,
+                  xmlSetProp(txn->cib, (const xmlChar *)name, (const xmlChar *)value));
+
+    if (txn->target != NULL && txn->backup != NULL) {
+        /* Modified */
+        xmlNode *old = NULL;
+
+        doc = txn->backup->doc;
+        old = xmlReplaceNode(txn->target, txn->backup);
+        free_xml_from_parent(NULL, old);
+
+    } else if (txn->target != NULL) {
+        /* Created */
+        free_xml_from_parent(txn->parent, txn->target);
+
+    } else if (txn->backup != NULL) {
+        /* Deleted */
+        doc = txn->backup->doc;
+        xmlUnlinkNode(txn->backup);
+        if (txn->next != NULL) {
+            xmlAddPrevSibling(txn->next, txn->backup);
+        } else {
+            xmlAddChild(txn->parent, txn->backup);
+        }
+    }
+
+    if (doc != NULL) {
+        /* The backup now belongs to the live CIB */
+        xmlDocSetRootElement(doc, NULL);
+        xmlFreeDoc(doc);
+        txn->backup = NULL;
+    }
+
+    /* None of the above went through the tracked mutators */
+    xml_node_changed(txn->cib);
+    xml_node_changed(txn->parent);
+
+#if ENABLE_ACL
+    /* The counters are back to what they were, but the nodes are not the
+     * ones anything compiled against them points to
+     */
+    acl_cache_flush();
+#endif
+
+    crm_trace("Rolled back in-place changes to <%s>", crm_element_name(txn->parent));
+    cib_txn_free(txn);
+}
+
+/*
+ * subtract_xml_object() pairs children by name and id, so the partial diff
+ * is only equivalent if nothing else under the same parent could be paired
+ * with the affected subtree or any of its ancestors
+ */
+static gboolean
+cib_txn_unique(xmlNode * parent, xmlNode * node, xmlNode * like)
+{
+    xmlNode *child = NULL;
+    const char *id = ID(like);
+    const char *name = crm_element_name(like);
+
+    for (child = __xml_first_child(parent); child != NULL; child = __xml_next(child)) {
+        const char *child_id = ID(child);
+
+        if (child == node || safe_str_neq(name, crm_element_name(child))) {
+            continue;
+
+        } else if (id == NULL || child_id == NULL || safe_str_eq(id, child_id)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean
+cib_txn_diffable(cib_txn_t * txn)
+{
+    xmlNode *iter = NULL;
+    xmlNode *leaf = txn->target ? txn->target : txn->backup;
+
+    if (leaf != NULL && cib_txn_unique(txn->parent, txn->target, leaf) == FALSE) {
+        return FALSE;
+    }
+
+    for (iter = txn->parent; iter != txn->cib; iter = iter->parent) {
+        if (cib_txn_unique(iter->parent, iter, iter) == FALSE) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Build <cib> -> ... -> parent -> leaf, with only the root and the
+ * ancestors' attributes in addition to (a copy of) the leaf
+ */
+static xmlNode *
+cib_txn_skeleton(xmlNode * top, xmlNode * parent, xmlNode * leaf)
+{
+    GListPtr path = NULL;
+    GListPtr gIter = NULL;
+    xmlNode *iter = NULL;
+    xmlNode *skeleton = cib_txn_copy_top(top);
+    xmlNode *last = skeleton;
+
+    for (iter = parent; iter != NULL && iter->parent != NULL
+         && iter->parent->type == XML_ELEMENT_NODE; iter = iter->parent) {
+        path = g_list_prepend(path, iter);
+    }
+
+    for (gIter = path; gIter != NULL; gIter = gIter->next) {
+        xmlNode *ancestor = (xmlNode *) gIter->data;
+
+        last = create_xml_node(last, crm_element_name(ancestor));
+        xml_prop_iter(ancestor, name, value,
+                      xmlSetProp(last, (const xmlChar *)name, (const xmlChar *)value));
+    }
+    g_list_free(path);
+
+    if (leaf != NULL) {
+        add_node_copy(last, leaf);
+    }
+    return skeleton;
+}
+
+static gboolean
+cib_txn_config_changed(cib_txn_t * txn, xmlNode ** diff)
+{
+    gboolean changed = FALSE;
+    xmlNode *last = cib_txn_skeleton(txn->top, txn->parent, txn->backup);
+    xmlNode *next = cib_txn_skeleton(txn->cib, txn->parent, txn->target);
+
+    changed = cib_config_changed(last, next, diff);
+
+    free_xml(last);
+    free_xml(next);
+    return changed;
+}
+
 enum cib_errors
 cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_query,
                const char *section, xmlNode * req, xmlNode * input,
                gboolean manage_counters, gboolean * config_changed,
                xmlNode * current_cib, xmlNode ** result_cib, xmlNode ** diff, xmlNode ** output)
 {
+    return cib_perform_op_txn(op, call_options, fn, is_query, section, req, input,
+                              manage_counters, config_changed, current_cib, result_cib, diff,
+                              output, NULL);
+}
+
+/*
+ * If txn is non-NULL, the operation may be applied to current_cib itself
+ * rather than a copy of it.  In that case *txn is set, *result_cib will
+ * be current_cib and the caller must either cib_txn_commit() or
+ * cib_txn_rollback() the changes once it is done with them.
+ *
+ * On failure current_cib is always left untouched and *result_cib, if
+ * set, is a separate copy.
+ */
+enum cib_errors
+cib_perform_op_txn(const char *op, int call_options, cib_op_t * fn, gboolean is_query,
+                   const char *section, xmlNode * req, xmlNode * input,
+                   gboolean manage_counters, gboolean * config_changed,
+                   xmlNode * current_cib, xmlNode ** result_cib, xmlNode ** diff,
+                   xmlNode ** output, cib_txn_t ** txn)
+{
 
     int rc = cib_ok;
     gboolean check_dtd = TRUE;
+    cib_txn_t *in_place = NULL;
+    xmlNode *last_cib = current_cib;
     xmlNode *scratch = NULL;
     xmlNode *local_diff = NULL;
     const char *current_dtd = "unknown";
@@ -615,6 +1081,9 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
     *output = NULL;
     *result_cib = NULL;
     *config_changed = FALSE;
+    if (txn != NULL) {
+        *txn = NULL;
+    }
 
     if (fn == NULL) {
         return cib_operation;
@@ -625,10 +1094,43 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
         return rc;
     }
 
-    scratch = copy_xml(current_cib);
-    rc = (*fn) (op, call_options, section, req, input, current_cib, &scratch, output);
+    if (txn != NULL && manage_counters) {
+        in_place = cib_txn_begin(op, call_options, section, input, current_cib);
+    }
+
+    if (in_place != NULL) {
+        scratch = current_cib;
+        rc = (*fn) (op, call_options, section, req, input, current_cib, &scratch, output);
+        CRM_CHECK(scratch == current_cib, cib_txn_free(in_place); return cib_unknown);
 
-    CRM_CHECK(current_cib != scratch, return cib_unknown);
+        if (rc != cib_ok) {
+            /* Modify and delete only fail before touching the tree */
+            cib_txn_free(in_place);
+            return rc;
+        }
+
+        if (in_place->create) {
+            in_place->target = in_place->parent->last;
+        }
+
+        if (cib_txn_diffable(in_place)) {
+            last_cib = in_place->top;
+
+        } else {
+            crm_trace("Ambiguous %s target, falling back to a full copy", op);
+            cib_txn_rollback(in_place);
+            in_place = NULL;
+            scratch = NULL;
+        }
+    }
+
+    if (scratch == NULL) {
+        scratch = copy_xml(current_cib);
+        xml_track_changes(scratch);
+        rc = (*fn) (op, call_options, section, req, input, current_cib, &scratch, output);
+
+        CRM_CHECK(current_cib != scratch, return cib_unknown);
+    }
 
     if (rc == cib_ok && scratch == NULL) {
         rc = cib_unknown;
@@ -649,7 +1151,7 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
         int new = 0;
 
         crm_element_value_int(scratch, XML_ATTR_GENERATION_ADMIN, &new);
-        crm_element_value_int(current_cib, XML_ATTR_GENERATION_ADMIN, &old);
+        crm_element_value_int(last_cib, XML_ATTR_GENERATION_ADMIN, &old);
 
         if (old > new) {
             crm_err("%s went backwards: %d -> %d (Opts: 0x%x)",
@@ -660,7 +1162,7 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
 
         } else if (old == new) {
             crm_element_value_int(scratch, XML_ATTR_GENERATION, &new);
-            crm_element_value_int(current_cib, XML_ATTR_GENERATION, &old);
+            crm_element_value_int(last_cib, XML_ATTR_GENERATION, &old);
             if (old > new) {
                 crm_err("%s went backwards: %d -> %d (Opts: 0x%x)",
                         XML_ATTR_GENERATION, old, new, call_options);
@@ -672,7 +1174,13 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
     }
 
     if (rc == cib_ok) {
-        fix_plus_plus_recursive(scratch);
+        if (in_place == NULL) {
+            fix_plus_plus_recursive(scratch);
+
+        } else if (in_place->target) {
+            /* Anything outside the target was expanded by an earlier update */
+            fix_plus_plus_recursive(in_place->target);
+        }
         current_dtd = crm_element_value(scratch, XML_ATTR_VALIDATION);
 
         if (manage_counters) {
@@ -686,8 +1194,15 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
              * CIB's total CPU usage on the DC
              *
              * RNG validation on the otherhand, accounts for only 9%... 
+             *
+             * Both in-place operations and change tracking on scratch limit
+             * the diff to the parts of the CIB that were actually touched
              */
-            *config_changed = cib_config_changed(current_cib, scratch, &local_diff);
+            if (in_place) {
+                *config_changed = cib_txn_config_changed(in_place, &local_diff);
+            } else {
+                *config_changed = cib_config_changed(current_cib, scratch, &local_diff);
+            }
 
             if (*config_changed) {
                 cib_update_counter(scratch, XML_ATTR_NUMUPDATES, TRUE);
@@ -735,7 +1250,7 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
 
     if (diff != NULL && local_diff != NULL) {
         /* Only fix the diff if we'll return it... */
-        fix_cib_diff(current_cib, scratch, local_diff, *config_changed);
+        fix_cib_diff(last_cib, scratch, local_diff, *config_changed);
         *diff = local_diff;
         local_diff = NULL;
     }
@@ -746,7 +1261,21 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
         rc = cib_dtd_validation;
     }
 
-    *result_cib = scratch;
+    /* Any diff has been calculated by now */
+    xml_accept_changes(scratch);
+
+    if (in_place != NULL && rc != cib_ok) {
+        /* Hand back a copy of the rejected CIB, as the full copy path would */
+        *result_cib = copy_xml(scratch);
+        cib_txn_rollback(in_place);
+
+    } else {
+        *result_cib = scratch;
+        if (txn != NULL) {
+            *txn = in_place;
+        }
+    }
+
     free_xml(local_diff);
     return rc;
 }
@@ -17,7 +17,6 @@
  */
 
 #include <crm_internal.h>
-#include <bzlib.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -26,7 +25,9 @@
 #include <crm/common/ipc.h>
 #include <crm/common/cluster.h>
 #include <crm/common/mainloop.h>
+#include <crm/common/compress.h>
 #include <sys/utsname.h>
+#include <time.h>
 #include "stack.h"
 
 #include <qb/qbipcc.h>
@@ -53,6 +54,45 @@ static char *pcmk_uname = NULL;
 static int pcmk_uname_len = 0;
 static uint32_t pcmk_nodeid = 0;
 
+/* The members of our CPG group and the codecs each has advertised
+ *
+ * Peers advertise the codecs they can decompress in the (otherwise
+ * unused) sender.local field of every message.  Older peers leave it
+ * zero and so only ever receive bzip2.  The membership is kept current by
+ * pcmk_cpg_membership(), a peer that (re)joins starts with nothing until
+ * it has advertised again.
+ */
+static GHashTable *cs_peer_codecs = NULL;
+
+static enum crm_codec
+cs_message_codec(enum crm_codec codec)
+{
+    GHashTableIter iter;
+    gpointer nodeid = NULL;
+    gpointer supported = NULL;
+
+    if (codec == crm_codec_bz2) {
+        return codec;
+
+    } else if (cs_peer_codecs == NULL || g_hash_table_size(cs_peer_codecs) == 0) {
+        crm_trace("Membership unknown, using %s", crm_codec2text(crm_codec_bz2));
+        return crm_codec_bz2;
+    }
+
+    g_hash_table_iter_init(&iter, cs_peer_codecs);
+    while (g_hash_table_iter_next(&iter, &nodeid, &supported)) {
+        if (GPOINTER_TO_UINT(nodeid) == pcmk_nodeid) {
+            continue;
+
+        } else if ((GPOINTER_TO_UINT(supported) & crm_codec_bit(codec)) == 0) {
+            crm_trace("Peer %u has not advertised %s, using %s", GPOINTER_TO_UINT(nodeid),
+                      crm_codec2text(codec), crm_codec2text(crm_codec_bz2));
+            return crm_codec_bz2;
+        }
+    }
+    return codec;
+}
+
 #define cs_repeat(counter, max, code) do {		\
 	code;						\
 	if(rc == CS_ERR_TRY_AGAIN || rc == CS_ERR_QUEUE_FULL) {  \
@@ -120,6 +160,262 @@ crm_get_cluster_name(char **cname)
     return FALSE;
 }
 
+/* Messages CPG was not ready to accept, in the order they were sent.
+ * Everything goes through a single queue so that the ordering towards
+ * any one destination is preserved.
+ */
+#define CS_SEND_INTERVAL   100 /* ms */
+#define CS_QUEUE_MAX_BYTES 10*1024*1024
+#define CS_QUEUE_MAX_MSGS  1000
+
+struct cs_queued_msg_s {
+    AIS_Message *msg;
+    time_t queued;
+};
+
+static GQueue *cs_message_queue = NULL;
+static size_t cs_message_queue_bytes = 0;
+static guint cs_message_timer = 0;
+static time_t cs_message_max_latency = 0;
+
+static int cs_queue_max_bytes = 0;
+static int cs_queue_max_msgs = 0;
+
+static gboolean cs_message_queue_flush(void);
+
+static void
+pick_cs_queue_limits(void)
+{
+    const char *env = NULL;
+
+    if (cs_queue_max_msgs > 0) {
+        return;
+    }
+
+    env = getenv("PCMK_cpg_queue_bytes");
+    if (env) {
+        cs_queue_max_bytes = crm_parse_int(env, "0");
+    }
+    if (cs_queue_max_bytes <= 0) {
+        cs_queue_max_bytes = CS_QUEUE_MAX_BYTES;
+    }
+
+    env = getenv("PCMK_cpg_queue_msgs");
+    if (env) {
+        cs_queue_max_msgs = crm_parse_int(env, "0");
+    }
+    if (cs_queue_max_msgs <= 0) {
+        cs_queue_max_msgs = CS_QUEUE_MAX_MSGS;
+    }
+
+    crm_trace("Queueing at most %d CPG messages (%d bytes)", cs_queue_max_msgs,
+              cs_queue_max_bytes);
+}
+
+static gboolean
+cs_message_timeout(gpointer data)
+{
+    if (cs_message_queue_flush()) {
+        cs_message_timer = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+cs_message_queue_pop(void)
+{
+    struct cs_queued_msg_s *queued = g_queue_pop_head(cs_message_queue);
+
+    cs_message_queue_bytes -= queued->msg->header.size;
+    crm_free(queued->msg);
+    crm_free(queued);
+}
+
+/* Discards anything still queued, reason says why */
+static void
+cs_message_queue_drop(const char *reason)
+{
+    if (cs_message_timer != 0) {
+        g_source_remove(cs_message_timer);
+        cs_message_timer = 0;
+    }
+
+    if (cs_message_queue == NULL || g_queue_is_empty(cs_message_queue)) {
+        return;
+    }
+
+    crm_err("Discarding %u queued CPG messages (%u bytes): %s",
+            g_queue_get_length(cs_message_queue), (unsigned int)cs_message_queue_bytes, reason);
+
+    while (g_queue_is_empty(cs_message_queue) == FALSE) {
+        struct cs_queued_msg_s *queued = g_queue_peek_head(cs_message_queue);
+
+        crm_info("Discarding message %d to %s.%s (%d bytes, queued %lds ago)",
+                 queued->msg->id, ais_dest(&(queued->msg->host)),
+                 msg_type2text(queued->msg->host.type), queued->msg->header.size,
+                 (long)(time(NULL) - queued->queued));
+        cs_message_queue_pop();
+    }
+}
+
+/* Compresses msg's payload with a codec the current membership can handle.
+ * Returns a new message, or NULL if msg should be sent as it is.
+ */
+static AIS_Message *
+cs_message_encode(const AIS_Message * msg)
+{
+    char *compressed = NULL;
+    unsigned int len = 0;
+    AIS_Message *encoded = NULL;
+    enum crm_codec codec = crm_codec_for(crm_compress_cluster);
+
+    if (crm_compress_wanted(codec, msg->size) == FALSE
+        && crm_compress_wanted(crm_codec_bz2, msg->size) == FALSE) {
+        /* Too small for any codec we might end up with */
+        return NULL;
+    }
+
+    codec = cs_message_codec(codec);
+    if (crm_compress_wanted(codec, msg->size) == FALSE) {
+        return NULL;
+
+    } else if (crm_compress(codec, msg->data, msg->size, &compressed, &len) == FALSE) {
+        return NULL;
+    }
+
+    crm_malloc0(encoded, sizeof(AIS_Message) + len + 1);
+    memcpy(encoded, msg, sizeof(AIS_Message));
+    memcpy(encoded->data, compressed, len);
+    encoded->data[len] = 0;
+    crm_free(compressed);
+
+    encoded->is_compressed = codec;
+    encoded->compressed_size = len;
+    encoded->header.size = sizeof(AIS_Message) + ais_data_len(encoded);
+
+    crm_trace("Compressed message %d with %s: %d -> %d", msg->id, crm_codec2text(codec),
+              msg->size, encoded->compressed_size);
+    return encoded;
+}
+
+/* msg always holds the uncompressed payload.  Whether, and with what, it
+ * is compressed is only decided now so that a message that had to wait in
+ * the queue suits the membership it is finally delivered to.
+ */
+static int
+cs_message_send(AIS_Message * msg)
+{
+    int rc = CS_OK;
+    struct iovec iov;
+    AIS_Message *encoded = cs_message_encode(msg);
+    AIS_Message *sending = encoded ? encoded : msg;
+
+    crm_trace("Sending%s message %d to %s.%s (data=%d, total=%d)",
+              sending->is_compressed ? " compressed" : "",
+              sending->id, ais_dest(&(sending->host)), msg_type2text(sending->host.type),
+              ais_data_len(sending), sending->header.size);
+
+    iov.iov_base = sending;
+    iov.iov_len = sending->header.size;
+
+    rc = cpg_mcast_joined(pcmk_cpg_handle, CPG_TYPE_AGREED, &iov, 1);
+    crm_free(encoded);
+    return rc;
+}
+
+/* Returns TRUE once the queue is empty */
+static gboolean
+cs_message_queue_flush(void)
+{
+    int rc = CS_OK;
+    time_t now = time(NULL);
+    guint sent = 0;
+
+    while (cs_message_queue != NULL && g_queue_is_empty(cs_message_queue) == FALSE) {
+        struct cs_queued_msg_s *queued = g_queue_peek_head(cs_message_queue);
+
+        rc = cs_message_send(queued->msg);
+        if (rc == CS_ERR_TRY_AGAIN || rc == CS_ERR_QUEUE_FULL) {
+            break;
+
+        } else if (rc != CS_OK) {
+            crm_err("Sending message %d via cpg: FAILED (rc=%d): %s",
+                    queued->msg->id, rc, ais_error2text(rc));
+
+        } else {
+            if (now - queued->queued > cs_message_max_latency) {
+                cs_message_max_latency = now - queued->queued;
+            }
+            crm_trace("Queued message %d: sent", queued->msg->id);
+            sent++;
+        }
+
+        cs_message_queue_pop();
+    }
+
+    if (sent > 0) {
+        crm_debug("Sent %u queued CPG messages, %u remaining (max latency %lds)",
+                  sent, g_queue_get_length(cs_message_queue), (long)cs_message_max_latency);
+    }
+    return cs_message_queue == NULL || g_queue_is_empty(cs_message_queue);
+}
+
+/* Takes ownership of msg if it could be queued */
+static gboolean
+cs_message_queue_add(AIS_Message * msg)
+{
+    guint depth = 0;
+    struct cs_queued_msg_s *queued = NULL;
+
+    pick_cs_queue_limits();
+    if (cs_message_queue == NULL) {
+        cs_message_queue = g_queue_new();
+    }
+
+    depth = g_queue_get_length(cs_message_queue);
+    if (depth >= (guint) cs_queue_max_msgs
+        || cs_message_queue_bytes + msg->header.size > (size_t) cs_queue_max_bytes) {
+        /* Refuse the newest rather than evict older messages, a gap in the
+         * middle of the sequence would be harder for peers to recover from
+         */
+        crm_err("Could not queue message %d to %s.%s: %u CPG messages (%u bytes) already pending",
+                msg->id, ais_dest(&(msg->host)), msg_type2text(msg->host.type), depth,
+                (unsigned int)cs_message_queue_bytes);
+        return FALSE;
+    }
+
+    crm_malloc0(queued, sizeof(struct cs_queued_msg_s));
+    queued->msg = msg;
+    queued->queued = time(NULL);
+
+    g_queue_push_tail(cs_message_queue, queued);
+    cs_message_queue_bytes += msg->header.size;
+    depth++;
+
+    if (depth % 100 == 0) {
+        crm_warn("Peer overloaded or membership in flux: %u CPG messages queued", depth);
+    } else {
+        crm_debug("Queued message %d, %u CPG messages pending", msg->id, depth);
+    }
+
+    if (cs_message_timer == 0) {
+        cs_message_timer = g_timeout_add(CS_SEND_INTERVAL, cs_message_timeout, NULL);
+    }
+    return TRUE;
+}
+
+void
+crm_cs_queue_stats(guint * depth, time_t * max_latency)
+{
+    if (depth) {
+        *depth = cs_message_queue ? g_queue_get_length(cs_message_queue) : 0;
+    }
+    if (max_latency) {
+        *max_latency = cs_message_max_latency;
+    }
+}
+
 gboolean
 send_ais_text(int class, const char *data,
               gboolean local, const char *node, enum crm_ais_msg_types dest)
@@ -127,12 +423,7 @@ send_ais_text(int class, const char *data,
     static int msg_id = 0;
     static int local_pid = 0;
 
-    int retries = 0;
     int rc = CS_OK;
-    int buf_len = sizeof(cs_ipc_header_response_t);
-
-    char *buf = NULL;
-    struct iovec iov;
     const char *transport = "pcmk";
     AIS_Message *ais_msg = NULL;
     enum crm_ais_msg_types sender = text2msg_type(crm_system_name);
@@ -178,83 +469,30 @@ send_ais_text(int class, const char *data,
     ais_msg->sender.size = pcmk_uname_len;
     memset(ais_msg->sender.uname, 0, MAX_NAME);
     memcpy(ais_msg->sender.uname, pcmk_uname, ais_msg->sender.size);
+    ais_msg->sender.local = crm_codecs_supported();
 
     ais_msg->size = 1 + strlen(data);
+    crm_realloc(ais_msg, sizeof(AIS_Message) + ais_msg->size);
+    memcpy(ais_msg->data, data, ais_msg->size);
+    ais_msg->header.size = sizeof(AIS_Message) + ais_msg->size;
 
-    if (ais_msg->size < CRM_BZ2_THRESHOLD) {
-  failback:
-        crm_realloc(ais_msg, sizeof(AIS_Message) + ais_msg->size);
-        memcpy(ais_msg->data, data, ais_msg->size);
-
-    } else {
-        char *compressed = NULL;
-        char *uncompressed = crm_strdup(data);
-        unsigned int len = (ais_msg->size * 1.1) + 600; /* recomended size */
-
-        crm_trace("Compressing message payload");
-        crm_malloc(compressed, len);
-
-        rc = BZ2_bzBuffToBuffCompress(compressed, &len, uncompressed, ais_msg->size, CRM_BZ2_BLOCKS,
-                                      0, CRM_BZ2_WORK);
-
-        crm_free(uncompressed);
-
-        if (rc != BZ_OK) {
-            crm_err("Compression failed: %d", rc);
-            crm_free(compressed);
-            goto failback;
-        }
-
-        crm_realloc(ais_msg, sizeof(AIS_Message) + len + 1);
-        memcpy(ais_msg->data, compressed, len);
-        ais_msg->data[len] = 0;
-        crm_free(compressed);
+    transport = "cpg";
+    CRM_CHECK(dest != crm_msg_ais, rc = CS_ERR_MESSAGE_ERROR; goto bail);
 
-        ais_msg->is_compressed = TRUE;
-        ais_msg->compressed_size = len;
+    if (cs_message_queue_flush()) {
+        rc = cs_message_send(ais_msg);
 
-        crm_trace("Compression details: %d -> %d", ais_msg->size, ais_data_len(ais_msg));
+    } else {
+        /* Anything already queued has to go first */
+        rc = CS_ERR_TRY_AGAIN;
     }
 
-    ais_msg->header.size = sizeof(AIS_Message) + ais_data_len(ais_msg);
-
-    crm_trace("Sending%s message %d to %s.%s (data=%d, total=%d)",
-              ais_msg->is_compressed ? " compressed" : "",
-              ais_msg->id, ais_dest(&(ais_msg->host)), msg_type2text(dest),
-              ais_data_len(ais_msg), ais_msg->header.size);
-
-    iov.iov_base = ais_msg;
-    iov.iov_len = ais_msg->header.size;
-    crm_realloc(buf, buf_len);
-
-    do {
-        if (rc == CS_ERR_TRY_AGAIN || rc == CS_ERR_QUEUE_FULL) {
-            retries++;
-            crm_info("Peer overloaded or membership in flux:"
-                     " Re-sending message (Attempt %d of 20)", retries);
-            sleep(retries);     /* Proportional back off */
-        }
-
-        errno = 0;
-        transport = "cpg";
-        CRM_CHECK(dest != crm_msg_ais, rc = CS_ERR_MESSAGE_ERROR; goto bail);
-        rc = cpg_mcast_joined(pcmk_cpg_handle, CPG_TYPE_AGREED, &iov, 1);
-        if (rc == CS_ERR_TRY_AGAIN || rc == CS_ERR_QUEUE_FULL) {
-            cpg_flow_control_state_t fc_state = CPG_FLOW_CONTROL_DISABLED;
-            int rc2 = cpg_flow_control_state_get(pcmk_cpg_handle, &fc_state);
-
-            if (rc2 == CS_OK && fc_state == CPG_FLOW_CONTROL_ENABLED) {
-                crm_warn("Connection overloaded, cannot send messages");
-                goto bail;
-
-            } else if (rc2 != CS_OK) {
-                crm_warn("Could not determin the connection state: %s (%d)",
-                         ais_error2text(rc2), rc2);
-                goto bail;
-            }
-        }
-
-    } while ((rc == CS_ERR_TRY_AGAIN || rc == CS_ERR_QUEUE_FULL) && retries < 20);
+    if ((rc == CS_ERR_TRY_AGAIN || rc == CS_ERR_QUEUE_FULL) && cs_message_queue_add(ais_msg)) {
+        /* Rather than blocking the mainloop until corosync catches up,
+         * the message was handed to the queue which now owns ais_msg
+         */
+        return TRUE;
+    }
 
   bail:
     if (rc != CS_OK) {
@@ -265,7 +503,6 @@ send_ais_text(int class, const char *data,
         crm_trace("Message %d: sent", ais_msg->id);
     }
 
-    crm_free(buf);
     crm_free(ais_msg);
     return (rc == CS_OK);
 }
@@ -286,6 +523,11 @@ terminate_ais_connection(void)
     crm_notice("Disconnecting from Corosync");
 
     if(pcmk_cpg_handle) {
+        /* One last attempt, without waiting, at anything still queued */
+        if(cs_message_queue_flush() == FALSE) {
+            cs_message_queue_drop("disconnecting from corosync");
+        }
+
         crm_trace("Disconnecting CPG");
         cpg_leave(pcmk_cpg_handle, &pcmk_cpg_group);
         cpg_finalize(pcmk_cpg_handle);
@@ -324,23 +566,19 @@ ais_dispatch_message(AIS_Message * msg, gboolean(*dispatch) (AIS_Message *, char
 
     data = msg->data;
     if (msg->is_compressed && msg->size > 0) {
-        int rc = BZ_OK;
         unsigned int new_size = msg->size + 1;
 
         if (check_message_sanity(msg, NULL) == FALSE) {
             goto badmsg;
         }
 
-        crm_trace("Decompressing message data");
+        crm_trace("Decompressing %s message data", crm_codec2text(msg->is_compressed));
         crm_malloc0(uncompressed, new_size);
-        rc = BZ2_bzBuffToBuffDecompress(uncompressed, &new_size, data, msg->compressed_size, 1, 0);
-
-        if (rc != BZ_OK) {
-            crm_err("Decompression failed: %d", rc);
+        if (crm_decompress(msg->is_compressed, data, msg->compressed_size, uncompressed,
+                           &new_size) == FALSE) {
             goto badmsg;
         }
 
-        CRM_ASSERT(rc == BZ_OK);
         CRM_ASSERT(new_size == msg->size);
 
         data = uncompressed;
@@ -382,7 +620,7 @@ ais_dispatch_message(AIS_Message * msg, gboolean(*dispatch) (AIS_Message *, char
 
   badmsg:
     crm_err("Invalid message (id=%d, dest=%s:%s, from=%s:%s.%d):"
-            " min=%d, total=%d, size=%d, bz2_size=%d",
+            " min=%d, total=%d, size=%d, compressed_size=%d",
             msg->id, ais_dest(&(msg->host)), msg_type2text(msg->host.type),
             ais_dest(&(msg->sender)), msg_type2text(msg->sender.type),
             msg->sender.pid, (int)sizeof(AIS_Message),
@@ -401,8 +639,12 @@ pcmk_cpg_dispatch(gpointer user_data)
     rc = cpg_dispatch(pcmk_cpg_handle, CS_DISPATCH_ALL);
     if (rc != CS_OK) {
         crm_err("Connection to the CPG API failed: %d", rc);
+        cs_message_queue_drop("lost the connection to corosync");
         return -1;
     }
+
+    /* Flow control may well have lifted */
+    cs_message_queue_flush();
     return 0;
 }
 
@@ -422,6 +664,13 @@ pcmk_cpg_deliver(cpg_handle_t handle,
         return;
     }
 
+    if (nodeid != pcmk_nodeid && cs_peer_codecs != NULL
+        && g_hash_table_lookup_extended(cs_peer_codecs, GUINT_TO_POINTER(nodeid), NULL, NULL)) {
+        g_hash_table_replace(cs_peer_codecs, GUINT_TO_POINTER(nodeid),
+                             GUINT_TO_POINTER(ais_msg->sender.local));
+    }
+    ais_msg->sender.local = FALSE;
+
     ais_msg->sender.id = nodeid;
     if (ais_msg->sender.size == 0) {
         crm_node_t *peer = crm_get_peer(nodeid, NULL);
@@ -454,20 +703,39 @@ pcmk_cpg_membership(cpg_handle_t handle,
     gboolean found = FALSE;
     static int counter = 0;
 
+    if (cs_peer_codecs == NULL) {
+        cs_peer_codecs = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
     for (i = 0; i < left_list_entries; i++) {
         crm_node_t *peer = crm_get_peer(left_list[i].nodeid, NULL);
         crm_info("Left[%d.%d] %s.%d ", counter, i, groupName->value, left_list[i].nodeid);
         crm_update_peer_proc(__FUNCTION__, peer, crm_proc_cpg, OFFLINESTATUS);
+
+        /* It may come back running something else */
+        g_hash_table_remove(cs_peer_codecs, GUINT_TO_POINTER(left_list[i].nodeid));
     }
 
     for (i = 0; i < joined_list_entries; i++) {
         crm_info("Joined[%d.%d] %s.%d ", counter, i, groupName->value, joined_list[i].nodeid);
+
+        /* Only trust what it advertises from now on */
+        g_hash_table_replace(cs_peer_codecs, GUINT_TO_POINTER(joined_list[i].nodeid),
+                             GUINT_TO_POINTER(0));
     }
 
     for (i = 0; i < member_list_entries; i++) {
         crm_node_t *peer = crm_get_peer(member_list[i].nodeid, NULL);
         crm_info("Member[%d.%d] %s.%d ", counter, i, groupName->value, member_list[i].nodeid);
         crm_update_peer_proc(__FUNCTION__, peer, crm_proc_cpg, ONLINESTATUS);
+
+        if (g_hash_table_lookup_extended(cs_peer_codecs, GUINT_TO_POINTER(member_list[i].nodeid),
+                                         NULL, NULL) == FALSE) {
+            /* Members from before our first callback have yet to advertise */
+            g_hash_table_insert(cs_peer_codecs, GUINT_TO_POINTER(member_list[i].nodeid),
+                                GUINT_TO_POINTER(0));
+        }
+
         if(pcmk_nodeid == member_list[i].nodeid) {
             found = TRUE;
         }
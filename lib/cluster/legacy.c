@@ -387,6 +387,18 @@ send_ais_text(int class, const char *data,
     return (rc == CS_OK);
 }
 
+void
+crm_cs_queue_stats(guint * depth, time_t * max_latency)
+{
+    /* Messages are never queued here */
+    if (depth) {
+        *depth = 0;
+    }
+    if (max_latency) {
+        *max_latency = 0;
+    }
+}
+
 gboolean
 send_ais_message(xmlNode * msg, gboolean local, const char *node, enum crm_ais_msg_types dest)
 {
@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2012 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <crm_internal.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <crm/crm.h>
+#include <crm/common/xml.h>
+#include <crm/common/compress.h>
+
+#if HAVE_BZLIB_H
+#  include <bzlib.h>
+#  define SUPPORT_BZ2 1
+#else
+#  define SUPPORT_BZ2 0
+#endif
+
+#if HAVE_LZ4_H && HAVE_LIBLZ4
+#  include <lz4.h>
+#  define SUPPORT_LZ4 1
+#else
+#  define SUPPORT_LZ4 0
+#endif
+
+#if HAVE_ZSTD_H && HAVE_LIBZSTD
+#  include <zstd.h>
+#  define SUPPORT_ZSTD 1
+#else
+#  define SUPPORT_ZSTD 0
+#endif
+
+/* Give up on data that would decompress to more than this */
+#define CRM_DECOMPRESS_MAX (1024 * 1024 * 1024)
+
+typedef struct crm_codec_info_s {
+    const char *name;
+    const char *extension;
+    gboolean available;
+
+    /* The block format doesn't record the original size, which messages
+     * carry separately but files do not
+     */
+    gboolean for_files;
+
+    /* Payloads smaller than this aren't worth the effort.  It never rises
+     * above the default, so anything that used to be compressed still is.
+     */
+    unsigned int threshold;
+    unsigned int min_threshold;
+    unsigned int max_threshold;
+
+} crm_codec_info_t;
+
+/* *INDENT-OFF* */
+static crm_codec_info_t codecs[crm_codec_max] = {
+    /* name    ext    available     files  threshold          min        max */
+    { "none",  NULL,  TRUE,         FALSE, 0,                 0,         0 },
+    { "bz2",   "bz2", SUPPORT_BZ2,  TRUE,  CRM_BZ2_THRESHOLD, 16 * 1024, CRM_BZ2_THRESHOLD },
+    { "lz4",   "lz4", SUPPORT_LZ4,  FALSE, 4 * 1024,          1024,      4 * 1024 },
+    { "zstd",  "zst", SUPPORT_ZSTD, TRUE,  8 * 1024,          1024,      8 * 1024 },
+};
+/* *INDENT-ON* */
+
+const char *
+crm_codec2text(enum crm_codec codec)
+{
+    if (codec < crm_codec_none || codec >= crm_codec_max) {
+        return "unknown";
+    }
+    return codecs[codec].name;
+}
+
+enum crm_codec
+crm_text2codec(const char *text)
+{
+    int lpc = 0;
+
+    for (lpc = crm_codec_none; text != NULL && lpc < crm_codec_max; lpc++) {
+        if (strcasecmp(text, codecs[lpc].name) == 0) {
+            return lpc;
+        }
+    }
+    if (crm_is_true(text)) {
+        return crm_codec_bz2;
+    }
+    return crm_codec_none;
+}
+
+uint32_t
+crm_codecs_supported(void)
+{
+    int lpc = 0;
+    uint32_t supported = 0;
+
+    for (lpc = crm_codec_none; lpc < crm_codec_max; lpc++) {
+        if (codecs[lpc].available) {
+            supported |= crm_codec_bit(lpc);
+        }
+    }
+    return supported;
+}
+
+enum crm_codec
+crm_codec_for(enum crm_compress_class cls)
+{
+    static enum crm_codec selected[crm_compress_class_max] = { crm_codec_max, crm_codec_max };
+
+    CRM_CHECK(cls >= crm_compress_cluster && cls < crm_compress_class_max, return crm_codec_bz2);
+
+    if (selected[cls] == crm_codec_max) {
+        const char *env = NULL;
+        enum crm_codec fallback = crm_codec_bz2;
+
+        if (cls == crm_compress_cluster) {
+            /* Prefer speed over ratio for anything going over the wire */
+            env = getenv("PCMK_cluster_compression");
+            if (codecs[crm_codec_lz4].available) {
+                fallback = crm_codec_lz4;
+
+            } else if (codecs[crm_codec_zstd].available) {
+                fallback = crm_codec_zstd;
+            }
+
+        } else {
+            /* bzip2 remains the default on disk so existing tools can read it */
+            env = getenv("PCMK_file_compression");
+        }
+
+        selected[cls] = fallback;
+        if (env != NULL) {
+            enum crm_codec codec = crm_text2codec(env);
+
+            if (codec == crm_codec_none || codecs[codec].available == FALSE) {
+                crm_warn("Compression codec '%s' is not available, using %s",
+                         env, codecs[fallback].name);
+
+            } else if (cls == crm_compress_file && codecs[codec].for_files == FALSE) {
+                crm_warn("Compression codec '%s' cannot be used for files, using %s",
+                         env, codecs[fallback].name);
+
+            } else {
+                selected[cls] = codec;
+            }
+        }
+        crm_debug("Using %s compression for %s", codecs[selected[cls]].name,
+                  cls == crm_compress_cluster ? "cluster messages" : "files");
+    }
+    return selected[cls];
+}
+
+const char *
+crm_codec_extension(enum crm_codec codec)
+{
+    if (codec <= crm_codec_none || codec >= crm_codec_max) {
+        return NULL;
+    }
+    return codecs[codec].extension;
+}
+
+enum crm_codec
+crm_codec_from_filename(const char *filename)
+{
+    int lpc = 0;
+    const char *ext = NULL;
+
+    if (filename != NULL) {
+        ext = strrchr(filename, '.');
+    }
+
+    for (lpc = crm_codec_bz2; ext != NULL && lpc < crm_codec_max; lpc++) {
+        if (codecs[lpc].for_files && safe_str_eq(ext + 1, codecs[lpc].extension)) {
+            return lpc;
+        }
+    }
+    return crm_codec_none;
+}
+
+gboolean
+crm_compress_wanted(enum crm_codec codec, unsigned int size)
+{
+    if (codec <= crm_codec_none || codec >= crm_codec_max || codecs[codec].available == FALSE) {
+        return FALSE;
+    }
+    return size >= codecs[codec].threshold;
+}
+
+static void
+compress_feedback(enum crm_codec codec, unsigned int in_len, unsigned int out_len)
+{
+    unsigned int threshold = codecs[codec].threshold;
+
+    if (out_len >= (in_len / 10) * 9) {
+        /* Saved less than 10%, not worth doing at this size */
+        threshold = threshold * 2;
+        if (threshold > codecs[codec].max_threshold) {
+            threshold = codecs[codec].max_threshold;
+        }
+
+    } else if (out_len <= in_len / 4) {
+        /* Very effective, try it on smaller payloads too */
+        threshold = threshold / 2;
+        if (threshold < codecs[codec].min_threshold) {
+            threshold = codecs[codec].min_threshold;
+        }
+    }
+
+    if (threshold != codecs[codec].threshold) {
+        crm_debug("%s compression threshold is now %u bytes (%u -> %u)",
+                  codecs[codec].name, threshold, in_len, out_len);
+        codecs[codec].threshold = threshold;
+    }
+}
+
+gboolean
+crm_compress(enum crm_codec codec, const char *in, unsigned int in_len, char **out,
+             unsigned int *out_len)
+{
+    int rc = 0;
+    char *compressed = NULL;
+    unsigned int len = 0;
+
+    CRM_CHECK(in != NULL && out != NULL && out_len != NULL, return FALSE);
+    CRM_CHECK(codec > crm_codec_none && codec < crm_codec_max, return FALSE);
+
+    *out = NULL;
+    *out_len = 0;
+
+    switch (codec) {
+        case crm_codec_bz2:
+#if SUPPORT_BZ2
+            len = (in_len * 1.1) + 600; /* recomended size */
+            crm_malloc(compressed, len);
+            rc = BZ2_bzBuffToBuffCompress(compressed, &len, (char *)in, in_len, CRM_BZ2_BLOCKS,
+                                          0, CRM_BZ2_WORK);
+            if (rc != BZ_OK) {
+                crm_err("%s compression failed: %d", codecs[codec].name, rc);
+                len = 0;
+            }
+#endif
+            break;
+
+        case crm_codec_lz4:
+#if SUPPORT_LZ4
+            len = LZ4_compressBound(in_len);
+            crm_malloc(compressed, len);
+            rc = LZ4_compress_default(in, compressed, in_len, len);
+            if (rc <= 0) {
+                crm_err("%s compression failed: %d", codecs[codec].name, rc);
+                len = 0;
+            } else {
+                len = rc;
+            }
+#endif
+            break;
+
+        case crm_codec_zstd:
+#if SUPPORT_ZSTD
+            {
+                size_t zrc = 0;
+
+                len = ZSTD_compressBound(in_len);
+                crm_malloc(compressed, len);
+                zrc = ZSTD_compress(compressed, len, in, in_len, 1);
+                if (ZSTD_isError(zrc)) {
+                    crm_err("%s compression failed: %s", codecs[codec].name,
+                            ZSTD_getErrorName(zrc));
+                    len = 0;
+                } else {
+                    len = zrc;
+                }
+            }
+#endif
+            break;
+
+        default:
+            break;
+    }
+
+    if (len == 0) {
+        if (codecs[codec].available == FALSE) {
+            crm_err("Cannot compress with %s: not available at compile time", codecs[codec].name);
+        }
+        crm_free(compressed);
+        return FALSE;
+    }
+
+    crm_trace("%s compression: %u -> %u bytes", codecs[codec].name, in_len, len);
+    compress_feedback(codec, in_len, len);
+
+    *out = compressed;
+    *out_len = len;
+    return TRUE;
+}
+
+gboolean
+crm_decompress(enum crm_codec codec, const char *in, unsigned int in_len, char *out,
+               unsigned int *out_len)
+{
+    int rc = 0;
+    gboolean done = FALSE;
+
+    CRM_CHECK(in != NULL && out != NULL && out_len != NULL, return FALSE);
+
+    switch (codec) {
+        case crm_codec_bz2:
+#if SUPPORT_BZ2
+            rc = BZ2_bzBuffToBuffDecompress(out, out_len, (char *)in, in_len, 1, 0);
+            if (rc != BZ_OK) {
+                crm_err("%s decompression failed: %d", codecs[codec].name, rc);
+            } else {
+                done = TRUE;
+            }
+#endif
+            break;
+
+        case crm_codec_lz4:
+#if SUPPORT_LZ4
+            rc = LZ4_decompress_safe(in, out, in_len, *out_len);
+            if (rc < 0) {
+                crm_err("%s decompression failed: %d", codecs[codec].name, rc);
+            } else {
+                *out_len = rc;
+                done = TRUE;
+            }
+#endif
+            break;
+
+        case crm_codec_zstd:
+#if SUPPORT_ZSTD
+            {
+                size_t zrc = ZSTD_decompress(out, *out_len, in, in_len);
+
+                if (ZSTD_isError(zrc)) {
+                    crm_err("%s decompression failed: %s", codecs[codec].name,
+                            ZSTD_getErrorName(zrc));
+                } else {
+                    *out_len = zrc;
+                    done = TRUE;
+                }
+            }
+#endif
+            break;
+
+        default:
+            crm_err("Unknown compression codec: %d", codec);
+            return FALSE;
+    }
+
+    if (done == FALSE && codecs[codec].available == FALSE) {
+        crm_err("Cannot decompress %s data: not available at compile time", codecs[codec].name);
+    }
+    return done;
+}
+
+char *
+crm_decompress_all(enum crm_codec codec, const char *in, unsigned int in_len,
+                   unsigned int *out_len)
+{
+    char *out = NULL;
+    unsigned int len = 0;
+    unsigned int size = in_len * 4;
+
+    CRM_CHECK(in != NULL, return NULL);
+    CRM_CHECK(codec > crm_codec_none && codec < crm_codec_max, return NULL);
+
+#if SUPPORT_ZSTD
+    if (codec == crm_codec_zstd) {
+        unsigned long long content_size = ZSTD_getFrameContentSize(in, in_len);
+
+        if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+            crm_err("Could not determine the original size of %s data", codecs[codec].name);
+            return NULL;
+        }
+        size = content_size;
+    }
+#endif
+
+    if (codecs[codec].for_files == FALSE) {
+        crm_err("%s data does not record its original size", crm_codec2text(codec));
+        return NULL;
+    }
+
+    /* Only bzip2 needs to guess, and XML typically shrinks 5-10 times */
+    while (size < CRM_DECOMPRESS_MAX) {
+        len = size;
+        crm_realloc(out, len + 1);
+
+#if SUPPORT_BZ2
+        if (codec == crm_codec_bz2) {
+            int rc = BZ2_bzBuffToBuffDecompress(out, &len, (char *)in, in_len, 0, 0);
+
+            if (rc == BZ_OUTBUFF_FULL) {
+                size = size * 2;
+                continue;
+
+            } else if (rc != BZ_OK) {
+                crm_err("%s decompression failed: %d", codecs[codec].name, rc);
+                break;
+            }
+
+            out[len] = 0;
+            if (out_len) {
+                *out_len = len;
+            }
+            return out;
+        }
+#endif
+
+        if (crm_decompress(codec, in, in_len, out, &len)) {
+            out[len] = 0;
+            if (out_len) {
+                *out_len = len;
+            }
+            return out;
+        }
+        break;
+    }
+
+    crm_free(out);
+    return NULL;
+}
@@ -167,58 +167,282 @@ crm_ipcs_recv(qb_ipcs_connection_t *c, void *data, size_t size)
     return string2xml(text);
 }
 
-ssize_t
-crm_ipcs_send(qb_ipcs_connection_t *c, xmlNode *message, enum ipcs_send_flags flags)
+/* Messages a client was not ready to accept are queued per connection
+ * rather than blocking the server's mainloop until it catches up.
+ */
+#define IPCS_QUEUE_MAX_BYTES  10*1024*1024
+#define IPCS_QUEUE_MAX_MSGS   500
+#define IPCS_FLUSH_INTERVAL   250 /* ms */
+
+struct ipcs_msg_s {
+    enum ipcs_send_flags flags;
+    struct qb_ipc_response_header header;
+    size_t size;
+    char *text;
+};
+
+struct ipcs_queue_s {
+    qb_ipcs_connection_t *c;
+    GQueue *pending;
+    size_t bytes;
+    gboolean evicted;
+};
+
+static GHashTable *ipcs_queues = NULL;
+static guint ipcs_flush_timer = 0;
+static size_t ipcs_queued_bytes = 0;
+static unsigned int ipcs_evictions = 0;
+
+static int ipcs_queue_max_bytes = 0;
+static int ipcs_queue_max_msgs = 0;
+
+static void
+pick_ipcs_queue_limits(void)
+{
+    const char *env = NULL;
+
+    if(ipcs_queue_max_msgs > 0) {
+        return;
+    }
+
+    env = getenv("PCMK_ipc_queue_bytes");
+    if(env) {
+        ipcs_queue_max_bytes = crm_parse_int(env, "0");
+    }
+    if(ipcs_queue_max_bytes <= 0) {
+        ipcs_queue_max_bytes = IPCS_QUEUE_MAX_BYTES;
+    }
+
+    env = getenv("PCMK_ipc_queue_msgs");
+    if(env) {
+        ipcs_queue_max_msgs = crm_parse_int(env, "0");
+    }
+    if(ipcs_queue_max_msgs <= 0) {
+        ipcs_queue_max_msgs = IPCS_QUEUE_MAX_MSGS;
+    }
+
+    crm_trace("Queueing at most %d messages (%d bytes) per client",
+              ipcs_queue_max_msgs, ipcs_queue_max_bytes);
+}
+
+static void
+ipcs_msg_free(gpointer data)
+{
+    struct ipcs_msg_s *msg = data;
+
+    crm_free(msg->text);
+    crm_free(msg);
+}
+
+static void
+ipcs_queue_drop(struct ipcs_queue_s *queue)
+{
+    ipcs_queued_bytes -= queue->bytes;
+    queue->bytes = 0;
+
+    g_queue_foreach(queue->pending, (GFunc) ipcs_msg_free, NULL);
+    g_queue_clear(queue->pending);
+}
+
+static void
+ipcs_queue_free(gpointer data)
+{
+    struct ipcs_queue_s *queue = data;
+
+    ipcs_queue_drop(queue);
+    g_queue_free(queue->pending);
+    qb_ipcs_connection_unref(queue->c);
+    crm_free(queue);
+}
+
+static ssize_t
+ipcs_msg_send(qb_ipcs_connection_t *c, struct ipcs_msg_s *msg)
 {
-    int rc;
-    int lpc = 0;
     struct iovec iov[2];
-    static uint32_t id = 0;
-    const char *type = "Response";
-    struct qb_ipc_response_header header;
-    char *buffer = dump_xml_unformatted(message);
 
     iov[0].iov_len = sizeof(struct qb_ipc_response_header);
-    iov[0].iov_base = &header;
-    iov[1].iov_len = 1 + strlen(buffer);
-    iov[1].iov_base = buffer;
+    iov[0].iov_base = &(msg->header);
+    iov[1].iov_len = msg->size - iov[0].iov_len;
+    iov[1].iov_base = msg->text;
 
-    header.id = id++; /* We don't really use it, but doesn't hurt to set one */
-    header.error = 0; /* unused */
-    header.size = iov[0].iov_len + iov[1].iov_len;
+    if(msg->flags & ipcs_send_event) {
+        return qb_ipcs_event_sendv(c, iov, 2);
+    }
+    return qb_ipcs_response_sendv(c, iov, 2);
+}
 
-    do {
-        if(flags & ipcs_send_event) {
-            rc = qb_ipcs_event_sendv(c, iov, 2);
-            type = "Event";
-            
-        } else {
-            rc = qb_ipcs_response_sendv(c, iov, 2);
+/* Returns TRUE once nothing is left to send */
+static gboolean
+ipcs_queue_flush(struct ipcs_queue_s *queue)
+{
+    while(g_queue_is_empty(queue->pending) == FALSE) {
+        struct ipcs_msg_s *msg = g_queue_peek_head(queue->pending);
+        ssize_t rc = ipcs_msg_send(queue->c, msg);
+
+        if(rc == -EAGAIN) {
+            return FALSE;
+
+        } else if(rc < 0) {
+            crm_info("Discarding %d queued messages (%u bytes) for %p[%d]: %s (%d)",
+                     g_queue_get_length(queue->pending), (unsigned int)queue->bytes,
+                     queue->c, crm_ipcs_client_pid(queue->c), strerror(-rc), (int)rc);
+            ipcs_queue_drop(queue);
+            break;
         }
 
-        if(rc != -EAGAIN) {
-            break;
-        } else if(lpc > 3 && (flags & ipcs_send_error)) {
-            break;
+        crm_trace("Queued message %u sent, %d bytes to %p", msg->header.id, (int)rc, queue->c);
+        queue->bytes -= msg->size;
+        ipcs_queued_bytes -= msg->size;
+
+        g_queue_pop_head(queue->pending);
+        ipcs_msg_free(msg);
+    }
+    return TRUE;
+}
+
+static gboolean
+ipcs_flush_all(gpointer user_data)
+{
+    GHashTableIter iter;
+    struct ipcs_queue_s *queue = NULL;
+
+    g_hash_table_iter_init(&iter, ipcs_queues);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & queue)) {
+        if(queue->evicted) {
+            /* Deferred until now so that the client's destroy callback
+             * cannot run while the caller of crm_ipcs_send() is iterating
+             * over its client list
+             */
+            qb_ipcs_disconnect(queue->c);
+            g_hash_table_iter_remove(&iter);
+
+        } else if(ipcs_queue_flush(queue)) {
+            g_hash_table_iter_remove(&iter);
         }
+    }
 
-        crm_debug("Attempting resend %d of %s %d (%d bytes) to %p[%d]: %.120s",
-                  ++lpc, type, header.id, header.size, c, crm_ipcs_client_pid(c), buffer);
-        sleep(1);
+    if(g_hash_table_size(ipcs_queues) == 0) {
+        ipcs_flush_timer = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Returns FALSE if the client was evicted, msg has been freed in that case */
+static gboolean
+ipcs_queue_add(qb_ipcs_connection_t *c, struct ipcs_msg_s *msg)
+{
+    struct ipcs_queue_s *queue = NULL;
 
-        /* Only retry for important stuff, and even then only a limited amount for ipcs_send_error
-         * Unless ipcs_send_info or ipcs_send_error is specified, we block by default
-         */
-    } while((flags & ipcs_send_info) == 0);
+    pick_ipcs_queue_limits();
+    if(ipcs_queues == NULL) {
+        ipcs_queues = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, ipcs_queue_free);
+    }
+
+    queue = g_hash_table_lookup(ipcs_queues, c);
+    if(queue == NULL) {
+        crm_malloc0(queue, sizeof(struct ipcs_queue_s));
+        queue->c = c;
+        queue->pending = g_queue_new();
 
-    if(rc < header.size) {
+        /* Keep the connection valid until we are done with it */
+        qb_ipcs_connection_ref(c);
+        g_hash_table_insert(ipcs_queues, c, queue);
+    }
+
+    g_queue_push_tail(queue->pending, msg);
+    queue->bytes += msg->size;
+    ipcs_queued_bytes += msg->size;
+
+    if(ipcs_flush_timer == 0) {
+        ipcs_flush_timer = g_timeout_add(IPCS_FLUSH_INTERVAL, ipcs_flush_all, NULL);
+    }
+
+    if(queue->bytes > (size_t)ipcs_queue_max_bytes
+       || g_queue_get_length(queue->pending) > (guint)ipcs_queue_max_msgs) {
+        ipcs_evictions++;
+        crm_err("Evicting client %p[%d]: %d messages (%u bytes) could not be delivered"
+                " (%u evictions, %u bytes queued in total)",
+                c, crm_ipcs_client_pid(c), g_queue_get_length(queue->pending),
+                (unsigned int)queue->bytes, ipcs_evictions, (unsigned int)ipcs_queued_bytes);
+        queue->evicted = TRUE;
+        ipcs_queue_drop(queue);
+        return FALSE;
+    }
+
+    crm_debug("Queued message %u (%d bytes) for %p[%d], %d pending (%u bytes)",
+              msg->header.id, (int)msg->size, c, crm_ipcs_client_pid(c),
+              g_queue_get_length(queue->pending), (unsigned int)queue->bytes);
+    return TRUE;
+}
+
+void
+crm_ipcs_queue_stats(size_t *queued_bytes, unsigned int *evictions)
+{
+    if(queued_bytes) {
+        *queued_bytes = ipcs_queued_bytes;
+    }
+    if(evictions) {
+        *evictions = ipcs_evictions;
+    }
+}
+
+ssize_t
+crm_ipcs_send(qb_ipcs_connection_t *c, xmlNode *message, enum ipcs_send_flags flags)
+{
+    ssize_t rc = -EAGAIN;
+    static uint32_t id = 0;
+    const char *type = (flags & ipcs_send_event)?"Event":"Response";
+    struct ipcs_queue_s *queue = NULL;
+    struct ipcs_msg_s msg;
+
+    msg.flags = flags;
+    msg.text = dump_xml_unformatted(message);
+    msg.size = sizeof(struct qb_ipc_response_header) + 1 + strlen(msg.text);
+
+    msg.header.id = id++; /* We don't really use it, but doesn't hurt to set one */
+    msg.header.error = 0; /* unused */
+    msg.header.size = msg.size;
+
+    if(ipcs_queues) {
+        queue = g_hash_table_lookup(ipcs_queues, c);
+    }
+
+    if(queue && queue->evicted) {
+        /* Waiting to be disconnected */
+        rc = -ENOTCONN;
+
+    } else if(queue == NULL || ipcs_queue_flush(queue)) {
+        /* Anything still queued for this client had to go first */
+        rc = ipcs_msg_send(c, &msg);
+    }
+
+    if(rc < msg.header.size && (rc != -EAGAIN || (flags & ipcs_send_info))) {
+        /* ipcs_send_info messages are not important enough to hold on to */
         do_crm_log((flags & ipcs_send_error)?LOG_ERR:LOG_INFO,
                    "%s %d failed, size=%d, to=%p[%d], rc=%d: %.120s",
-                   type, header.id, header.size, crm_ipcs_client_pid(c), rc, buffer);
+                   type, msg.header.id, msg.header.size, c, crm_ipcs_client_pid(c), (int)rc,
+                   msg.text);
+
+    } else if(rc == -EAGAIN) {
+        /* Only now does the message need to outlive this call */
+        struct ipcs_msg_s *queued = NULL;
+
+        crm_malloc0(queued, sizeof(struct ipcs_msg_s));
+        *queued = msg;
+        msg.text = NULL;
+
+        if(ipcs_queue_add(c, queued)) {
+            rc = msg.header.size;
+        } else {
+            rc = -ENOBUFS;
+        }
+
     } else {
-        crm_trace("%s %d sent, %d bytes to %p: %.120s", type, header.id, rc, c, buffer);
+        crm_trace("%s %d sent, %d bytes to %p: %.120s", type, msg.header.id, (int)rc, c, msg.text);
     }
-    crm_free(buffer);
+
+    crm_free(msg.text);
     return rc;
 }
 
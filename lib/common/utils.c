@@ -50,6 +50,7 @@
 #include <crm/common/ipc.h>
 #include <crm/common/iso8601.h>
 #include <crm/common/mainloop.h>
+#include <crm/common/compress.h>
 #include <crm/attrd.h>
 #include <libxml2/libxml/relaxng.h>
 
@@ -1734,7 +1735,7 @@ generate_series_filename(const char *directory, const char *series, int sequence
     CRM_CHECK(filename != NULL, return NULL);
 
     if (bzip) {
-        ext = "bz2";
+        ext = crm_codec_extension(crm_codec_for(crm_compress_file));
     }
     sprintf(filename, "%s/%s-%d.%s", directory, series, sequence, ext);
 
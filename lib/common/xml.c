@@ -32,7 +32,9 @@
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
 #include <crm/common/xml.h>
+#include <crm/common/compress.h>
 #include <libxml/xmlreader.h>
+#include <md5.h>
 
 #if HAVE_BZLIB_H
 #  include <bzlib.h>
@@ -135,6 +137,219 @@ int write_file(const char *string, const char *filename);
 xmlNode *subtract_xml_object(xmlNode *parent, xmlNode *left, xmlNode *right, gboolean full, const char *marker);
 int add_xml_object(xmlNode *parent, xmlNode *target, xmlNode *update, gboolean as_diff);
 
+/*
+ * Change tracking
+ *
+ * Once enabled for a document, the mutators in this file flag each
+ * element they change (and all its ancestors) as dirty in the node's
+ * private data.  Elements added to the document are flagged along with
+ * their entire subtree.  Anything still clean is therefore identical to
+ * the element it was copied from, which lets diff_xml_object() skip it.
+ *
+ * The same mutators also discard any cached tree digest (see
+ * calculate_xml_tree_digest()) for the changed element and its ancestors.
+ */
+enum xml_private_flags {
+    xpf_none   = 0x0000,
+    xpf_dirty  = 0x0001,
+    xpf_digest = 0x0002,
+};
+
+typedef struct xml_private_s {
+    long flags;
+    unsigned char digest[MD5_DIGEST_SIZE];
+} xml_private_t;
+
+enum xml_prune {
+    xml_prune_none,
+    xml_prune_left,
+    xml_prune_right,
+};
+
+static const char *xml_tracking_marker = "tracking";
+
+static xmlNode *__subtract_xml_object(
+    xmlNode *parent, xmlNode *left, xmlNode *right, gboolean full, const char *marker,
+    enum xml_prune prune);
+
+static void
+__xml_private_free(xmlNode *xml)
+{
+    /* Documents and attributes also come through here, their _private is not ours */
+    if(xml->type == XML_ELEMENT_NODE && xml->_private != NULL) {
+        crm_free(xml->_private);
+    }
+}
+
+static xml_private_t *
+__xml_private(xmlNode *xml)
+{
+    static gsize registered = 0;
+
+    if(xml->_private == NULL) {
+        if(g_once_init_enter(&registered)) {
+            xmlDeregisterNodeDefault(__xml_private_free);
+            g_once_init_leave(&registered, 1);
+        }
+        crm_malloc0(xml->_private, sizeof(xml_private_t));
+    }
+    return xml->_private;
+}
+
+static inline gboolean
+__xml_flag_set(xmlNode *xml, enum xml_private_flags flag)
+{
+    xml_private_t *p = xml->_private;
+    return p != NULL && (p->flags & flag);
+}
+
+static inline gboolean
+__xml_tracking(xmlNode *xml)
+{
+    return xml != NULL && xml->doc != NULL && xml->doc->_private == xml_tracking_marker;
+}
+
+static inline gboolean
+__xml_node_clean(xmlNode *xml)
+{
+    return __xml_flag_set(xml, xpf_dirty) == FALSE;
+}
+
+/* Does anyone care whether xml changes? */
+static inline gboolean
+__xml_watched(xmlNode *xml)
+{
+    return __xml_flag_set(xml, xpf_digest) || __xml_tracking(xml);
+}
+
+static void
+__xml_node_changed(xmlNode *xml)
+{
+    gboolean tracking = __xml_tracking(xml);
+
+    /* If an element is dirty, so are all of its ancestors.
+     * If an element has a cached digest, so do all of its children.
+     */
+    for(; xml != NULL && xml->type == XML_ELEMENT_NODE; xml = xml->parent) {
+        gboolean more = FALSE;
+
+        if(__xml_flag_set(xml, xpf_digest)) {
+            ((xml_private_t*)xml->_private)->flags &= ~xpf_digest;
+            more = TRUE;
+        }
+        if(tracking && __xml_node_clean(xml)) {
+            __xml_private(xml)->flags |= xpf_dirty;
+            more = TRUE;
+        }
+        if(more == FALSE) {
+            break;
+        }
+    }
+}
+
+static void
+__xml_subtree_dirty(xmlNode *xml)
+{
+    xmlNode *child = NULL;
+
+    __xml_private(xml)->flags |= xpf_dirty;
+    for(child = __xml_first_child(xml); child != NULL; child = __xml_next(child)) {
+        __xml_subtree_dirty(child);
+    }
+}
+
+static void
+__xml_node_created(xmlNode *xml)
+{
+    if(__xml_tracking(xml)) {
+        __xml_subtree_dirty(xml);
+    }
+    __xml_node_changed(xml->parent);
+}
+
+void
+xml_node_changed(xmlNode *xml)
+{
+    CRM_CHECK(xml != NULL, return);
+    __xml_node_changed(xml);
+}
+
+void
+xml_track_changes(xmlNode *xml)
+{
+    xmlDoc *doc = NULL;
+    CRM_CHECK(xml != NULL, return);
+
+    doc = getDocPtr(xml);
+    CRM_CHECK(doc->_private == NULL || doc->_private == xml_tracking_marker, return);
+    doc->_private = (void*)xml_tracking_marker;
+}
+
+gboolean
+xml_tracking_changes(xmlNode *xml)
+{
+    return __xml_tracking(xml);
+}
+
+static void
+__xml_accept_changes(xmlNode *xml)
+{
+    xmlNode *child = NULL;
+
+    if(__xml_node_clean(xml)) {
+        /* Nothing below here can be dirty either */
+        return;
+    }
+
+    ((xml_private_t*)xml->_private)->flags &= ~xpf_dirty;
+    for(child = __xml_first_child(xml); child != NULL; child = __xml_next(child)) {
+        __xml_accept_changes(child);
+    }
+}
+
+void
+xml_accept_changes(xmlNode *xml)
+{
+    xmlNode *top = NULL;
+
+    if(__xml_tracking(xml) == FALSE) {
+        return;
+    }
+
+    top = xmlDocGetRootElement(xml->doc);
+    if(top != NULL) {
+        __xml_accept_changes(top);
+    }
+    xml->doc->_private = NULL;
+}
+
+/* Copies are identical, so they can share any digests already calculated */
+static void
+__xml_copy_digests(xmlNode *src, xmlNode *copy)
+{
+    xml_private_t *p = NULL;
+    xmlNode *src_child = NULL;
+    xmlNode *copy_child = NULL;
+
+    if(src->_private == NULL) {
+        /* Nothing has ever been calculated for this part of the tree */
+        return;
+
+    } else if(__xml_flag_set(src, xpf_digest)) {
+        p = __xml_private(copy);
+        p->flags |= xpf_digest;
+        memcpy(p->digest, ((xml_private_t*)src->_private)->digest, MD5_DIGEST_SIZE);
+    }
+
+    src_child = __xml_first_child(src);
+    copy_child = __xml_first_child(copy);
+    while(src_child != NULL && copy_child != NULL) {
+        __xml_copy_digests(src_child, copy_child);
+        src_child = __xml_next(src_child);
+        copy_child = __xml_next(copy_child);
+    }
+}
+
 xmlNode *
 find_xml_node(xmlNode *root, const char * search_path, gboolean must_find)
 {
@@ -311,6 +526,8 @@ add_node_copy(xmlNode *parent, xmlNode *src_node)
 
     child = xmlDocCopyNode(src_node, doc, 1);
     xmlAddChild(parent, child);
+    __xml_copy_digests(src_node, child);
+    __xml_node_created(child);
     return child;
 }
 
@@ -346,6 +563,14 @@ crm_xml_add(xmlNode* node, const char *name, const char *value)
 		  return value);
     }
 #endif
+
+    if(__xml_watched(node)) {
+        const char *old_value = crm_element_value(node, name);
+
+        if(old_value == NULL || strcmp(old_value, value) != 0) {
+            __xml_node_changed(node);
+        }
+    }
     
     attr = xmlSetProp(node, (const xmlChar*)name, (const xmlChar*)value);
     CRM_CHECK(attr && attr->children && attr->children->content, return NULL);
@@ -371,6 +596,9 @@ crm_xml_replace(xmlNode* node, const char *name, const char *value)
 
     } else if(value == NULL) {
 	return NULL;
+
+    } else if(old_value == NULL || strcmp(old_value, value) != 0) {
+	__xml_node_changed(node);
     }
     
     attr = xmlSetProp(node, (const xmlChar*)name, (const xmlChar*)value);
@@ -406,6 +634,7 @@ create_xml_node(xmlNode *parent, const char *name)
 	doc = getDocPtr(parent);
 	node = xmlNewDocRawNode(doc, NULL, (const xmlChar*)name, NULL);
 	xmlAddChild(parent, node);
+	__xml_node_created(node);
     }
     return node;
 }
@@ -415,6 +644,7 @@ free_xml_from_parent(xmlNode *parent, xmlNode *a_node)
 {
     CRM_CHECK(a_node != NULL, return);
 
+    __xml_node_changed(a_node->parent);
     xmlUnlinkNode(a_node);
     xmlFreeNode(a_node);
 }
@@ -426,6 +656,7 @@ copy_xml(xmlNode *src)
     xmlNode *copy = xmlDocCopyNode(src, doc, 1);
     xmlDocSetRootElement(doc, copy);
     xmlSetTreeDoc(copy, doc);
+    __xml_copy_digests(src, copy);
     return copy;
 }
 
@@ -594,7 +825,7 @@ stdin2xml(void)
 }
 
 static char *
-decompress_file(const char *filename)
+decompress_file(const char *filename, enum crm_codec codec)
 {
     char *buffer = NULL;
 #if HAVE_BZLIB_H
@@ -602,8 +833,13 @@ decompress_file(const char *filename)
     size_t length = 0, read_len = 0;
     
     BZFILE *bz_file = NULL;
-    FILE *input = fopen(filename, "r");
+    FILE *input = NULL;
+
+    if(codec != crm_codec_bz2) {
+	goto other_codec;
+    }
 
+    input = fopen(filename, "r");
     if(input == NULL) {
 	crm_perror(LOG_ERR,"Could not open %s for reading", filename);
 	return NULL;
@@ -641,11 +877,36 @@ decompress_file(const char *filename)
     
     BZ2_bzReadClose (&rc, bz_file);
     fclose(input);
-    
-#else
-    crm_err("Cannot read compressed files:"
-	    " bzlib was not available at compile time");
+    return buffer;
+
+  other_codec:
 #endif
+    {
+	struct stat st;
+	char *compressed = NULL;
+	FILE *input = fopen(filename, "r");
+
+	if(input == NULL) {
+	    crm_perror(LOG_ERR,"Could not open %s for reading", filename);
+	    return NULL;
+
+	} else if(fstat(fileno(input), &st) < 0 || st.st_size <= 0) {
+	    crm_err("Could not determine the size of %s", filename);
+	    fclose(input);
+	    return NULL;
+	}
+
+	crm_malloc0(compressed, st.st_size);
+	if(fread(compressed, 1, st.st_size, input) == (size_t)st.st_size) {
+	    buffer = crm_decompress_all(codec, compressed, st.st_size, NULL);
+	}
+	if(buffer == NULL) {
+	    crm_err("Couldnt read %s compressed xml from %s", crm_codec2text(codec), filename);
+	}
+
+	crm_free(compressed);
+	fclose(input);
+    }
     return buffer;
 }
 
@@ -680,7 +941,7 @@ filename2xml(const char *filename)
 {
     xmlNode *xml = NULL;
     xmlDocPtr output = NULL;
-    const char *match = NULL;
+    enum crm_codec codec = crm_codec_none;
     xmlParserCtxtPtr ctxt = NULL;
     xmlErrorPtr last_error = NULL;
     static int xml_options = XML_PARSE_NOBLANKS|XML_PARSE_RECOVER;
@@ -696,18 +957,18 @@ filename2xml(const char *filename)
     /* initGenericErrorDefaultFunc(crm_xml_err); */
 
     if(filename) {
-        match = strstr(filename, ".bz2");
+        codec = crm_codec_from_filename(filename);
     }
 
     if(filename == NULL) {
 	/* STDIN_FILENO == fileno(stdin) */
 	output = xmlCtxtReadFd(ctxt, STDIN_FILENO, "unknown.xml", NULL, xml_options);
 
-    } else if(match == NULL || match[4] != 0) {
+    } else if(codec == crm_codec_none) {
 	output = xmlCtxtReadFile(ctxt, filename, NULL, xml_options);
 
     } else {
-	char *input = decompress_file(filename);
+	char *input = decompress_file(filename, codec);
 	output = xmlCtxtReadDoc(ctxt, (const xmlChar*)input, NULL, NULL, xml_options);
 	crm_free(input);
     }
@@ -739,6 +1000,50 @@ filename2xml(const char *filename)
     return xml;
 }
 
+static int
+xml_stream_to_file(void *context, const char *buffer, int len)
+{
+    FILE *stream = context;
+
+    if(fwrite(buffer, 1, len, stream) != (size_t)len) {
+	return -1;
+    }
+    return len;
+}
+
+static int
+xml_stream_to_md5(void *context, const char *buffer, int len)
+{
+    md5_process_bytes(buffer, len, context);
+    return len;
+}
+
+/*
+ * Serialize an_xml_node directly into the supplied callback instead of
+ * building the whole document in memory first.
+ *
+ * The output is byte-for-byte identical to xmlNodeDump() (and therefore to
+ * dump_xml()) since that is just a wrapper around xmlNodeDumpOutput() with
+ * an in-memory buffer.
+ *
+ * Returns the number of bytes written or -1 on error.
+ */
+static int
+stream_xml(xmlNode *an_xml_node, gboolean formatted,
+	   xmlOutputWriteCallback writer, void *context)
+{
+    xmlOutputBuffer *out = NULL;
+    xmlDoc *doc = getDocPtr(an_xml_node);
+
+    CRM_CHECK(doc != NULL, return -1);
+
+    out = xmlOutputBufferCreateIO(writer, NULL, context, NULL);
+    CRM_CHECK(out != NULL, return -1);
+
+    xmlNodeDumpOutput(out, doc, an_xml_node, 0, formatted, NULL);
+    return xmlOutputBufferClose(out);
+}
+
 int
 write_xml_file(xmlNode *xml_node, const char *filename, gboolean compress) 
 {
@@ -748,6 +1053,7 @@ write_xml_file(xmlNode *xml_node, const char *filename, gboolean compress)
     char *now_str = NULL;
     unsigned int out = 0;
     FILE *file_output_strm = NULL;
+    enum crm_codec codec = crm_codec_none;
     static mode_t cib_mode = S_IRUSR|S_IWUSR;
 	
     CRM_CHECK(filename != NULL, return -1);
@@ -776,12 +1082,40 @@ write_xml_file(xmlNode *xml_node, const char *filename, gboolean compress)
     crm_xml_add(xml_node, XML_CIB_ATTR_WRITTEN, now_str);
     crm_validate_data(xml_node);
 	
+    if(compress == FALSE) {
+	/* Avoid holding a second, serialized, copy of the document in memory */
+	res = stream_xml(xml_node, TRUE, xml_stream_to_file, file_output_strm);
+	if(res <= 0) {
+	    crm_perror(LOG_ERR,"Cannot write output to %s", filename);
+	    res = -1;
+	}
+	goto bail;
+    }
+
     buffer = dump_xml_formatted(xml_node);
     CRM_CHECK(buffer != NULL && strlen(buffer) > 0,
 	      crm_log_xml_warn(xml_node, "dump:failed");
 	      goto bail);	
 
-    if(compress) {
+    codec = crm_codec_from_filename(filename);
+    if(compress && codec != crm_codec_none && codec != crm_codec_bz2) {
+	char *compressed = NULL;
+
+	if(crm_compress(codec, buffer, strlen(buffer), &compressed, &out) == FALSE) {
+	    /* Plain text would not match the file name */
+	    crm_err("Cannot write %s: %s compression failed", filename, crm_codec2text(codec));
+	    res = -1;
+	    goto bail;
+
+	} else if(fwrite(compressed, 1, out, file_output_strm) != out) {
+	    crm_perror(LOG_ERR,"Cannot write output to %s", filename);
+	    crm_free(compressed);
+	    res = -1;
+	    goto bail;
+	}
+	crm_free(compressed);
+
+    } else if(compress) {
 #if HAVE_BZLIB_H
 	int rc = BZ_OK;
 	unsigned int in = 0;
@@ -839,6 +1173,296 @@ write_xml_file(xmlNode *xml_node, const char *filename, gboolean compress)
     return res;
 }
 
+/*
+ * Append-only archives
+ *
+ * Each record is a one-line header followed by <length> bytes of
+ * unformatted XML and a newline:
+ *
+ *     <type> <sequence> <digest> <length>
+ *
+ * Keyframe ('K') records contain the complete document, delta ('D')
+ * records contain the diff_xml_object() result against the document in
+ * the record before it.  The digest covers the complete document.
+ */
+#define XML_ARCHIVE_KEYFRAME	'K'
+#define XML_ARCHIVE_DELTA	'D'
+#define XML_ARCHIVE_HEADER_LEN	256
+
+static char *
+archive_digest(xmlNode *xml)
+{
+    /* Unfiltered, a record has to reproduce every attribute */
+    return calculate_xml_versioned_digest(xml, FALSE, FALSE, CRM_FEATURE_SET);
+}
+
+int
+append_xml_archive(const char *archive, int sequence, xmlNode *xml, xmlNode *base,
+		   gboolean *is_delta)
+{
+    int len = 0;
+    int res = -1;
+    char type = XML_ARCHIVE_KEYFRAME;
+    char *digest = NULL;
+    char *buffer = NULL;
+    xmlNode *diff = NULL;
+    FILE *archive_strm = NULL;
+
+    CRM_CHECK(archive != NULL, return -1);
+    CRM_CHECK(xml != NULL, return -1);
+
+    digest = archive_digest(xml);
+    CRM_CHECK(digest != NULL, return -1);
+
+    if(base != NULL) {
+	xmlNode *applied = NULL;
+
+	diff = diff_xml_object(base, xml, FALSE);
+	if(diff == NULL) {
+	    /* Nothing changed, an empty diff is enough */
+	    diff = create_xml_node(NULL, "diff");
+	    crm_xml_add(diff, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
+	}
+
+	/* Diffs ignore some attributes and don't always preserve the order
+	 * of children, so only use one if it really reproduces xml
+	 */
+	if(apply_xml_diff(base, diff, &applied)) {
+	    char *applied_digest = archive_digest(applied);
+
+	    if(safe_str_eq(applied_digest, digest)) {
+		type = XML_ARCHIVE_DELTA;
+	    }
+	    crm_free(applied_digest);
+	}
+	if(type != XML_ARCHIVE_DELTA) {
+	    crm_trace("Diff does not reproduce %s@%d, storing it in full", archive, sequence);
+	}
+	free_xml(applied);
+    }
+
+    if(type == XML_ARCHIVE_DELTA) {
+	buffer = dump_xml_unformatted(diff);
+    } else {
+	buffer = dump_xml_unformatted(xml);
+    }
+    free_xml(diff);
+    CRM_CHECK(buffer != NULL, crm_free(digest); return -1);
+
+    archive_strm = fopen(archive, "a");
+    if(archive_strm == NULL) {
+	crm_perror(LOG_ERR, "Cannot open %s for appending", archive);
+	goto bail;
+    }
+    fchmod(fileno(archive_strm), S_IRUSR|S_IWUSR);
+
+    len = strlen(buffer);
+    if(fprintf(archive_strm, "%c %d %s %d\n%s\n", type, sequence, digest, len, buffer) < 0) {
+	crm_perror(LOG_ERR, "Cannot append to %s", archive);
+
+    } else if(fflush(archive_strm) != 0) {
+	crm_perror(LOG_ERR, "fflush for %s failed", archive);
+
+    } else if(fsync(fileno(archive_strm)) < 0) {
+	crm_perror(LOG_ERR, "fsync for %s failed", archive);
+
+    } else {
+	crm_trace("Appended %s record %d (%d bytes) to %s",
+		  type == XML_ARCHIVE_DELTA ? "delta" : "keyframe", sequence, len, archive);
+	res = len;
+    }
+    fclose(archive_strm);
+
+  bail:
+    if(is_delta) {
+	*is_delta = (type == XML_ARCHIVE_DELTA);
+    }
+    crm_free(buffer);
+    crm_free(digest);
+    return res;
+}
+
+/* Reads the next record header, leaving the stream at its payload */
+static gboolean
+archive_read_header(FILE *archive_strm, const char *archive,
+		    char *type, int *seq, char *digest, int *len)
+{
+    char header[XML_ARCHIVE_HEADER_LEN];
+
+    if(fgets(header, XML_ARCHIVE_HEADER_LEN, archive_strm) == NULL) {
+	return FALSE;
+
+    } else if(sscanf(header, "%c %d %255s %d", type, seq, digest, len) != 4 || *len <= 0) {
+	crm_err("Corrupt record header in %s: %s", archive, header);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Rebuild the document stored as sequence in archive (or the most recent
+ * one if sequence is negative).
+ *
+ * The headers are scanned first, skipping over the payloads, to find the
+ * record and the closest keyframe before it.  Only the records from that
+ * keyframe on are parsed and replayed, and the result has to match the
+ * digest recorded for it.
+ */
+static xmlNode *
+read_xml_archive(const char *archive, int sequence)
+{
+    int seq = 0;
+    int len = 0;
+    char type = 0;
+    char digest[XML_ARCHIVE_HEADER_LEN];
+    char expected[XML_ARCHIVE_HEADER_LEN];
+
+    long offset = 0;
+    long target = -1;
+    long keyframe = -1;
+    long target_keyframe = -1;
+
+    char *buffer = NULL;
+    char *calculated = NULL;
+    xmlNode *current = NULL;
+    FILE *archive_strm = fopen(archive, "r");
+
+    if(archive_strm == NULL) {
+	crm_debug("Cannot open archive %s: %s", archive, strerror(errno));
+	return NULL;
+    }
+
+    while((offset = ftell(archive_strm)) >= 0
+	  && archive_read_header(archive_strm, archive, &type, &seq, digest, &len)) {
+
+	if(fseek(archive_strm, len, SEEK_CUR) != 0 || fgetc(archive_strm) != '\n') {
+	    /* Most likely a partial write at the end of the archive */
+	    crm_warn("Truncated record %d in %s", seq, archive);
+	    break;
+	}
+
+	if(type == XML_ARCHIVE_KEYFRAME) {
+	    keyframe = offset;
+	}
+
+	/* Sequence numbers wrap, the latest occurrence is the one wanted */
+	if(sequence < 0 || seq == sequence) {
+	    target = offset;
+	    target_keyframe = keyframe;
+	    strcpy(expected, digest);
+	}
+    }
+
+    if(target < 0) {
+	crm_trace("No record %d in %s", sequence, archive);
+	goto bail;
+
+    } else if(target_keyframe < 0) {
+	crm_err("No keyframe precedes record %d in %s", sequence, archive);
+	goto bail;
+
+    } else if(fseek(archive_strm, target_keyframe, SEEK_SET) != 0) {
+	crm_perror(LOG_ERR, "Cannot seek to offset %ld in %s", target_keyframe, archive);
+	goto bail;
+    }
+
+    do {
+	xmlNode *record = NULL;
+
+	offset = ftell(archive_strm);
+	if(archive_read_header(archive_strm, archive, &type, &seq, digest, &len) == FALSE) {
+	    break;
+	}
+
+	crm_malloc0(buffer, len + 1);
+	if(fread(buffer, 1, len, archive_strm) != (size_t)len || fgetc(archive_strm) != '\n') {
+	    crm_warn("Truncated record %d in %s", seq, archive);
+	    crm_free(buffer);
+	    break;
+	}
+
+	record = string2xml(buffer);
+	crm_free(buffer);
+
+	if(record == NULL) {
+	    crm_err("Could not parse record %d in %s", seq, archive);
+	    free_xml(current);
+	    current = NULL;
+
+	} else if(type == XML_ARCHIVE_KEYFRAME) {
+	    free_xml(current);
+	    current = record;
+	    record = NULL;
+
+	} else if(type == XML_ARCHIVE_DELTA && current != NULL) {
+	    xmlNode *next = NULL;
+
+	    if(apply_xml_diff(current, record, &next) == FALSE) {
+		crm_err("Could not apply record %d in %s", seq, archive);
+		free_xml(next);
+		next = NULL;
+	    }
+	    free_xml(current);
+	    current = next;
+	}
+	free_xml(record);
+
+    } while(current != NULL && offset < target);
+
+    if(current == NULL || offset != target) {
+	crm_err("Could not rebuild record %d in %s", sequence, archive);
+	free_xml(current);
+	current = NULL;
+	goto bail;
+    }
+
+    calculated = archive_digest(current);
+    if(safe_str_neq(calculated, expected)) {
+	crm_err("Digest mis-match for record %d in %s: expected %s, calculated %s",
+		seq, archive, expected, calculated);
+	free_xml(current);
+	current = NULL;
+    }
+    crm_free(calculated);
+
+  bail:
+    fclose(archive_strm);
+    return current;
+}
+
+xmlNode *
+archive2xml(const char *spec)
+{
+    int sequence = -1;
+    char *archive = NULL;
+    char *marker = NULL;
+    xmlNode *xml = NULL;
+
+    CRM_CHECK(spec != NULL, return NULL);
+
+    archive = crm_strdup(spec);
+    marker = strrchr(archive, XML_ARCHIVE_SEPARATOR);
+    if(marker != NULL) {
+	*marker = 0;
+	sequence = crm_parse_int(marker + 1, "-1");
+    }
+
+    xml = read_xml_archive(archive, sequence);
+    if(xml == NULL && sequence >= 0) {
+	/* It may have been rotated out */
+	char *previous = crm_concat(archive, "old", '.');
+
+	xml = read_xml_archive(previous, sequence);
+	crm_free(previous);
+    }
+
+    if(xml == NULL) {
+	crm_err("Could not extract %s", spec);
+    }
+    crm_free(archive);
+    return xml;
+}
+
 xmlNode *
 get_message_xml(xmlNode *msg, const char *field) 
 {
@@ -1078,6 +1702,9 @@ crm_element_value_copy(xmlNode *data, const char *name)
 void
 xml_remove_prop(xmlNode *obj, const char *name)
 {
+    if(__xml_watched(obj) && xmlHasProp(obj, (const xmlChar*)name)) {
+	__xml_node_changed(obj);
+    }
     xmlUnsetProp(obj, (const xmlChar*)name);
 }
 
@@ -1132,6 +1759,7 @@ apply_xml_diff(xmlNode *old, xmlNode *diff, xmlNode **new)
     gboolean result = TRUE;
     int root_nodes_seen = 0;
     const char *digest = crm_element_value(diff, XML_ATTR_DIGEST);
+    const char *tree_digest = crm_element_value(diff, XML_ATTR_TREE_DIGEST);
     const char *version = crm_element_value(diff, XML_ATTR_CRM_VERSION);
 
     xmlNode *child_diff = NULL;
@@ -1176,10 +1804,16 @@ apply_xml_diff(xmlNode *old, xmlNode *diff, xmlNode **new)
 		" saw %d", root_nodes_seen);
 	result = FALSE;
 
-    } else if(result && digest) {
+    } else if(result && (digest || tree_digest)) {
 	char *new_digest = NULL;
 	purge_diff_markers(*new); /* Purge now so the diff is ok */
-	new_digest = calculate_xml_versioned_digest(*new, FALSE, TRUE, version);
+	if(tree_digest) {
+	    /* Cheaper, most of *new was copied along with its digests */
+	    digest = tree_digest;
+	    new_digest = calculate_xml_tree_digest(*new);
+	} else {
+	    new_digest = calculate_xml_versioned_digest(*new, FALSE, TRUE, version);
+	}
 	if(safe_str_neq(new_digest, digest)) {
 	    crm_info("Digest mis-match: expected %s, calculated %s",
 		     digest, new_digest);
@@ -1252,15 +1886,19 @@ diff_xml_object(xmlNode *old, xmlNode *new, gboolean suppress)
     xmlNode *diff    = create_xml_node(NULL, "diff");
     xmlNode *removed = create_xml_node(diff, "diff-removed");
     xmlNode *added   = create_xml_node(diff, "diff-added");
+    gboolean tracked = xml_tracking_changes(new);
 
     crm_xml_add(diff, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
 	
-    tmp1 = subtract_xml_object(removed, old, new, FALSE, "removed:top");
+    /* If new is tracking changes, only its dirty subtrees need comparing */
+    tmp1 = __subtract_xml_object(removed, old, new, FALSE, "removed:top",
+                                 tracked?xml_prune_right:xml_prune_none);
     if(suppress && tmp1 != NULL && can_prune_leaf(tmp1)) {
 	free_xml_from_parent(removed, tmp1);
     }
 	
-    tmp1 = subtract_xml_object(added, new, old, TRUE, "added:top");
+    tmp1 = __subtract_xml_object(added, new, old, TRUE, "added:top",
+                                 tracked?xml_prune_left:xml_prune_none);
     if(suppress && tmp1 != NULL && can_prune_leaf(tmp1)) {
 	free_xml_from_parent(added, tmp1);
     }
@@ -1361,6 +1999,13 @@ in_upper_context(int depth, int context, xmlNode *xml_node)
 
 xmlNode *
 subtract_xml_object(xmlNode *parent, xmlNode *left, xmlNode *right, gboolean full, const char *marker)
+{
+    return __subtract_xml_object(parent, left, right, full, marker, xml_prune_none);
+}
+
+static xmlNode *
+__subtract_xml_object(xmlNode *parent, xmlNode *left, xmlNode *right, gboolean full, const char *marker,
+                      enum xml_prune prune)
 {
     gboolean skip = FALSE;
     gboolean differences = FALSE;
@@ -1393,6 +2038,12 @@ subtract_xml_object(xmlNode *parent, xmlNode *left, xmlNode *right, gboolean ful
 	return deleted;
     }
 
+    if((prune == xml_prune_left && __xml_node_clean(left))
+       || (prune == xml_prune_right && __xml_node_clean(right))) {
+	crm_trace("\tNo changes to <%s id=%s> since tracking began", crm_element_name(left), id);
+	return NULL;
+    }
+
     name = crm_element_name(left);
     CRM_CHECK(name != NULL, return NULL);
 
@@ -1408,7 +2059,7 @@ subtract_xml_object(xmlNode *parent, xmlNode *left, xmlNode *right, gboolean ful
     for(left_child = __xml_first_child(left); left_child != NULL; left_child = __xml_next(left_child)) {
 	right_child = find_entity(
 	    right, crm_element_name(left_child), ID(left_child));
-	child_diff = subtract_xml_object(diff, left_child, right_child, full, marker);
+	child_diff = __subtract_xml_object(diff, left_child, right_child, full, marker, prune);
 	if(child_diff != NULL) {
 	    differences = TRUE;
 	}
@@ -1549,6 +2200,7 @@ add_xml_object(xmlNode *parent, xmlNode *target, xmlNode *update, gboolean as_di
 
     } else {
 	/* No need for expand_plus_plus(), just raw speed */
+	__xml_node_changed(target);
 	xml_prop_iter(update, p_name, p_value,
 		      /* Remove it first so the ordering of the update is preserved */
 		      xmlUnsetProp(target, (const xmlChar*)p_name);
@@ -1679,6 +2331,7 @@ replace_xml_child(xmlNode *parent, xmlNode *child, xmlNode *update, gboolean del
 	    xmlNode *tmp = copy_xml(update);
 	    xmlDoc *doc = tmp->doc;
 	    xmlNode *old = xmlReplaceNode(child, tmp);
+	    __xml_node_created(tmp);
 	    free_xml_from_parent(NULL, old);
 	    xmlDocSetRootElement(doc, NULL);
 	    xmlFreeDoc(doc);
@@ -1925,9 +2578,12 @@ filter_xml(xmlNode *data, filter_t *filter, int filter_len, gboolean recursive)
 static char *
 calculate_xml_digest_v1(xmlNode *input, gboolean sort, gboolean do_filter)
 {
+    int lpc = 0;
+    int len = 0;
     char *digest = NULL;
     xmlNode *copy = NULL;
-    char *buffer = NULL;
+    struct md5_ctx ctx;
+    unsigned char raw_digest[MD5_DIGEST_SIZE];
 
     if(sort || do_filter) {
 	copy = sorted_xml(input, NULL, TRUE);
@@ -1938,14 +2594,26 @@ calculate_xml_digest_v1(xmlNode *input, gboolean sort, gboolean do_filter)
 	filter_xml(input, filter, DIMOF(filter), TRUE);
     }
 
-    buffer = dump_xml(input, FALSE, TRUE);
-    CRM_CHECK(buffer != NULL && strlen(buffer) > 0, free_xml(copy); crm_free(buffer); return NULL);
+    /* Hash the serialized form as it is produced rather than dumping it
+     * to a buffer first.  The leading space and trailing newline keep the
+     * result identical to the historical dump_xml(input, FALSE, TRUE) output
+     * since on-disk and operation digests must not change.
+     */
+    md5_init_ctx(&ctx);
+    md5_process_bytes(" ", 1, &ctx);
+    len = stream_xml(input, FALSE, xml_stream_to_md5, &ctx);
+    CRM_CHECK(len > 0, free_xml(copy); return NULL);
+    md5_process_bytes("\n", 1, &ctx);
+    md5_finish_ctx(&ctx, raw_digest);
+
+    crm_malloc0(digest, (2 * MD5_DIGEST_SIZE) + 1);
+    for(lpc = 0; lpc < MD5_DIGEST_SIZE; lpc++) {
+	sprintf(digest + (2 * lpc), "%02x", raw_digest[lpc]);
+    }
 
-    digest = crm_md5sum(buffer);
-    crm_trace("Digest %s: %s\n", digest, buffer);
+    crm_trace("Digest %s: %d bytes", digest, len + 2);
     crm_log_xml_trace(copy,  "digest:source");
 
-    crm_free(buffer);
     free_xml(copy);
     return digest;
 }
@@ -2081,6 +2749,81 @@ calculate_xml_versioned_digest(xmlNode *input, gboolean sort, gboolean do_filter
     return calculate_xml_digest_v2(input, do_filter);
 }
 
+static void
+__xml_tree_digest(xmlNode *xml, unsigned char *result)
+{
+    int lpc = 0;
+    xmlAttr *attr = NULL;
+    xmlNode *child = NULL;
+    xml_private_t *p = __xml_private(xml);
+    const char *name = crm_element_name(xml);
+    struct md5_ctx ctx;
+
+    if(p->flags & xpf_digest) {
+	memcpy(result, p->digest, MD5_DIGEST_SIZE);
+	return;
+    }
+
+    /* Each element hashes its name, its (filtered) attributes and
+     * the digests of its children, so that only the elements changed
+     * since the last call need to be visited again
+     */
+    md5_init_ctx(&ctx);
+    md5_process_bytes(name, strlen(name) + 1, &ctx);
+
+    for(attr = xml->properties; attr != NULL; attr = attr->next) {
+	const char *p_name = (const char *)attr->name;
+	const char *p_value = crm_element_value(xml, p_name);
+
+	if(p_value == NULL) {
+	    p_value = "";
+	}
+	for(lpc = 0; lpc < DIMOF(filter); lpc++) {
+	    if(safe_str_eq(p_name, filter[lpc].string)) {
+		break;
+	    }
+	}
+	if(lpc < DIMOF(filter)) {
+	    continue;
+	}
+
+	md5_process_bytes("a", 1, &ctx);
+	md5_process_bytes(p_name, strlen(p_name) + 1, &ctx);
+	md5_process_bytes(p_value, strlen(p_value) + 1, &ctx);
+    }
+
+    for(child = __xml_first_child(xml); child != NULL; child = __xml_next(child)) {
+	unsigned char child_digest[MD5_DIGEST_SIZE];
+
+	__xml_tree_digest(child, child_digest);
+	md5_process_bytes("c", 1, &ctx);
+	md5_process_bytes(child_digest, MD5_DIGEST_SIZE, &ctx);
+    }
+
+    md5_finish_ctx(&ctx, p->digest);
+    p->flags |= xpf_digest;
+    memcpy(result, p->digest, MD5_DIGEST_SIZE);
+}
+
+char *
+calculate_xml_tree_digest(xmlNode *input)
+{
+    int lpc = 0;
+    char *digest = NULL;
+    unsigned char raw_digest[MD5_DIGEST_SIZE];
+
+    CRM_CHECK(input != NULL, return NULL);
+
+    __xml_tree_digest(input, raw_digest);
+
+    crm_malloc0(digest, 2*MD5_DIGEST_SIZE + 1);
+    for(lpc = 0; lpc < MD5_DIGEST_SIZE; lpc++) {
+	sprintf(digest+(2*lpc), "%02x", raw_digest[lpc]);
+    }
+    crm_trace("Tree digest %s", digest);
+    return digest;
+}
+
 static gboolean
 validate_with_dtd(
     xmlDocPtr doc, gboolean to_logs, const char *dtd_file) 
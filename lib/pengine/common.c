@@ -156,6 +156,15 @@ pe_cluster_option pe_opts[] = {
 	  "The number of PE inputs resulting in WARNINGs to save", "Zero to disable, -1 to store unlimited." },
 	{ "pe-input-series-max", NULL, "integer", NULL, "4000", &check_number,
 	  "The number of other PE inputs to save", "Zero to disable, -1 to store unlimited." },
+	{ "pe-input-archive", NULL, "boolean", NULL, "false", &check_boolean,
+	  "Store PE inputs in one append-only archive per series",
+	  "Inputs are stored as differences from the previous one, with a complete copy at regular intervals, instead of as individual compressed files."
+	  "  Use crm_simulate -x with $archive@$sequence to extract one." },
+
+	/* Performance */
+	{ "pe-threads", NULL, "integer", NULL, "1", &check_number,
+	  "The number of threads the PE may use to process the status section",
+	  "Zero or one disables threading.  Mostly useful for clusters with many nodes." },
 
 	/* Node health */
 	{ "node-health-strategy", NULL, "enum", "none, migrate-on-red, only-green, progressive, custom", "none", &check_health,
@@ -663,6 +663,10 @@ common_free(resource_t * rsc)
         g_list_free(rsc->actions);
         rsc->actions = NULL;
     }
+    if (rsc->action_index) {
+        g_hash_table_destroy(rsc->action_index);
+        rsc->action_index = NULL;
+    }
     if (rsc->allowed_nodes) {
         g_hash_table_destroy(rsc->allowed_nodes);
         rsc->allowed_nodes = NULL;
@@ -27,110 +27,568 @@
 
 CRM_TRACE_INIT_DATA(pe_rules);
 
-ha_time_t *parse_xml_duration(ha_time_t * start, xmlNode * duration_spec);
+/* As per the nethack rules:
+ *
+ * moon period = 29.53058 days ~= 30, year = 365.2422 days
+ * days moon phase advances on first day of year compared to preceding year
+ *      = 365.2422 - 12*29.53058 ~= 11
+ * years in Metonic cycle (time until same phases fall on the same days of
+ *      the month) = 18.6 ~= 19
+ * moon phase on first day of year (epact) ~= (11*(year%19) + 29) % 30
+ *      (29 as initial condition)
+ * current phase in days = first day phase + days elapsed in year
+ * 6 moons ~= 177 days
+ * 177 ~= 8 reported phases * 22
+ * + 11/22 for rounding
+ *
+ * 0-7, with 0: new, 4: full
+ */
 
-gboolean test_date_expression(xmlNode * time_expr, ha_time_t * now);
-gboolean cron_range_satisfied(ha_time_t * now, xmlNode * cron_spec);
-gboolean test_attr_expression(xmlNode * expr, GHashTable * hash, ha_time_t * now);
-gboolean test_role_expression(xmlNode * expr, enum rsc_role_e role, ha_time_t * now);
+static int
+phase_of_the_moon(ha_time_t * now)
+{
+    int epact, diy, goldn;
 
-gboolean
-test_ruleset(xmlNode * ruleset, GHashTable * node_hash, ha_time_t * now)
+    diy = now->yeardays;
+    goldn = (now->years % 19) + 1;
+    epact = (11 * goldn + 18) % 30;
+    if ((epact == 25 && goldn > 11) || epact == 24)
+        epact++;
+
+    return ((((((diy + epact) * 6) + 11) % 177) / 22) & 7);
+}
+
+/*
+ * Rules and attribute sets are compiled into the structures below before
+ * being evaluated: operations and comparison types are resolved, dates
+ * are parsed, numbers converted and attribute names interned up-front.
+ *
+ * Between pe_rules_cache_enable() and pe_rules_cache_flush() the compiled
+ * form of anything in the enabled document is kept, so that evaluating
+ * the same rule for every node or resource only compiles it once.
+ * Everything else is compiled, evaluated and discarded as needed.
+ */
+enum rule_op {
+    rule_op_unknown,
+    rule_op_defined,
+    rule_op_not_defined,
+    rule_op_eq,
+    rule_op_ne,
+    rule_op_lt,
+    rule_op_lte,
+    rule_op_gt,
+    rule_op_gte,
+};
+
+enum rule_cmp {
+    rule_cmp_none,
+    rule_cmp_string,
+    rule_cmp_number,
+    rule_cmp_version,
+};
+
+enum date_op {
+    date_op_unknown,
+    date_op_in_range,
+    date_op_date_spec,
+    date_op_gt,
+    date_op_lt,
+    date_op_eq,
+    date_op_neq,
+};
+
+/* The date_spec fields, in the order they are checked */
+enum cron_field {
+    cron_seconds,
+    cron_minutes,
+    cron_hours,
+    cron_monthdays,
+    cron_weekdays,
+    cron_yeardays,
+    cron_weeks,
+    cron_months,
+    cron_years,
+    cron_weekyears,
+    cron_moon,
+    cron_max
+};
+
+static const char *cron_field_names[cron_max] = {
+    "seconds", "minutes", "hours", "monthdays", "weekdays", "yeardays",
+    "weeks", "months", "years", "weekyears", "moon"
+};
+
+typedef struct compiled_rule_s compiled_rule_t;
+
+typedef struct compiled_expr_s {
+    char *id;
+    enum expression_type type;
+
+    /* attr_expr, loc_expr and role_expr */
+    const char *attr;           /* interned */
+    const char *op_text;
+    enum rule_op op;
+    enum rule_cmp cmp;
+    char *value;
+    int value_i;
+    enum rsc_role_e value_role;
+
+    /* nested_rule */
+    compiled_rule_t *rule;
+
+    /* time_expr */
+    enum date_op date_op;
+    ha_time_t *start;
+    ha_time_t *end;
+    unsigned int cron_set;
+    int cron_low[cron_max];
+    int cron_high[cron_max];
+} compiled_expr_t;
+
+struct compiled_rule_s {
+    char *id;
+    gboolean cached;
+    gboolean do_and;
+    GListPtr expressions;       /* compiled_expr_t */
+};
+
+typedef struct compiled_nvpair_s {
+    const char *name;           /* interned */
+    char *value;
+} compiled_nvpair_t;
+
+/* An attribute set, or a ruleset such as a constraint's lifetime */
+typedef struct compiled_set_s {
+    char *id;
+    int score;
+    gboolean cached;
+    gboolean have_rules;
+    GListPtr rules;             /* compiled_rule_t */
+    GListPtr nvpairs;           /* compiled_nvpair_t, in document order */
+} compiled_set_t;
+
+static xmlDoc *rules_cache_doc = NULL;
+static GHashTable *rule_cache = NULL;   /* xmlNode* => compiled_rule_t* */
+static GHashTable *set_cache = NULL;    /* xmlNode* => compiled_set_t* */
+static GHashTable *attrs_cache = NULL;  /* see attrs_cache_key() => sorted GListPtr of compiled_set_t* */
+
+static compiled_rule_t *compile_rule(xmlNode * rule);
+static void free_compiled_rule(gpointer data);
+static gboolean eval_rule(compiled_rule_t * rule, GHashTable * node_hash,
+                          enum rsc_role_e role, ha_time_t * now);
+
+static enum rule_op
+text2rule_op(const char *op)
 {
-    gboolean ruleset_default = TRUE;
-    xmlNode *rule = NULL;
+    if (safe_str_eq(op, "defined")) {
+        return rule_op_defined;
+    } else if (safe_str_eq(op, "not_defined")) {
+        return rule_op_not_defined;
+    } else if (safe_str_eq(op, "eq")) {
+        return rule_op_eq;
+    } else if (safe_str_eq(op, "ne")) {
+        return rule_op_ne;
+    } else if (safe_str_eq(op, "lt")) {
+        return rule_op_lt;
+    } else if (safe_str_eq(op, "lte")) {
+        return rule_op_lte;
+    } else if (safe_str_eq(op, "gt")) {
+        return rule_op_gt;
+    } else if (safe_str_eq(op, "gte")) {
+        return rule_op_gte;
+    }
+    return rule_op_unknown;
+}
 
-    for (rule = __xml_first_child(ruleset); rule != NULL; rule = __xml_next(rule)) {
-        if (crm_str_eq((const char *)rule->name, XML_TAG_RULE, TRUE)) {
-            ruleset_default = FALSE;
-            if (test_rule(rule, node_hash, RSC_ROLE_UNKNOWN, now)) {
-                return TRUE;
-            }
-        }
+static enum date_op
+text2date_op(const char *op)
+{
+    if (op == NULL || safe_str_eq(op, "in_range")) {
+        return date_op_in_range;
+    } else if (safe_str_eq(op, "date_spec")) {
+        return date_op_date_spec;
+    } else if (safe_str_eq(op, "gt")) {
+        return date_op_gt;
+    } else if (safe_str_eq(op, "lt")) {
+        return date_op_lt;
+    } else if (safe_str_eq(op, "eq")) {
+        return date_op_eq;
+    } else if (safe_str_eq(op, "neq")) {
+        return date_op_neq;
     }
+    return date_op_unknown;
+}
 
-    return ruleset_default;
+static gboolean
+rules_cache_usable(xmlNode * xml)
+{
+    return rules_cache_doc != NULL && xml != NULL && xml->doc == rules_cache_doc;
 }
 
-gboolean
-test_rule(xmlNode * rule, GHashTable * node_hash, enum rsc_role_e role, ha_time_t * now)
+void
+pe_rules_cache_flush(void)
 {
-    xmlNode *expr = NULL;
-    gboolean test = TRUE;
-    gboolean empty = TRUE;
-    gboolean passed = TRUE;
-    gboolean do_and = TRUE;
+    if (rules_cache_doc == NULL) {
+        return;
+    }
+
+    crm_trace("Discarding %u compiled rules and %u attribute sets",
+              g_hash_table_size(rule_cache), g_hash_table_size(set_cache));
+
+    /* The lists in attrs_cache only reference the sets */
+    g_hash_table_destroy(attrs_cache);
+    g_hash_table_destroy(set_cache);
+    g_hash_table_destroy(rule_cache);
+    attrs_cache = NULL;
+    set_cache = NULL;
+    rule_cache = NULL;
+    rules_cache_doc = NULL;
+}
+
+static ha_time_t *
+compile_date(xmlNode * time_expr, const char *field)
+{
+    ha_time_t *result = NULL;
+    const char *value = crm_element_value(time_expr, field);
+
+    if (value != NULL) {
+        char *value_copy = crm_strdup(value);
+        char *value_copy_start = value_copy;
+
+        result = parse_date(&value_copy);
+        crm_free(value_copy_start);
+    }
+    return result;
+}
+
+#define update_field(xml_field, time_fn)			\
+    value = crm_element_value(duration_spec, xml_field);	\
+    if(value != NULL) {						\
+	int value_i = crm_parse_int(value, "0");		\
+	time_fn(end, value_i);					\
+    }
+
+static ha_time_t *
+parse_xml_duration(ha_time_t * start, xmlNode * duration_spec)
+{
+    ha_time_t *end = NULL;
     const char *value = NULL;
 
-    rule = expand_idref(rule, NULL);
-    value = crm_element_value(rule, XML_RULE_ATTR_BOOLEAN_OP);
-    if (safe_str_eq(value, "or")) {
-        do_and = FALSE;
-        passed = FALSE;
+    end = new_ha_date(FALSE);
+    ha_set_time(end, start, TRUE);
+
+    update_field("years", add_years);
+    update_field("months", add_months);
+    update_field("weeks", add_weeks);
+    update_field("days", add_days);
+    update_field("hours", add_hours);
+    update_field("minutes", add_minutes);
+    update_field("seconds", add_seconds);
+
+    return end;
+}
+
+static void
+compile_date_spec(compiled_expr_t * compiled, xmlNode * date_spec)
+{
+    int lpc = 0;
+
+    if (date_spec == NULL) {
+        return;
     }
 
-    crm_trace("Testing rule %s", ID(rule));
-    for (expr = __xml_first_child(rule); expr != NULL; expr = __xml_next(expr)) {
-        test = test_expression(expr, node_hash, role, now);
-        empty = FALSE;
+    for (lpc = 0; lpc < cron_max; lpc++) {
+        char *value_low = NULL;
+        char *value_high = NULL;
+        const char *value = crm_element_value(date_spec, cron_field_names[lpc]);
 
-        if (test && do_and == FALSE) {
-            crm_trace("Expression %s/%s passed", ID(rule), ID(expr));
-            return TRUE;
+        if (value == NULL) {
+            continue;
+        }
 
-        } else if (test == FALSE && do_and) {
-            crm_trace("Expression %s/%s failed", ID(rule), ID(expr));
-            return FALSE;
+        decodeNVpair(value, '-', &value_low, &value_high);
+        if (value_low == NULL) {
+            value_low = crm_strdup(value);
         }
-    }
 
-    if (empty) {
-        crm_err("Invalid Rule %s: rules must contain at least one expression", ID(rule));
-    }
+        compiled->cron_set |= (1 << lpc);
+        compiled->cron_low[lpc] = crm_parse_int(value_low, "0");
+        compiled->cron_high[lpc] = crm_parse_int(value_high, "-1");
 
-    crm_trace("Rule %s %s", ID(rule), passed ? "passed" : "failed");
-    return passed;
+        crm_free(value_low);
+        crm_free(value_high);
+    }
 }
 
-gboolean
-test_expression(xmlNode * expr, GHashTable * node_hash, enum rsc_role_e role, ha_time_t * now)
+static compiled_expr_t *
+compile_expression(xmlNode * expr)
 {
-    gboolean accept = FALSE;
-    const char *uname = NULL;
+    const char *type = NULL;
+    compiled_expr_t *compiled = NULL;
 
-    switch (find_expression_type(expr)) {
+    crm_malloc0(compiled, sizeof(compiled_expr_t));
+    compiled->id = crm_strdup(ID(expr));
+    compiled->type = find_expression_type(expr);
+
+    switch (compiled->type) {
         case nested_rule:
-            accept = test_rule(expr, node_hash, role, now);
+            compiled->rule = compile_rule(expr);
             break;
+
         case attr_expr:
         case loc_expr:
-            /* these expressions can never succeed if there is
-             * no node to compare with
-             */
-            if (node_hash != NULL) {
-                accept = test_attr_expression(expr, node_hash, now);
+        case role_expr:
+            compiled->attr = g_intern_string(crm_element_value(expr, XML_EXPR_ATTR_ATTRIBUTE));
+            compiled->op_text = g_intern_string(crm_element_value(expr, XML_EXPR_ATTR_OPERATION));
+            compiled->op = text2rule_op(compiled->op_text);
+            compiled->value = crm_element_value_copy(expr, XML_EXPR_ATTR_VALUE);
+
+            if (compiled->type == role_expr) {
+                compiled->value_role = text2role(compiled->value);
+                break;
+            }
+
+            type = crm_element_value(expr, XML_EXPR_ATTR_TYPE);
+            if (type == NULL) {
+                switch (compiled->op) {
+                    case rule_op_lt:
+                    case rule_op_lte:
+                    case rule_op_gt:
+                    case rule_op_gte:
+                        type = "number";
+                        break;
+                    default:
+                        type = "string";
+                        break;
+                }
+                crm_trace("Defaulting to %s based comparison for '%s' op",
+                          type, crm_str(compiled->op_text));
+            }
+
+            if (safe_str_eq(type, "string")) {
+                compiled->cmp = rule_cmp_string;
+
+            } else if (safe_str_eq(type, "number")) {
+                compiled->cmp = rule_cmp_number;
+                compiled->value_i = crm_parse_int(compiled->value, NULL);
+
+            } else if (safe_str_eq(type, "version")) {
+                compiled->cmp = rule_cmp_version;
             }
             break;
 
         case time_expr:
-            accept = test_date_expression(expr, now);
-            break;
+            compiled->date_op = text2date_op(crm_element_value(expr, "operation"));
+            compiled->start = compile_date(expr, "start");
+            compiled->end = compile_date(expr, "end");
 
-        case role_expr:
-            accept = test_role_expression(expr, role, now);
+            if (compiled->start != NULL && compiled->end == NULL) {
+                xmlNode *duration_spec = first_named_child(expr, "duration");
+
+                if (duration_spec != NULL) {
+                    compiled->end = parse_xml_duration(compiled->start, duration_spec);
+                }
+            }
+            compile_date_spec(compiled, first_named_child(expr, "date_spec"));
             break;
 
         default:
-            CRM_CHECK(FALSE /* bad type */ , return FALSE);
-            accept = FALSE;
+            break;
     }
-    if (node_hash) {
-        uname = g_hash_table_lookup(node_hash, "#uname");
+
+    return compiled;
+}
+
+static void
+free_compiled_expression(gpointer data)
+{
+    compiled_expr_t *compiled = data;
+
+    if (compiled->rule) {
+        free_compiled_rule(compiled->rule);
     }
+    free_ha_date(compiled->start);
+    free_ha_date(compiled->end);
+    crm_free(compiled->value);
+    crm_free(compiled->id);
+    crm_free(compiled);
+}
 
-    crm_trace("Expression %s %s on %s",
-              ID(expr), accept ? "passed" : "failed", uname ? uname : "all ndoes");
-    return accept;
+static compiled_rule_t *
+compile_rule(xmlNode * rule)
+{
+    xmlNode *expr = NULL;
+    compiled_rule_t *compiled = NULL;
+
+    rule = expand_idref(rule, NULL);
+
+    crm_malloc0(compiled, sizeof(compiled_rule_t));
+    compiled->id = crm_strdup(ID(rule));
+    compiled->do_and = TRUE;
+    if (safe_str_eq(crm_element_value(rule, XML_RULE_ATTR_BOOLEAN_OP), "or")) {
+        compiled->do_and = FALSE;
+    }
+
+    for (expr = __xml_first_child(rule); expr != NULL; expr = __xml_next(expr)) {
+        compiled->expressions = g_list_prepend(compiled->expressions, compile_expression(expr));
+    }
+    compiled->expressions = g_list_reverse(compiled->expressions);
+    return compiled;
+}
+
+static void
+free_compiled_rule(gpointer data)
+{
+    compiled_rule_t *compiled = data;
+
+    GListPtr gIter = NULL;
+
+    for (gIter = compiled->expressions; gIter != NULL; gIter = gIter->next) {
+        free_compiled_expression(gIter->data);
+    }
+    g_list_free(compiled->expressions);
+    crm_free(compiled->id);
+    crm_free(compiled);
+}
+
+static void
+release_rule(compiled_rule_t * compiled)
+{
+    if (compiled->cached == FALSE) {
+        free_compiled_rule(compiled);
+    }
+}
+
+static compiled_rule_t *
+get_compiled_rule(xmlNode * rule)
+{
+    compiled_rule_t *compiled = NULL;
+
+    if (rules_cache_usable(rule) == FALSE) {
+        return compile_rule(rule);
+    }
+
+    compiled = g_hash_table_lookup(rule_cache, rule);
+    if (compiled == NULL) {
+        compiled = compile_rule(rule);
+        compiled->cached = TRUE;
+        g_hash_table_insert(rule_cache, rule, compiled);
+    }
+    return compiled;
+}
+
+static compiled_set_t *
+compile_set(xmlNode * set)
+{
+    xmlNode *child = NULL;
+    xmlNode *list = set;
+    compiled_set_t *compiled = NULL;
+
+    crm_malloc0(compiled, sizeof(compiled_set_t));
+    compiled->id = crm_strdup(ID(set));
+    compiled->score = char2score(crm_element_value(set, XML_RULE_ATTR_SCORE));
+
+    for (child = __xml_first_child(set); child != NULL; child = __xml_next(child)) {
+        if (crm_str_eq((const char *)child->name, XML_TAG_RULE, TRUE)) {
+            compiled->have_rules = TRUE;
+            compiled->rules = g_list_prepend(compiled->rules, compile_rule(child));
+        }
+    }
+    compiled->rules = g_list_reverse(compiled->rules);
+
+    if (safe_str_eq(XML_TAG_ATTRS, crm_element_name(set->children))) {
+        list = set->children;
+    }
+
+    for (child = __xml_first_child(list); child != NULL; child = __xml_next(child)) {
+        if (crm_str_eq((const char *)child->name, XML_CIB_TAG_NVPAIR, TRUE)) {
+            compiled_nvpair_t *nvpair = NULL;
+            const char *name = crm_element_value(child, XML_NVPAIR_ATTR_NAME);
+            const char *value = crm_element_value(child, XML_NVPAIR_ATTR_VALUE);
+
+            if (name == NULL || value == NULL) {
+                continue;
+            }
+
+            crm_malloc0(nvpair, sizeof(compiled_nvpair_t));
+            nvpair->name = g_intern_string(name);
+            nvpair->value = crm_strdup(value);
+            compiled->nvpairs = g_list_prepend(compiled->nvpairs, nvpair);
+        }
+    }
+    compiled->nvpairs = g_list_reverse(compiled->nvpairs);
+    return compiled;
+}
+
+static void
+free_compiled_nvpair(gpointer data)
+{
+    compiled_nvpair_t *nvpair = data;
+
+    crm_free(nvpair->value);
+    crm_free(nvpair);
+}
+
+static void
+free_compiled_set(gpointer data)
+{
+    compiled_set_t *compiled = data;
+
+    GListPtr gIter = NULL;
+
+    for (gIter = compiled->rules; gIter != NULL; gIter = gIter->next) {
+        free_compiled_rule(gIter->data);
+    }
+    for (gIter = compiled->nvpairs; gIter != NULL; gIter = gIter->next) {
+        free_compiled_nvpair(gIter->data);
+    }
+    g_list_free(compiled->rules);
+    g_list_free(compiled->nvpairs);
+    crm_free(compiled->id);
+    crm_free(compiled);
+}
+
+static void
+release_set(gpointer data)
+{
+    compiled_set_t *compiled = data;
+
+    if (compiled->cached == FALSE) {
+        free_compiled_set(compiled);
+    }
+}
+
+static compiled_set_t *
+get_compiled_set(xmlNode * set)
+{
+    compiled_set_t *compiled = NULL;
+
+    if (rules_cache_usable(set) == FALSE) {
+        return compile_set(set);
+    }
+
+    compiled = g_hash_table_lookup(set_cache, set);
+    if (compiled == NULL) {
+        compiled = compile_set(set);
+        compiled->cached = TRUE;
+        g_hash_table_insert(set_cache, set, compiled);
+    }
+    return compiled;
+}
+
+void
+pe_rules_cache_enable(xmlNode * input)
+{
+    pe_rules_cache_flush();
+    if (input == NULL || input->doc == NULL) {
+        return;
+    }
+
+    rules_cache_doc = input->doc;
+    rule_cache = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_compiled_rule);
+    set_cache = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_compiled_set);
+    attrs_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, g_hash_destroy_str,
+                                        (GDestroyNotify) g_list_free);
 }
 
 enum expression_type
@@ -161,106 +619,95 @@ find_expression_type(xmlNode * expr)
     return attr_expr;
 }
 
-gboolean
-test_role_expression(xmlNode * expr, enum rsc_role_e role, ha_time_t * now)
+static gboolean
+eval_role_expression(compiled_expr_t * expr, enum rsc_role_e role)
 {
     gboolean accept = FALSE;
-    const char *op = NULL;
-    const char *value = NULL;
 
     if (role == RSC_ROLE_UNKNOWN) {
         return accept;
     }
 
-    value = crm_element_value(expr, XML_EXPR_ATTR_VALUE);
-    op = crm_element_value(expr, XML_EXPR_ATTR_OPERATION);
+    switch (expr->op) {
+        case rule_op_defined:
+            if (role > RSC_ROLE_STARTED) {
+                accept = TRUE;
+            }
+            break;
 
-    if (safe_str_eq(op, "defined")) {
-        if (role > RSC_ROLE_STARTED) {
-            accept = TRUE;
-        }
+        case rule_op_not_defined:
+            if (role < RSC_ROLE_SLAVE && role > RSC_ROLE_UNKNOWN) {
+                accept = TRUE;
+            }
+            break;
 
-    } else if (safe_str_eq(op, "not_defined")) {
-        if (role < RSC_ROLE_SLAVE && role > RSC_ROLE_UNKNOWN) {
-            accept = TRUE;
-        }
+        case rule_op_eq:
+            if (expr->value_role == role) {
+                accept = TRUE;
+            }
+            break;
 
-    } else if (safe_str_eq(op, "eq")) {
-        if (text2role(value) == role) {
-            accept = TRUE;
-        }
+        case rule_op_ne:
+            /* we will only test "ne" wtih master/slave roles style */
+            if (role < RSC_ROLE_SLAVE && role > RSC_ROLE_UNKNOWN) {
+                accept = FALSE;
 
-    } else if (safe_str_eq(op, "ne")) {
-        /* we will only test "ne" wtih master/slave roles style */
-        if (role < RSC_ROLE_SLAVE && role > RSC_ROLE_UNKNOWN) {
-            accept = FALSE;
+            } else if (expr->value_role != role) {
+                accept = TRUE;
+            }
+            break;
 
-        } else if (text2role(value) != role) {
-            accept = TRUE;
-        }
+        default:
+            break;
     }
     return accept;
 }
 
-gboolean
-test_attr_expression(xmlNode * expr, GHashTable * hash, ha_time_t * now)
+static gboolean
+eval_attr_expression(compiled_expr_t * expr, GHashTable * hash)
 {
     gboolean accept = FALSE;
     int cmp = 0;
     const char *h_val = NULL;
+    const char *value = expr->value;
 
-    const char *op = NULL;
-    const char *type = NULL;
-    const char *attr = NULL;
-    const char *value = NULL;
-
-    attr = crm_element_value(expr, XML_EXPR_ATTR_ATTRIBUTE);
-    op = crm_element_value(expr, XML_EXPR_ATTR_OPERATION);
-    value = crm_element_value(expr, XML_EXPR_ATTR_VALUE);
-    type = crm_element_value(expr, XML_EXPR_ATTR_TYPE);
-
-    if (attr == NULL || op == NULL) {
+    if (expr->attr == NULL || expr->op_text == NULL) {
         pe_err("Invlaid attribute or operation in expression"
-               " (\'%s\' \'%s\' \'%s\')", crm_str(attr), crm_str(op), crm_str(value));
+               " (\'%s\' \'%s\' \'%s\')", crm_str(expr->attr), crm_str(expr->op_text),
+               crm_str(value));
         return FALSE;
     }
 
     if (hash != NULL) {
-        h_val = (const char *)g_hash_table_lookup(hash, attr);
+        h_val = (const char *)g_hash_table_lookup(hash, expr->attr);
     }
 
     if (value != NULL && h_val != NULL) {
-        if (type == NULL) {
-            if (safe_str_eq(op, "lt")
-                || safe_str_eq(op, "lte")
-                || safe_str_eq(op, "gt")
-                || safe_str_eq(op, "gte")) {
-                type = "number";
-
-            } else {
-                type = "string";
-            }
-            crm_trace("Defaulting to %s based comparison for '%s' op", type, op);
-        }
-
-        if (safe_str_eq(type, "string")) {
-            cmp = strcasecmp(h_val, value);
-
-        } else if (safe_str_eq(type, "number")) {
-            int h_val_f = crm_parse_int(h_val, NULL);
-            int value_f = crm_parse_int(value, NULL);
-
-            if (h_val_f < value_f) {
-                cmp = -1;
-            } else if (h_val_f > value_f) {
-                cmp = 1;
-            } else {
-                cmp = 0;
-            }
+        switch (expr->cmp) {
+            case rule_cmp_string:
+                cmp = strcasecmp(h_val, value);
+                break;
+
+            case rule_cmp_number:
+                {
+                    int h_val_f = crm_parse_int(h_val, NULL);
+
+                    if (h_val_f < expr->value_i) {
+                        cmp = -1;
+                    } else if (h_val_f > expr->value_i) {
+                        cmp = 1;
+                    } else {
+                        cmp = 0;
+                    }
+                }
+                break;
 
-        } else if (safe_str_eq(type, "version")) {
-            cmp = compare_version(h_val, value);
+            case rule_cmp_version:
+                cmp = compare_version(h_val, value);
+                break;
 
+            case rule_cmp_none:
+                break;
         }
 
     } else if (value == NULL && h_val == NULL) {
@@ -271,252 +718,267 @@ test_attr_expression(xmlNode * expr, GHashTable * hash, ha_time_t * now)
         cmp = -1;
     }
 
-    if (safe_str_eq(op, "defined")) {
-        if (h_val != NULL) {
-            accept = TRUE;
-        }
+    switch (expr->op) {
+        case rule_op_defined:
+            accept = (h_val != NULL);
+            break;
 
-    } else if (safe_str_eq(op, "not_defined")) {
-        if (h_val == NULL) {
-            accept = TRUE;
-        }
+        case rule_op_not_defined:
+            accept = (h_val == NULL);
+            break;
 
-    } else if (safe_str_eq(op, "eq")) {
-        if ((h_val == value) || cmp == 0) {
-            accept = TRUE;
-        }
+        case rule_op_eq:
+            accept = ((h_val == value) || cmp == 0);
+            break;
 
-    } else if (safe_str_eq(op, "ne")) {
-        if ((h_val == NULL && value != NULL)
-            || (h_val != NULL && value == NULL)
-            || cmp != 0) {
-            accept = TRUE;
-        }
+        case rule_op_ne:
+            accept = ((h_val == NULL && value != NULL)
+                      || (h_val != NULL && value == NULL)
+                      || cmp != 0);
+            break;
 
-    } else if (value == NULL || h_val == NULL) {
-        /* the comparision is meaningless from this point on */
-        accept = FALSE;
+        default:
+            if (value == NULL || h_val == NULL) {
+                /* the comparision is meaningless from this point on */
+                accept = FALSE;
 
-    } else if (safe_str_eq(op, "lt")) {
-        if (cmp < 0) {
-            accept = TRUE;
-        }
+            } else if (expr->op == rule_op_lt) {
+                accept = (cmp < 0);
 
-    } else if (safe_str_eq(op, "lte")) {
-        if (cmp <= 0) {
-            accept = TRUE;
-        }
+            } else if (expr->op == rule_op_lte) {
+                accept = (cmp <= 0);
 
-    } else if (safe_str_eq(op, "gt")) {
-        if (cmp > 0) {
-            accept = TRUE;
-        }
+            } else if (expr->op == rule_op_gt) {
+                accept = (cmp > 0);
 
-    } else if (safe_str_eq(op, "gte")) {
-        if (cmp >= 0) {
-            accept = TRUE;
-        }
+            } else if (expr->op == rule_op_gte) {
+                accept = (cmp >= 0);
+            }
+            break;
     }
 
     return accept;
 }
 
-/* As per the nethack rules:
- *
- * moon period = 29.53058 days ~= 30, year = 365.2422 days
- * days moon phase advances on first day of year compared to preceding year
- *      = 365.2422 - 12*29.53058 ~= 11
- * years in Metonic cycle (time until same phases fall on the same days of
- *      the month) = 18.6 ~= 19
- * moon phase on first day of year (epact) ~= (11*(year%19) + 29) % 30
- *      (29 as initial condition)
- * current phase in days = first day phase + days elapsed in year
- * 6 moons ~= 177 days
- * 177 ~= 8 reported phases * 22
- * + 11/22 for rounding
- *
- * 0-7, with 0: new, 4: full
- */
-
-static int
-phase_of_the_moon(ha_time_t * now)
+static gboolean
+cron_range_satisfied(compiled_expr_t * expr, ha_time_t * now)
 {
-    int epact, diy, goldn;
-
-    diy = now->yeardays;
-    goldn = (now->years % 19) + 1;
-    epact = (11 * goldn + 18) % 30;
-    if ((epact == 25 && goldn > 11) || epact == 24)
-        epact++;
+    int lpc = 0;
 
-    return ((((((diy + epact) * 6) + 11) % 177) / 22) & 7);
-}
+    CRM_CHECK(now != NULL, return FALSE);
 
-#define cron_check(xml_field, time_field)				\
-    value = crm_element_value(cron_spec, xml_field);			\
-    if(value != NULL) {							\
-	gboolean pass = TRUE;						\
-	decodeNVpair(value, '-', &value_low, &value_high);		\
-	if(value_low == NULL) {						\
-	    value_low = crm_strdup(value);				\
-	}								\
-	value_low_i = crm_parse_int(value_low, "0");			\
-	value_high_i = crm_parse_int(value_high, "-1");			\
-	if(value_high_i < 0) {						\
-	    if(value_low_i != time_field) {				\
-		pass = FALSE;						\
-	    }								\
-	} else if(value_low_i > time_field) {				\
-	    pass = FALSE;						\
-	} else if(value_high_i < time_field) {				\
-	    pass = FALSE;						\
-	}								\
-	crm_free(value_low);						\
-	crm_free(value_high);						\
-	if(pass == FALSE) {						\
-	    crm_debug("Condition '%s' in %s: failed", value, xml_field); \
-	    return pass;						\
-	}								\
-	crm_debug("Condition '%s' in %s: passed", value, xml_field);	\
-    }
+    for (lpc = 0; lpc < cron_max; lpc++) {
+        int time_field = 0;
+        gboolean pass = TRUE;
 
-gboolean
-cron_range_satisfied(ha_time_t * now, xmlNode * cron_spec)
-{
-    const char *value = NULL;
-    char *value_low = NULL;
-    char *value_high = NULL;
+        if ((expr->cron_set & (1 << lpc)) == 0) {
+            continue;
+        }
 
-    int value_low_i = 0;
-    int value_high_i = 0;
+        switch (lpc) {
+            case cron_seconds:   time_field = now->seconds; break;
+            case cron_minutes:   time_field = now->minutes; break;
+            case cron_hours:     time_field = now->hours; break;
+            case cron_monthdays: time_field = now->days; break;
+            case cron_weekdays:  time_field = now->weekdays; break;
+            case cron_yeardays:  time_field = now->yeardays; break;
+            case cron_weeks:     time_field = now->weeks; break;
+            case cron_months:    time_field = now->months; break;
+            case cron_years:     time_field = now->years; break;
+            case cron_weekyears: time_field = now->weekyears; break;
+            case cron_moon:      time_field = phase_of_the_moon(now); break;
+        }
 
-    CRM_CHECK(now != NULL, return FALSE);
+        if (expr->cron_high[lpc] < 0) {
+            if (expr->cron_low[lpc] != time_field) {
+                pass = FALSE;
+            }
+        } else if (expr->cron_low[lpc] > time_field) {
+            pass = FALSE;
+        } else if (expr->cron_high[lpc] < time_field) {
+            pass = FALSE;
+        }
 
-    cron_check("seconds", now->seconds);
-    cron_check("minutes", now->minutes);
-    cron_check("hours", now->hours);
-    cron_check("monthdays", now->days);
-    cron_check("weekdays", now->weekdays);
-    cron_check("yeardays", now->yeardays);
-    cron_check("weeks", now->weeks);
-    cron_check("months", now->months);
-    cron_check("years", now->years);
-    cron_check("weekyears", now->weekyears);
-    cron_check("moon", phase_of_the_moon(now));
+        crm_debug("Condition '%d-%d' in %s: %s", expr->cron_low[lpc], expr->cron_high[lpc],
+                  cron_field_names[lpc], pass ? "passed" : "failed");
+        if (pass == FALSE) {
+            return FALSE;
+        }
+    }
 
     return TRUE;
 }
 
-#define update_field(xml_field, time_fn)			\
-    value = crm_element_value(duration_spec, xml_field);	\
-    if(value != NULL) {						\
-	int value_i = crm_parse_int(value, "0");		\
-	time_fn(end, value_i);					\
-    }
-
-ha_time_t *
-parse_xml_duration(ha_time_t * start, xmlNode * duration_spec)
+static gboolean
+eval_date_expression(compiled_expr_t * expr, ha_time_t * now)
 {
-    ha_time_t *end = NULL;
-    const char *value = NULL;
+    gboolean passed = FALSE;
 
-    end = new_ha_date(FALSE);
-    ha_set_time(end, start, TRUE);
+    crm_trace("Testing expression: %s", expr->id);
+
+    switch (expr->date_op) {
+        case date_op_in_range:
+        case date_op_date_spec:
+            if (expr->start != NULL && compare_date(expr->start, now) > 0) {
+                passed = FALSE;
+            } else if (expr->end != NULL && compare_date(expr->end, now) < 0) {
+                passed = FALSE;
+            } else if (expr->date_op == date_op_in_range) {
+                passed = TRUE;
+            } else {
+                passed = cron_range_satisfied(expr, now);
+            }
+            break;
 
-    update_field("years", add_years);
-    update_field("months", add_months);
-    update_field("weeks", add_weeks);
-    update_field("days", add_days);
-    update_field("hours", add_hours);
-    update_field("minutes", add_minutes);
-    update_field("seconds", add_seconds);
+        case date_op_gt:
+            passed = (compare_date(expr->start, now) < 0);
+            break;
 
-    return end;
+        case date_op_lt:
+            passed = (compare_date(expr->end, now) > 0);
+            break;
+
+        case date_op_eq:
+            passed = (compare_date(expr->start, now) == 0);
+            break;
+
+        case date_op_neq:
+            passed = (compare_date(expr->start, now) != 0);
+            break;
+
+        case date_op_unknown:
+            break;
+    }
+
+    return passed;
 }
 
-gboolean
-test_date_expression(xmlNode * time_expr, ha_time_t * now)
+static gboolean
+eval_expression(compiled_expr_t * expr, GHashTable * node_hash, enum rsc_role_e role,
+                ha_time_t * now)
 {
-    ha_time_t *start = NULL;
-    ha_time_t *end = NULL;
-    const char *value = NULL;
-    char *value_copy = NULL;
-    char *value_copy_start = NULL;
-    const char *op = crm_element_value(time_expr, "operation");
-
-    xmlNode *duration_spec = NULL;
-    xmlNode *date_spec = NULL;
+    gboolean accept = FALSE;
+    const char *uname = NULL;
 
-    gboolean passed = FALSE;
+    switch (expr->type) {
+        case nested_rule:
+            accept = eval_rule(expr->rule, node_hash, role, now);
+            break;
+        case attr_expr:
+        case loc_expr:
+            /* these expressions can never succeed if there is
+             * no node to compare with
+             */
+            if (node_hash != NULL) {
+                accept = eval_attr_expression(expr, node_hash);
+            }
+            break;
 
-    crm_trace("Testing expression: %s", ID(time_expr));
+        case time_expr:
+            accept = eval_date_expression(expr, now);
+            break;
 
-    duration_spec = first_named_child(time_expr, "duration");
-    date_spec = first_named_child(time_expr, "date_spec");
+        case role_expr:
+            accept = eval_role_expression(expr, role);
+            break;
 
-    value = crm_element_value(time_expr, "start");
-    if (value != NULL) {
-        value_copy = crm_strdup(value);
-        value_copy_start = value_copy;
-        start = parse_date(&value_copy);
-        crm_free(value_copy_start);
+        default:
+            CRM_CHECK(FALSE /* bad type */ , return FALSE);
+            accept = FALSE;
     }
-    value = crm_element_value(time_expr, "end");
-    if (value != NULL) {
-        value_copy = crm_strdup(value);
-        value_copy_start = value_copy;
-        end = parse_date(&value_copy);
-        crm_free(value_copy_start);
+    if (node_hash) {
+        uname = g_hash_table_lookup(node_hash, "#uname");
     }
 
-    if (start != NULL && end == NULL && duration_spec != NULL) {
-        end = parse_xml_duration(start, duration_spec);
+    crm_trace("Expression %s %s on %s",
+              expr->id, accept ? "passed" : "failed", uname ? uname : "all ndoes");
+    return accept;
+}
+
+static gboolean
+eval_rule(compiled_rule_t * rule, GHashTable * node_hash, enum rsc_role_e role, ha_time_t * now)
+{
+    GListPtr gIter = NULL;
+    gboolean passed = rule->do_and;
+
+    crm_trace("Testing rule %s", rule->id);
+    for (gIter = rule->expressions; gIter != NULL; gIter = gIter->next) {
+        compiled_expr_t *expr = gIter->data;
+        gboolean test = eval_expression(expr, node_hash, role, now);
+
+        if (test && rule->do_and == FALSE) {
+            crm_trace("Expression %s/%s passed", rule->id, expr->id);
+            return TRUE;
+
+        } else if (test == FALSE && rule->do_and) {
+            crm_trace("Expression %s/%s failed", rule->id, expr->id);
+            return FALSE;
+        }
     }
-    if (op == NULL) {
-        op = "in_range";
+
+    if (rule->expressions == NULL) {
+        crm_err("Invalid Rule %s: rules must contain at least one expression", rule->id);
     }
 
-    if (safe_str_eq(op, "date_spec") || safe_str_eq(op, "in_range")) {
-        if (start != NULL && compare_date(start, now) > 0) {
-            passed = FALSE;
-        } else if (end != NULL && compare_date(end, now) < 0) {
-            passed = FALSE;
-        } else if (safe_str_eq(op, "in_range")) {
-            passed = TRUE;
-        } else {
-            passed = cron_range_satisfied(now, date_spec);
-        }
+    crm_trace("Rule %s %s", rule->id, passed ? "passed" : "failed");
+    return passed;
+}
 
-    } else if (safe_str_eq(op, "gt") && compare_date(start, now) < 0) {
-        passed = TRUE;
+static gboolean
+eval_ruleset(compiled_set_t * set, GHashTable * node_hash, ha_time_t * now)
+{
+    GListPtr gIter = NULL;
 
-    } else if (safe_str_eq(op, "lt") && compare_date(end, now) > 0) {
-        passed = TRUE;
+    for (gIter = set->rules; gIter != NULL; gIter = gIter->next) {
+        if (eval_rule(gIter->data, node_hash, RSC_ROLE_UNKNOWN, now)) {
+            return TRUE;
+        }
+    }
+    return (set->have_rules == FALSE);
+}
 
-    } else if (safe_str_eq(op, "eq") && compare_date(start, now) == 0) {
-        passed = TRUE;
+gboolean
+test_ruleset(xmlNode * ruleset, GHashTable * node_hash, ha_time_t * now)
+{
+    compiled_set_t *compiled = NULL;
+    gboolean passed = TRUE;
 
-    } else if (safe_str_eq(op, "neq") && compare_date(start, now) != 0) {
-        passed = TRUE;
+    if (ruleset == NULL) {
+        return TRUE;
     }
 
-    free_ha_date(start);
-    free_ha_date(end);
+    compiled = get_compiled_set(ruleset);
+    passed = eval_ruleset(compiled, node_hash, now);
+    release_set(compiled);
     return passed;
 }
 
-typedef struct sorted_set_s {
-    int score;
-    const char *name;
-    const char *special_name;
-    xmlNode *attr_set;
-} sorted_set_t;
+gboolean
+test_rule(xmlNode * rule, GHashTable * node_hash, enum rsc_role_e role, ha_time_t * now)
+{
+    compiled_rule_t *compiled = get_compiled_rule(rule);
+    gboolean passed = eval_rule(compiled, node_hash, role, now);
+
+    release_rule(compiled);
+    return passed;
+}
+
+gboolean
+test_expression(xmlNode * expr, GHashTable * node_hash, enum rsc_role_e role, ha_time_t * now)
+{
+    compiled_expr_t *compiled = compile_expression(expr);
+    gboolean passed = eval_expression(compiled, node_hash, role, now);
+
+    free_compiled_expression(compiled);
+    return passed;
+}
 
 static gint
-sort_pairs(gconstpointer a, gconstpointer b)
+sort_sets(gconstpointer a, gconstpointer b, gpointer user_data)
 {
-    const sorted_set_t *pair_a = a;
-    const sorted_set_t *pair_b = b;
+    const compiled_set_t *set_a = a;
+    const compiled_set_t *set_b = b;
+    const char *special_name = user_data;
 
     if (a == NULL && b == NULL) {
         return 0;
@@ -526,86 +988,87 @@ sort_pairs(gconstpointer a, gconstpointer b)
         return -1;
     }
 
-    if (safe_str_eq(pair_a->name, pair_a->special_name)) {
+    if (safe_str_eq(set_a->id, special_name)) {
         return -1;
 
-    } else if (safe_str_eq(pair_b->name, pair_a->special_name)) {
+    } else if (safe_str_eq(set_b->id, special_name)) {
         return 1;
     }
 
-    if (pair_a->score < pair_b->score) {
+    if (set_a->score < set_b->score) {
         return 1;
-    } else if (pair_a->score > pair_b->score) {
+    } else if (set_a->score > set_b->score) {
         return -1;
     }
     return 0;
 }
 
 static void
-populate_hash(xmlNode * nvpair_list, GHashTable * hash, gboolean overwrite)
+populate_hash(compiled_set_t * set, GHashTable * hash, gboolean overwrite)
 {
-    const char *name = NULL;
-    const char *value = NULL;
-    const char *old_value = NULL;
-    xmlNode *list = nvpair_list;
-    xmlNode *an_attr = NULL;
-
-    name = crm_element_name(list->children);
-    if (safe_str_eq(XML_TAG_ATTRS, name)) {
-        list = list->children;
-    }
-
-    for (an_attr = __xml_first_child(list); an_attr != NULL; an_attr = __xml_next(an_attr)) {
-        if (crm_str_eq((const char *)an_attr->name, XML_CIB_TAG_NVPAIR, TRUE)) {
-            name = crm_element_value(an_attr, XML_NVPAIR_ATTR_NAME);
+    GListPtr gIter = NULL;
 
-            crm_trace("Setting attribute: %s", name);
-            value = crm_element_value(an_attr, XML_NVPAIR_ATTR_VALUE);
+    for (gIter = set->nvpairs; gIter != NULL; gIter = gIter->next) {
+        compiled_nvpair_t *nvpair = gIter->data;
+        const char *old_value = g_hash_table_lookup(hash, nvpair->name);
 
-            if (name == NULL || value == NULL) {
-                continue;
+        crm_trace("Setting attribute: %s", nvpair->name);
 
+        if (safe_str_eq(nvpair->value, "#default")) {
+            if (old_value) {
+                crm_trace("Removing value for %s (%s)", nvpair->name, nvpair->value);
+                g_hash_table_remove(hash, nvpair->name);
             }
+            continue;
 
-            old_value = g_hash_table_lookup(hash, name);
+        } else if (old_value == NULL) {
+            g_hash_table_insert(hash, crm_strdup(nvpair->name), crm_strdup(nvpair->value));
 
-            if (safe_str_eq(value, "#default")) {
-                if (old_value) {
-                    crm_trace("Removing value for %s (%s)", name, value);
-                    g_hash_table_remove(hash, name);
-                }
-                continue;
-
-            } else if (old_value == NULL) {
-                g_hash_table_insert(hash, crm_strdup(name), crm_strdup(value));
-
-            } else if (overwrite) {
-                crm_debug("Overwriting value of %s: %s -> %s", name, old_value, value);
-                g_hash_table_replace(hash, crm_strdup(name), crm_strdup(value));
-            }
+        } else if (overwrite) {
+            crm_debug("Overwriting value of %s: %s -> %s", nvpair->name, old_value, nvpair->value);
+            g_hash_table_replace(hash, crm_strdup(nvpair->name), crm_strdup(nvpair->value));
         }
     }
 }
 
-struct unpack_data_s {
-    gboolean overwrite;
-    GHashTable *node_hash;
-    GHashTable *hash;
-    ha_time_t *now;
-};
+static char *
+attrs_cache_key(xmlNode * top, xmlNode * xml_obj, const char *set_name, const char *always_first)
+{
+    int len = 64 + (set_name ? strlen(set_name) : 0) + (always_first ? strlen(always_first) : 0);
+    char *key = NULL;
 
-static void
-unpack_attr_set(gpointer data, gpointer user_data)
+    crm_malloc0(key, len);
+    snprintf(key, len, "%p %p %s %s", top, xml_obj, crm_str(set_name), crm_str(always_first));
+    return key;
+}
+
+/* The sets in xml_obj in the order they should be applied */
+static GListPtr
+compile_attr_sets(xmlNode * top, xmlNode * xml_obj, const char *set_name,
+                  const char *always_first, gboolean * cacheable)
 {
-    sorted_set_t *pair = data;
-    struct unpack_data_s *unpack_data = user_data;
+    GListPtr sets = NULL;
+    xmlNode *attr_set = NULL;
 
-    if (test_ruleset(pair->attr_set, unpack_data->node_hash, unpack_data->now) == FALSE) {
-        return;
+    for (attr_set = __xml_first_child(xml_obj); attr_set != NULL; attr_set = __xml_next(attr_set)) {
+        /* Uncertain if set_name == NULL check is strictly necessary here */
+        if (set_name == NULL || crm_str_eq((const char *)attr_set->name, set_name, TRUE)) {
+            compiled_set_t *set = NULL;
+
+            attr_set = expand_idref(attr_set, top);
+            if (attr_set == NULL) {
+                continue;
+            }
+
+            set = get_compiled_set(attr_set);
+            if (set->cached == FALSE) {
+                *cacheable = FALSE;
+            }
+            sets = g_list_prepend(sets, set);
+        }
     }
 
-    crm_trace("Adding attributes from %s", pair->name);
-    populate_hash(pair->attr_set, unpack_data->hash, unpack_data->overwrite);
+    return g_list_sort_with_data(sets, sort_sets, (gpointer) always_first);
 }
 
 void
@@ -613,12 +1076,10 @@ unpack_instance_attributes(xmlNode * top, xmlNode * xml_obj, const char *set_nam
                            GHashTable * node_hash, GHashTable * hash, const char *always_first,
                            gboolean overwrite, ha_time_t * now)
 {
-    GListPtr sorted = NULL;
-    GListPtr unsorted = NULL;
-    const char *score = NULL;
-    sorted_set_t *pair = NULL;
-    struct unpack_data_s data;
-    xmlNode *attr_set = NULL;
+    char *key = NULL;
+    GListPtr sets = NULL;
+    GListPtr gIter = NULL;
+    gboolean cacheable = rules_cache_usable(xml_obj);
 
     if (xml_obj == NULL) {
         crm_trace("No instance attributes");
@@ -626,35 +1087,36 @@ unpack_instance_attributes(xmlNode * top, xmlNode * xml_obj, const char *set_nam
     }
 
     crm_trace("Checking for attributes");
-    for (attr_set = __xml_first_child(xml_obj); attr_set != NULL; attr_set = __xml_next(attr_set)) {
-        /* Uncertain if set_name == NULL check is strictly necessary here */
-        if (set_name == NULL || crm_str_eq((const char *)attr_set->name, set_name, TRUE)) {
-            pair = NULL;
-            attr_set = expand_idref(attr_set, top);
-            if (attr_set == NULL) {
-                continue;
-            }
+    if (cacheable) {
+        key = attrs_cache_key(top, xml_obj, set_name, always_first);
+        sets = g_hash_table_lookup(attrs_cache, key);
+    }
 
-            crm_malloc0(pair, sizeof(sorted_set_t));
-            pair->name = ID(attr_set);
-            pair->special_name = always_first;
-            pair->attr_set = attr_set;
+    if (sets == NULL) {
+        sets = compile_attr_sets(top, xml_obj, set_name, always_first, &cacheable);
+        if (cacheable && sets != NULL) {
+            g_hash_table_insert(attrs_cache, key, sets);
+            key = NULL;
+        }
+    }
+    crm_free(key);
 
-            score = crm_element_value(attr_set, XML_RULE_ATTR_SCORE);
-            pair->score = char2score(score);
+    for (gIter = sets; gIter != NULL; gIter = gIter->next) {
+        compiled_set_t *set = gIter->data;
 
-            unsorted = g_list_prepend(unsorted, pair);
+        if (eval_ruleset(set, node_hash, now) == FALSE) {
+            continue;
         }
-    }
 
-    if (pair != NULL) {
-        data.hash = hash;
-        data.node_hash = node_hash;
-        data.now = now;
-        data.overwrite = overwrite;
+        crm_trace("Adding attributes from %s", set->id);
+        populate_hash(set, hash, overwrite);
     }
 
-    sorted = g_list_sort(unsorted, sort_pairs);
-    g_list_foreach(sorted, unpack_attr_set, &data);
-    slist_basic_destroy(sorted);
+    if (cacheable == FALSE) {
+        /* Not kept in attrs_cache, so the list (and any uncached sets) are ours */
+        for (gIter = sets; gIter != NULL; gIter = gIter->next) {
+            release_set(gIter->data);
+        }
+        g_list_free(sets);
+    }
 }
@@ -28,6 +28,7 @@
 #include <glib.h>
 
 #include <crm/pengine/status.h>
+#include <crm/pengine/rules.h>
 #include <utils.h>
 #include <unpack.h>
 
@@ -40,6 +41,96 @@ extern xmlNode *get_object_root(const char *object_type, xmlNode * the_root);
 	crm_err("Exiting: stage %d", stage);				\
 	exit(1);
 
+/* Marks keys matched by more than one resource, pe_find_resource() has to scan for those */
+static int ambiguous_rsc_key = 0;
+
+static void
+index_node_key(GHashTable * index, const char *key, node_t * node)
+{
+    /* Keep the first match, like a scan of data_set->nodes would */
+    if (key != NULL && g_hash_table_lookup(index, key) == NULL) {
+        g_hash_table_insert(index, crm_strdup(key), node);
+    }
+}
+
+static void
+index_nodes(pe_working_set_t * data_set)
+{
+    GListPtr gIter = data_set->nodes;
+
+    data_set->node_index_id = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                    g_hash_destroy_str, NULL);
+    data_set->node_index_uname = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                       g_hash_destroy_str, NULL);
+
+    for (; gIter != NULL; gIter = gIter->next) {
+        node_t *node = (node_t *) gIter->data;
+
+        index_node_key(data_set->node_index_id, node->details->id, node);
+        index_node_key(data_set->node_index_uname, node->details->uname, node);
+    }
+}
+
+static void
+index_resource_key(GHashTable * index, const char *key, resource_t * rsc)
+{
+    gpointer existing = NULL;
+
+    if (key == NULL) {
+        return;
+    }
+
+    existing = g_hash_table_lookup(index, key);
+    if (existing == NULL) {
+        g_hash_table_insert(index, crm_strdup(key), rsc);
+
+    } else if (existing != rsc) {
+        g_hash_table_replace(index, crm_strdup(key), &ambiguous_rsc_key);
+    }
+}
+
+/*
+ * Add rsc and its children to the index, or just 'key' if it is not NULL
+ *
+ * Must be called for every resource created, and every clone_name set,
+ * after cluster_status() has built the index
+ */
+void
+pe_index_resource(resource_t * rsc, const char *key, pe_working_set_t * data_set)
+{
+    GListPtr gIter = NULL;
+    GHashTable *index = data_set ? data_set->resource_index : NULL;
+
+    if (index == NULL) {
+        return;
+
+    } else if (key != NULL) {
+        index_resource_key(index, key, rsc);
+        return;
+    }
+
+    index_resource_key(index, rsc->id, rsc);
+    index_resource_key(index, rsc->long_name, rsc);
+    index_resource_key(index, rsc->clone_name, rsc);
+
+    for (gIter = rsc->children; gIter != NULL; gIter = gIter->next) {
+        pe_index_resource(gIter->data, NULL, data_set);
+    }
+}
+
+static void
+index_resources(pe_working_set_t * data_set)
+{
+    GListPtr gIter = data_set->resources;
+
+    data_set->resource_index = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                     g_hash_destroy_str, NULL);
+
+    for (; gIter != NULL; gIter = gIter->next) {
+        pe_index_resource(gIter->data, NULL, data_set);
+    }
+}
+
 /*
  * Unpack everything
  * At the end you'll have:
@@ -71,6 +162,8 @@ cluster_status(pe_working_set_t * data_set)
         return FALSE;
     }
 
+    pe_rules_cache_enable(data_set->input);
+
     if (data_set->now == NULL) {
         data_set->now = new_ha_date(TRUE);
     }
@@ -96,8 +189,12 @@ cluster_status(pe_working_set_t * data_set)
     }
 
     unpack_nodes(cib_nodes, data_set);
+    index_nodes(data_set);
+
     unpack_domains(cib_domains, data_set);
     unpack_resources(cib_resources, data_set);
+    index_resources(data_set);
+
     unpack_status(cib_status, data_set);
 
     set_bit_inplace(data_set->flags, pe_flag_have_status);
@@ -177,6 +274,8 @@ cleanup_calculations(pe_working_set_t * data_set)
     }
 
     clear_bit_inplace(data_set->flags, pe_flag_have_status);
+    pe_rules_cache_flush();
+
     if (data_set->config_hash != NULL) {
         g_hash_table_destroy(data_set->config_hash);
     }
@@ -189,6 +288,22 @@ cleanup_calculations(pe_working_set_t * data_set)
         g_hash_table_destroy(data_set->template_rsc_sets);
     }
 
+    if (data_set->resource_index) {
+        g_hash_table_destroy(data_set->resource_index);
+    }
+
+    if (data_set->node_index_id) {
+        g_hash_table_destroy(data_set->node_index_id);
+    }
+
+    if (data_set->node_index_uname) {
+        g_hash_table_destroy(data_set->node_index_uname);
+    }
+
+    if (data_set->action_index) {
+        g_hash_table_destroy(data_set->action_index);
+    }
+
     crm_free(data_set->dc_uuid);
 
     crm_trace("deleting resources");
@@ -208,6 +323,7 @@ cleanup_calculations(pe_working_set_t * data_set)
     free_ha_date(data_set->now);
     free_xml(data_set->input);
     free_xml(data_set->failed);
+    pe_arena_free(data_set);
 
     set_working_set_defaults(data_set);
 
@@ -235,18 +351,37 @@ set_working_set_defaults(pe_working_set_t * data_set)
 resource_t *
 pe_find_resource(GListPtr rsc_list, const char *id)
 {
-    unsigned lpc = 0;
-    resource_t *rsc = NULL;
-    resource_t *match = NULL;
+    GListPtr gIter = rsc_list;
 
     if (id == NULL) {
         return NULL;
     }
 
-    for (lpc = 0; lpc < g_list_length(rsc_list); lpc++) {
-        rsc = g_list_nth_data(rsc_list, lpc);
+    if (pe_dataset && pe_dataset->resource_index && rsc_list == pe_dataset->resources) {
+        resource_t *rsc = g_hash_table_lookup(pe_dataset->resource_index, id);
+
+        if (rsc == NULL) {
+            crm_trace("No match for %s", id);
+            return NULL;
+
+        } else if ((gpointer) rsc != &ambiguous_rsc_key) {
+            if (safe_str_eq(rsc->id, id)
+                || safe_str_eq(rsc->long_name, id)
+                || safe_str_eq(rsc->clone_name, id)) {
+                return rsc;
+            }
+
+            /* Its clone_name has since been reset and nothing else ever matched */
+            crm_trace("No match for %s", id);
+            return NULL;
+        }
+        /* Only the order of rsc_list can decide which one wins */
+    }
+
+    for (; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        resource_t *match = rsc->fns->find_rsc(rsc, id, NULL, pe_find_renamed | pe_find_current);
 
-        match = rsc->fns->find_rsc(rsc, id, NULL, pe_find_renamed | pe_find_current);
         if (match != NULL) {
             return match;
         }
@@ -260,6 +395,10 @@ pe_find_node_id(GListPtr nodes, const char *id)
 {
     GListPtr gIter = nodes;
 
+    if (pe_dataset && pe_dataset->node_index_id && nodes == pe_dataset->nodes) {
+        return id ? g_hash_table_lookup(pe_dataset->node_index_id, id) : NULL;
+    }
+
     for (; gIter != NULL; gIter = gIter->next) {
         node_t *node = (node_t *) gIter->data;
 
@@ -276,6 +415,10 @@ pe_find_node(GListPtr nodes, const char *uname)
 {
     GListPtr gIter = nodes;
 
+    if (pe_dataset && pe_dataset->node_index_uname && nodes == pe_dataset->nodes) {
+        return uname ? g_hash_table_lookup(pe_dataset->node_index_uname, uname) : NULL;
+    }
+
     for (; gIter != NULL; gIter = gIter->next) {
         node_t *node = (node_t *) gIter->data;
 
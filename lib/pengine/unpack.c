@@ -46,6 +46,14 @@ CRM_TRACE_INIT_DATA(pe_status);
 gboolean unpack_rsc_op(resource_t * rsc, node_t * node, xmlNode * xml_op, GListPtr next,
                        enum action_fail_response *failed, pe_working_set_t * data_set);
 
+static int threads_override = 0;
+
+void
+pe_set_threads(int threads)
+{
+    threads_override = threads;
+}
+
 static void
 pe_fence_node(pe_working_set_t * data_set, node_t * node, const char *reason)
 {
@@ -188,6 +196,12 @@ unpack_config(xmlNode * config, pe_working_set_t * data_set)
     data_set->placement_strategy = pe_pref(data_set->config_hash, "placement-strategy");
     crm_trace("Placement strategy: %s", data_set->placement_strategy);
 
+    data_set->threads = threads_override;
+    if (data_set->threads == 0) {
+        data_set->threads = crm_parse_int(pe_pref(data_set->config_hash, "pe-threads"), "1");
+    }
+    crm_trace("Status processing threads: %d", data_set->threads);
+
     return TRUE;
 }
 
@@ -586,6 +600,40 @@ get_ticket_state_legacy(gpointer key, gpointer value, gpointer user_data)
 /* remove nodes that are down, stopping */
 /* create +ve rsc_to_node constraints between resources and the nodes they are running on */
 /* anything else? */
+static void
+prepare_status_op_lists(xmlNode * status, pe_working_set_t * data_set)
+{
+    xmlNode *node_state = NULL;
+    GPtrArray *rsc_entries = NULL;
+
+    if (data_set->threads <= 1) {
+        return;
+    }
+
+    rsc_entries = g_ptr_array_new();
+    for (node_state = __xml_first_child(status); node_state != NULL;
+         node_state = __xml_next(node_state)) {
+        xmlNode *lrm_rsc = NULL;
+        xmlNode *rsc_entry = NULL;
+
+        if (crm_str_eq((const char *)node_state->name, XML_CIB_TAG_STATE, TRUE) == FALSE) {
+            continue;
+        }
+
+        lrm_rsc = find_xml_node(node_state, XML_CIB_TAG_LRM, FALSE);
+        lrm_rsc = find_xml_node(lrm_rsc, XML_LRM_TAG_RESOURCES, FALSE);
+        for (rsc_entry = __xml_first_child(lrm_rsc); rsc_entry != NULL;
+             rsc_entry = __xml_next(rsc_entry)) {
+            if (crm_str_eq((const char *)rsc_entry->name, XML_LRM_TAG_RESOURCE, TRUE)) {
+                g_ptr_array_add(rsc_entries, rsc_entry);
+            }
+        }
+    }
+
+    pe_prepare_op_lists(rsc_entries, data_set);
+    g_ptr_array_free(rsc_entries, TRUE);
+}
+
 gboolean
 unpack_status(xmlNode * status, pe_working_set_t * data_set)
 {
@@ -670,6 +718,11 @@ unpack_status(xmlNode * status, pe_working_set_t * data_set)
         }
     }
 
+    /* Sorting each resource's operation history doesn't depend on
+     * anything else, so it can be done up-front and in parallel
+     */
+    prepare_status_op_lists(status, data_set);
+
     /* Now that we know all node states, we can safely handle migration ops
      * But, for now, only process healthy nodes
      *  - this is necessary for the logic in bug lf#2508 to function correctly 
@@ -725,6 +778,7 @@ unpack_status(xmlNode * status, pe_working_set_t * data_set)
         }
     }
 
+    pe_discard_op_lists(data_set);
     return TRUE;
 }
 
@@ -1118,6 +1172,7 @@ create_fake_resource(const char *rsc_id, xmlNode * rsc_entry, pe_working_set_t *
 
     set_bit(rsc->flags, pe_rsc_orphan);
     data_set->resources = g_list_append(data_set->resources, rsc);
+    pe_index_resource(rsc, NULL, data_set);
     return rsc;
 }
 
@@ -1230,6 +1285,7 @@ find_clone(pe_working_set_t * data_set, node_t * node, resource_t * parent, cons
         /* Create an extra orphan */
         resource_t *top = create_child_clone(parent, -1, data_set);
 
+        pe_index_resource(top, NULL, data_set);
         crm_debug("Created orphan for %s: %s on %s", parent->id, rsc_id, node->details->uname);
         rsc = top->fns->find_rsc(top, base, NULL, pe_find_current | pe_find_partial);
         CRM_ASSERT(rsc != NULL);
@@ -1242,6 +1298,7 @@ find_clone(pe_working_set_t * data_set, node_t * node, resource_t * parent, cons
                  rsc_id, node->details->uname, rsc->id,
                  is_set(rsc->flags, pe_rsc_orphan) ? " (ORPHAN)" : "");
         rsc->clone_name = crm_strdup(rsc_id);
+        pe_index_resource(rsc, rsc->clone_name, data_set);
     }
 
     crm_free(alt_rsc_id);
@@ -1544,11 +1601,9 @@ unpack_lrm_rsc_state(node_t * node, xmlNode * rsc_entry, pe_working_set_t * data
     const char *rsc_id = crm_element_value(rsc_entry, XML_ATTR_ID);
 
     resource_t *rsc = NULL;
-    GListPtr op_list = NULL;
     GListPtr sorted_op_list = NULL;
 
     xmlNode *migrate_op = NULL;
-    xmlNode *rsc_op = NULL;
 
     enum action_fail_response on_fail = FALSE;
     enum rsc_role_e saved_role = RSC_ROLE_UNKNOWN;
@@ -1557,16 +1612,9 @@ unpack_lrm_rsc_state(node_t * node, xmlNode * rsc_entry, pe_working_set_t * data
               crm_element_name(rsc_entry), rsc_id, node->details->uname);
 
     /* extract operations */
-    op_list = NULL;
-    sorted_op_list = NULL;
-
-    for (rsc_op = __xml_first_child(rsc_entry); rsc_op != NULL; rsc_op = __xml_next(rsc_op)) {
-        if (crm_str_eq((const char *)rsc_op->name, XML_LRM_TAG_RSC_OP, TRUE)) {
-            op_list = g_list_prepend(op_list, rsc_op);
-        }
-    }
+    sorted_op_list = pe_sorted_op_list(rsc_entry, data_set);
 
-    if (op_list == NULL) {
+    if (sorted_op_list == NULL) {
         /* if there are no operations, there is nothing to do */
         return;
     }
@@ -1582,7 +1630,6 @@ unpack_lrm_rsc_state(node_t * node, xmlNode * rsc_entry, pe_working_set_t * data
     saved_role = rsc->role;
     on_fail = action_fail_ignore;
     rsc->role = RSC_ROLE_UNKNOWN;
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
 
     for (gIter = sorted_op_list; gIter != NULL; gIter = gIter->next) {
         xmlNode *rsc_op = (xmlNode *) gIter->data;
@@ -33,6 +33,112 @@ void print_str_str(gpointer key, gpointer value, gpointer user_data);
 gboolean ghash_free_str_str(gpointer key, gpointer value, gpointer user_data);
 void unpack_operation(action_t * action, xmlNode * xml_obj, pe_working_set_t * data_set);
 
+/*
+ * Region allocator for objects that are never freed individually
+ *
+ * Everything allocated from a working set's arena is released in one
+ * go by cleanup_calculations(), so callers must not crm_free() it.
+ */
+#define PE_ARENA_BLOCK_SIZE (64 * 1024)
+#define PE_ARENA_ALIGN      sizeof(void *)
+
+typedef struct pe_arena_block_s {
+    struct pe_arena_block_s *next;
+    size_t size;
+    size_t offset;
+} pe_arena_block_t;
+
+struct pe_arena_s {
+    pe_arena_block_t *blocks;
+    size_t used;
+};
+
+/* The header size is a multiple of PE_ARENA_ALIGN, so is the start of each block's data */
+#define PE_ARENA_HEADER ((sizeof(pe_arena_block_t) + PE_ARENA_ALIGN - 1) & ~(PE_ARENA_ALIGN - 1))
+
+static pe_arena_block_t *
+pe_arena_block_new(size_t size)
+{
+    pe_arena_block_t *block = NULL;
+
+    /* crm_malloc0() also means the memory we hand out is already zero'd */
+    crm_malloc0(block, PE_ARENA_HEADER + size);
+    block->size = size;
+    return block;
+}
+
+void *
+pe_arena_alloc(pe_working_set_t * data_set, size_t size)
+{
+    char *mem = NULL;
+    pe_arena_t *arena = NULL;
+    pe_arena_block_t *block = NULL;
+
+    CRM_ASSERT(data_set != NULL);
+
+    size = (size + PE_ARENA_ALIGN - 1) & ~(PE_ARENA_ALIGN - 1);
+    if (data_set->arena == NULL) {
+        crm_malloc0(data_set->arena, sizeof(pe_arena_t));
+    }
+
+    arena = data_set->arena;
+    arena->used += size;
+
+    if (size > PE_ARENA_BLOCK_SIZE / 4) {
+        /* Large requests get a block of their own, behind the current one
+         * so that the latter's free space is not wasted
+         */
+        block = pe_arena_block_new(size);
+        block->offset = size;
+        if (arena->blocks) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            arena->blocks = block;
+        }
+        return (char *)block + PE_ARENA_HEADER;
+    }
+
+    block = arena->blocks;
+    if (block == NULL || block->size - block->offset < size) {
+        block = pe_arena_block_new(PE_ARENA_BLOCK_SIZE);
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    mem = (char *)block + PE_ARENA_HEADER + block->offset;
+    block->offset += size;
+    return mem;
+}
+
+size_t
+pe_arena_used(pe_working_set_t * data_set)
+{
+    if (data_set == NULL || data_set->arena == NULL) {
+        return 0;
+    }
+    return data_set->arena->used;
+}
+
+void
+pe_arena_free(pe_working_set_t * data_set)
+{
+    pe_arena_block_t *block = NULL;
+
+    if (data_set == NULL || data_set->arena == NULL) {
+        return;
+    }
+
+    block = data_set->arena->blocks;
+    while (block != NULL) {
+        pe_arena_block_t *next = block->next;
+
+        crm_free(block);
+        block = next;
+    }
+    crm_free(data_set->arena);
+}
+
 node_t *
 node_copy(node_t * this_node)
 {
@@ -410,6 +516,7 @@ custom_action(resource_t * rsc, char *key, const char *task,
         }
 
         if (save_action) {
+            pe_index_action(action, data_set);
             crm_trace("Action %d created", action->id);
         }
     }
@@ -884,8 +991,12 @@ pe_free_action(action_t * action)
     if (action == NULL) {
         return;
     }
-    slist_basic_destroy(action->actions_before);        /* action_warpper_t* */
-    slist_basic_destroy(action->actions_after); /* action_warpper_t* */
+    /* The action_warpper_t's themselves belong to the working set's arena */
+    g_list_free(action->actions_before);
+    g_list_free(action->actions_after);
+    if (action->actions_after_index) {
+        g_hash_table_destroy(action->actions_after_index);
+    }
     if (action->extra) {
         g_hash_table_destroy(action->extra);
     }
@@ -898,6 +1009,87 @@ pe_free_action(action_t * action)
     crm_free(action);
 }
 
+static gint
+sort_action_id_desc(gconstpointer a, gconstpointer b)
+{
+    const action_t *action_a = a;
+    const action_t *action_b = b;
+
+    if (action_a->id > action_b->id) {
+        return -1;
+    } else if (action_a->id < action_b->id) {
+        return 1;
+    }
+    return 0;
+}
+
+static void
+index_action(GHashTable ** index, action_t * action)
+{
+    gpointer key = NULL;
+    gpointer bucket = NULL;
+
+    if (*index == NULL) {
+        *index = g_hash_table_new_full(crm_str_hash, g_str_equal, g_hash_destroy_str,
+                                       (GDestroyNotify) g_list_free);
+    }
+
+    /* Lists of actions are built with g_list_prepend(), so each bucket
+     * is kept in descending id order to match
+     */
+    if (g_hash_table_lookup_extended(*index, action->uuid, &key, &bucket)) {
+        g_hash_table_steal(*index, key);
+    } else {
+        key = crm_strdup(action->uuid);
+    }
+    bucket = g_list_insert_sorted(bucket, action, sort_action_id_desc);
+    g_hash_table_insert(*index, key, bucket);
+}
+
+/*
+ * Index a saved action by its uuid, for find_actions() and friends
+ *
+ * Must be called again whenever action->uuid changes
+ */
+void
+pe_index_action(action_t * action, pe_working_set_t * data_set)
+{
+    CRM_CHECK(action != NULL && action->uuid != NULL, return);
+
+    index_action(&data_set->action_index, action);
+    if (action->rsc) {
+        index_action(&action->rsc->action_index, action);
+    }
+}
+
+/*
+ * If input is a resource's or the working set's list of actions,
+ * only the subset indexed under key needs to be searched.
+ *
+ * Entries are never removed, callers must still check action->uuid
+ */
+static GListPtr
+find_action_candidates(GListPtr input, const char *key)
+{
+    GHashTable *index = NULL;
+    action_t *first = input ? input->data : NULL;
+
+    if (key == NULL || first == NULL) {
+        return input;
+
+    } else if (first->rsc && first->rsc->actions == input) {
+        index = first->rsc->action_index;
+
+    } else if (pe_dataset && pe_dataset->actions == input) {
+        index = pe_dataset->action_index;
+    }
+
+    if (index == NULL) {
+        return input;
+    }
+    return g_hash_table_lookup(index, key);
+}
+
 GListPtr
 find_recurring_actions(GListPtr input, node_t * not_on_node)
 {
@@ -963,6 +1155,7 @@ find_first_action(GListPtr input, const char *uuid, const char *task, node_t * o
 
     CRM_CHECK(uuid || task, return NULL);
 
+    input = find_action_candidates(input, uuid);
     for (gIter = input; gIter != NULL; gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
@@ -989,11 +1182,13 @@ find_first_action(GListPtr input, const char *uuid, const char *task, node_t * o
 GListPtr
 find_actions(GListPtr input, const char *key, node_t * on_node)
 {
-    GListPtr gIter = input;
+    GListPtr gIter = NULL;
     GListPtr result = NULL;
 
     CRM_CHECK(key != NULL, return NULL);
 
+    gIter = find_action_candidates(input, key);
+
     for (; gIter != NULL; gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
@@ -1024,11 +1219,13 @@ find_actions(GListPtr input, const char *key, node_t * on_node)
 GListPtr
 find_actions_exact(GListPtr input, const char *key, node_t * on_node)
 {
-    GListPtr gIter = input;
+    GListPtr gIter = NULL;
     GListPtr result = NULL;
 
     CRM_CHECK(key != NULL, return NULL);
 
+    gIter = find_action_candidates(input, key);
+
     for (; gIter != NULL; gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
@@ -1232,6 +1429,146 @@ sort_op_by_callid(gconstpointer a, gconstpointer b)
 
 }
 
+/*
+ * Running independent pieces of work on several threads
+ *
+ * fn is called once for each entry of items, on up to data_set->threads
+ * threads at a time, and everything has finished by the time this returns.
+ * It must only read the working set and only write to its own item, any
+ * changes to shared state are left for the caller to make (serially, and
+ * in the order of items) afterwards so that the result is the same however
+ * the work was scheduled.
+ */
+void
+pe_run_parallel(pe_working_set_t * data_set, GPtrArray * items, GFunc fn, gpointer user_data)
+{
+    guint lpc = 0;
+
+#if SUPPORT_PE_THREADS
+    if (data_set->threads > 1 && items->len > 1) {
+        GError *error = NULL;
+        GThreadPool *pool = NULL;
+
+#  if !GLIB_CHECK_VERSION(2, 32, 0)
+        if (g_thread_supported() == FALSE) {
+            g_thread_init(NULL);
+        }
+#  endif
+        pool = g_thread_pool_new(fn, user_data, MIN(data_set->threads, items->len), TRUE, &error);
+        if (pool != NULL) {
+            crm_trace("Processing %u items with %d threads", items->len, data_set->threads);
+            for (lpc = 0; lpc < items->len; lpc++) {
+                g_thread_pool_push(pool, g_ptr_array_index(items, lpc), NULL);
+            }
+            g_thread_pool_free(pool, FALSE, TRUE);
+            return;
+        }
+
+        crm_warn("Could not create a thread pool, continuing with one thread: %s",
+                 error ? error->message : "unknown error");
+        g_clear_error(&error);
+    }
+#endif
+
+    for (lpc = 0; lpc < items->len; lpc++) {
+        fn(g_ptr_array_index(items, lpc), user_data);
+    }
+}
+
+typedef struct op_list_s {
+    xmlNode *rsc_entry;
+    GListPtr sorted;
+} op_list_t;
+
+static GListPtr
+build_sorted_op_list(xmlNode * rsc_entry)
+{
+    xmlNode *rsc_op = NULL;
+    GListPtr op_list = NULL;
+
+    for (rsc_op = __xml_first_child(rsc_entry); rsc_op != NULL; rsc_op = __xml_next(rsc_op)) {
+        if (crm_str_eq((const char *)rsc_op->name, XML_LRM_TAG_RSC_OP, TRUE)) {
+            op_list = g_list_prepend(op_list, rsc_op);
+        }
+    }
+    return g_list_sort(op_list, sort_op_by_callid);
+}
+
+static void
+sort_op_list_worker(gpointer data, gpointer user_data)
+{
+    op_list_t *entry = data;
+
+    entry->sorted = build_sorted_op_list(entry->rsc_entry);
+}
+
+/*
+ * Sort the lrm_rsc_op children of each lrm_resource in rsc_entries (in
+ * parallel if data_set->threads allows), for pe_sorted_op_list() to hand out
+ */
+void
+pe_prepare_op_lists(GPtrArray * rsc_entries, pe_working_set_t * data_set)
+{
+    guint lpc = 0;
+    GPtrArray *items = NULL;
+
+    pe_discard_op_lists(data_set);
+    if (data_set->threads <= 1 || rsc_entries->len < 2) {
+        /* Nothing to gain, pe_sorted_op_list() will do it as needed */
+        return;
+    }
+
+    items = g_ptr_array_sized_new(rsc_entries->len);
+    for (lpc = 0; lpc < rsc_entries->len; lpc++) {
+        op_list_t *entry = NULL;
+
+        crm_malloc0(entry, sizeof(op_list_t));
+        entry->rsc_entry = g_ptr_array_index(rsc_entries, lpc);
+        g_ptr_array_add(items, entry);
+    }
+
+    pe_run_parallel(data_set, items, sort_op_list_worker, NULL);
+
+    data_set->sorted_ops = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                 (GDestroyNotify) g_list_free);
+    for (lpc = 0; lpc < items->len; lpc++) {
+        op_list_t *entry = g_ptr_array_index(items, lpc);
+
+        g_hash_table_replace(data_set->sorted_ops, entry->rsc_entry, entry->sorted);
+        crm_free(entry);
+    }
+    g_ptr_array_free(items, TRUE);
+}
+
+void
+pe_discard_op_lists(pe_working_set_t * data_set)
+{
+    if (data_set->sorted_ops != NULL) {
+        g_hash_table_destroy(data_set->sorted_ops);
+        data_set->sorted_ops = NULL;
+    }
+}
+
+/*
+ * The lrm_rsc_op children of rsc_entry sorted by sort_op_by_callid()
+ *
+ * Uses the list from pe_prepare_op_lists() if there is one.  Either way
+ * the caller owns the result and must g_list_free() it.
+ */
+GListPtr
+pe_sorted_op_list(xmlNode * rsc_entry, pe_working_set_t * data_set)
+{
+    GListPtr sorted = NULL;
+
+    if (data_set->sorted_ops != NULL
+        && g_hash_table_lookup_extended(data_set->sorted_ops, rsc_entry, NULL,
+                                        (gpointer *) & sorted)) {
+        g_hash_table_steal(data_set->sorted_ops, rsc_entry);
+        return sorted;
+    }
+    return build_sorted_op_list(rsc_entry);
+}
+
 time_t
 get_timet_now(pe_working_set_t * data_set)
 {
@@ -1380,9 +1717,24 @@ get_target_role(resource_t * rsc, enum rsc_role_e * role)
     return TRUE;
 }
 
+/* Scanning fewer successors than this is cheaper than maintaining a hash table */
+#define ORDER_INDEX_THRESHOLD 16
+
+static void
+index_order(GHashTable * index, action_wrapper_t * wrapper)
+{
+    GListPtr edges = g_hash_table_lookup(index, wrapper->action);
+
+    if (edges) {
+        g_hash_table_steal(index, wrapper->action);
+    }
+    g_hash_table_insert(index, wrapper->action, g_list_prepend(edges, wrapper));
+}
+
 gboolean
 order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order)
 {
+    int num_after = 0;
     GListPtr gIter = NULL;
     action_wrapper_t *wrapper = NULL;
     GListPtr list = NULL;
@@ -1397,17 +1749,30 @@ order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order
 
     crm_trace("Ordering Action %s before %s", lh_action->uuid, rh_action->uuid);
 
-    /* Filter dups, otherwise update_action_states() has too much work to do */
-    gIter = lh_action->actions_after;
+    /* Filter dups, otherwise update_action_states() has too much work to do
+     *
+     * Once an action has accumulated enough successors, only the edges
+     * to rh_action need checking.  Checking every edge's type (instead
+     * of just remembering the pair) is necessary since update_action()
+     * disables edges by resetting it.
+     */
+    if (lh_action->actions_after_index) {
+        gIter = g_hash_table_lookup(lh_action->actions_after_index, rh_action);
+    } else {
+        gIter = lh_action->actions_after;
+    }
+
     for (; gIter != NULL; gIter = gIter->next) {
         action_wrapper_t *after = (action_wrapper_t *) gIter->data;
 
         if (after->action == rh_action && (after->type & order)) {
             return FALSE;
         }
+        num_after++;
     }
 
-    crm_malloc0(wrapper, sizeof(action_wrapper_t));
+    CRM_CHECK(pe_dataset != NULL, return FALSE);
+    wrapper = pe_arena_alloc(pe_dataset, sizeof(action_wrapper_t));
     wrapper->action = rh_action;
     wrapper->type = order;
 
@@ -1415,12 +1780,24 @@ order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order
     list = g_list_prepend(list, wrapper);
     lh_action->actions_after = list;
 
+    if (lh_action->actions_after_index == NULL && num_after >= ORDER_INDEX_THRESHOLD) {
+        /* Includes the new wrapper */
+        lh_action->actions_after_index = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                               NULL, (GDestroyNotify) g_list_free);
+        for (gIter = list; gIter != NULL; gIter = gIter->next) {
+            index_order(lh_action->actions_after_index, gIter->data);
+        }
+
+    } else if (lh_action->actions_after_index) {
+        index_order(lh_action->actions_after_index, wrapper);
+    }
+
     wrapper = NULL;
 
 /* 	order |= pe_order_implies_then; */
 /* 	order ^= pe_order_implies_then; */
 
-    crm_malloc0(wrapper, sizeof(action_wrapper_t));
+    wrapper = pe_arena_alloc(pe_dataset, sizeof(action_wrapper_t));
     wrapper->action = lh_action;
     wrapper->type = order;
     list = rh_action->actions_before;
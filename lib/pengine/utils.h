@@ -22,6 +22,18 @@
 
 extern pe_working_set_t *pe_dataset;
 
+extern void *pe_arena_alloc(pe_working_set_t * data_set, size_t size);
+extern size_t pe_arena_used(pe_working_set_t * data_set);
+extern void pe_arena_free(pe_working_set_t * data_set);
+
+extern void pe_index_resource(resource_t * rsc, const char *key, pe_working_set_t * data_set);
+
+extern void pe_run_parallel(pe_working_set_t * data_set, GPtrArray * items, GFunc fn,
+                            gpointer user_data);
+extern void pe_prepare_op_lists(GPtrArray * rsc_entries, pe_working_set_t * data_set);
+extern void pe_discard_op_lists(pe_working_set_t * data_set);
+extern GListPtr pe_sorted_op_list(xmlNode * rsc_entry, pe_working_set_t * data_set);
+
 extern node_t *node_copy(node_t * this_node);
 extern time_t get_timet_now(pe_working_set_t * data_set);
 extern int get_failcount(node_t * node, resource_t * rsc, int *last_failure,
@@ -136,6 +148,7 @@ extern GListPtr find_actions_exact(GListPtr input, const char *key, node_t * on_
 extern GListPtr find_recurring_actions(GListPtr input, node_t * not_on_node);
 
 extern void pe_free_action(action_t * action);
+extern void pe_index_action(action_t * action, pe_working_set_t * data_set);
 
 extern void
 
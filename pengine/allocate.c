@@ -178,6 +178,247 @@ CancelXmlOp(resource_t * rsc, xmlNode * xml_op, node_t * active_node,
     key = NULL;
 }
 
+/*
+ * Operation digests are remembered across transitions
+ *
+ * Recomputing them means converting the parameters to XML, copying,
+ * sorting and serializing them for every recorded operation, even though
+ * they rarely change between one transition and the next.  Instead the
+ * parameter set an operation would be given is written out directly from
+ * the hash tables it is assembled from and, together with the op key, the
+ * feature set the op was recorded with and its restart list, used to look
+ * up the digests calculated the last time it was seen.
+ *
+ * Entries not used during the previous transition are expired in stage0().
+ */
+typedef struct op_digest_s {
+    char *digest_all_calc;
+    char *digest_restart_calc;
+    unsigned int generation;
+} op_digest_t;
+
+static GHashTable *op_digest_cache = NULL;
+static unsigned int op_digest_generation = 0;
+
+static void
+free_op_digest(gpointer data)
+{
+    op_digest_t *digest = data;
+
+    crm_free(digest->digest_all_calc);
+    crm_free(digest->digest_restart_calc);
+    crm_free(digest);
+}
+
+static gboolean
+op_digest_expired(gpointer key, gpointer value, gpointer user_data)
+{
+    op_digest_t *digest = value;
+
+    return (op_digest_generation - digest->generation) > 1;
+}
+
+static void
+expire_op_digests(void)
+{
+    if (op_digest_cache != NULL) {
+        guint removed = g_hash_table_foreach_remove(op_digest_cache, op_digest_expired, NULL);
+
+        crm_trace("Expired %u of %u cached operation digests",
+                  removed, removed + g_hash_table_size(op_digest_cache));
+    }
+    op_digest_generation++;
+}
+
+/* The same precedence as the hash2field() calls in op_digest_params(): first one wins */
+static const char *
+op_param_value(GHashTable ** tables, int n_tables, int upto, const char *name)
+{
+    int lpc = 0;
+    const char *value = NULL;
+
+    for (lpc = 0; lpc < n_tables && lpc < upto; lpc++) {
+        value = g_hash_table_lookup(tables[lpc], name);
+        if (value != NULL) {
+            return value;
+        }
+    }
+    return NULL;
+}
+
+static gboolean
+op_param_filtered(const char *name)
+{
+    if (safe_str_eq(name, XML_ATTR_ID)
+        || safe_str_eq(name, XML_ATTR_CRM_VERSION)
+        || safe_str_eq(name, XML_LRM_ATTR_OP_DIGEST)) {
+        return TRUE;
+    }
+    return strncasecmp(name, CRM_META, strlen(CRM_META)) == 0;
+}
+
+static void
+op_digest_append(GString * buffer, const char *name, const char *value)
+{
+    g_string_append_printf(buffer, "%d:%s%d:%s",
+                           (int)strlen(name), name, (int)strlen(value), value);
+}
+
+static gint
+sort_param_names(gconstpointer a, gconstpointer b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+/*
+ * Equivalent to what op_digest_params() produces, but without the XML.
+ * Must be kept in sync with it and filter_action_parameters().
+ */
+static char *
+op_digest_key(const char *key, GHashTable * local_rsc_params, action_t * action,
+              resource_t * rsc, const char *op_version, gboolean restart,
+              const char *restart_list)
+{
+    int lpc = 0;
+    char *meta_name = NULL;
+    const char *interval = NULL;
+    const char *timeout = NULL;
+    GListPtr names = NULL;
+    GListPtr gIter = NULL;
+    GString *buffer = NULL;
+    GHashTable *tables[] = { local_rsc_params, action->extra, rsc->parameters };
+
+    for (lpc = 0; lpc < DIMOF(tables); lpc++) {
+        GHashTableIter iter;
+        const char *name = NULL;
+        const char *value = NULL;
+
+        g_hash_table_iter_init(&iter, tables[lpc]);
+        while (g_hash_table_iter_next(&iter, (gpointer *) & name, (gpointer *) & value)) {
+            if (value == NULL || op_param_filtered(name)) {
+                continue;
+
+            } else if (op_param_value(tables, DIMOF(tables), lpc, name) != NULL) {
+                /* Shadowed by an earlier table */
+                continue;
+            }
+            names = g_list_prepend(names, (gpointer) name);
+        }
+    }
+    names = g_list_sort(names, sort_param_names);
+
+    /* The leading byte says whether the restart list follows, so that it
+     * can never be mistaken for a parameter called "restart"
+     */
+    buffer = g_string_sized_new(1024);
+    g_string_append_c(buffer, restart ? 'R' : 'A');
+    op_digest_append(buffer, "key", key);
+    op_digest_append(buffer, "version", op_version ? op_version : "");
+    if (restart) {
+        op_digest_append(buffer, "restart", restart_list ? restart_list : "");
+    }
+
+    for (gIter = names; gIter != NULL; gIter = gIter->next) {
+        const char *name = gIter->data;
+
+        op_digest_append(buffer, name, op_param_value(tables, DIMOF(tables), DIMOF(tables), name));
+    }
+    g_list_free(names);
+
+    /* The interval and timeout come from the meta attributes unless a
+     * parameter of the same name got there first
+     */
+    meta_name = crm_meta_name(XML_LRM_ATTR_INTERVAL);
+    interval = op_param_value(tables, DIMOF(tables), DIMOF(tables), meta_name);
+    crm_free(meta_name);
+    if (interval == NULL) {
+        interval = g_hash_table_lookup(action->meta, XML_LRM_ATTR_INTERVAL);
+    }
+
+    meta_name = crm_meta_name(XML_ATTR_TIMEOUT);
+    timeout = op_param_value(tables, DIMOF(tables), DIMOF(tables), meta_name);
+    if (timeout == NULL) {
+        timeout = g_hash_table_lookup(action->meta, XML_ATTR_TIMEOUT);
+    }
+
+    if (timeout != NULL && crm_get_msec(interval) > 0 && compare_version(op_version, "1.0.8") > 0) {
+        /* filter_action_parameters() re-instates it */
+        op_digest_append(buffer, meta_name, timeout);
+    }
+    crm_free(meta_name);
+
+    return g_string_free(buffer, FALSE);
+}
+
+static xmlNode *
+op_digest_params(GHashTable * local_rsc_params, action_t * action, resource_t * rsc,
+                 const char *op_version)
+{
+    xmlNode *params = create_xml_node(NULL, XML_TAG_PARAMS);
+
+    g_hash_table_foreach(local_rsc_params, hash2field, params);
+    g_hash_table_foreach(action->extra, hash2field, params);
+    g_hash_table_foreach(rsc->parameters, hash2field, params);
+    g_hash_table_foreach(action->meta, hash2metafield, params);
+
+    filter_action_parameters(params, op_version);
+    return params;
+}
+
+static xmlNode *
+op_digest_restart_params(xmlNode * params_all, const char *restart_list)
+{
+    xmlNode *params_restart = copy_xml(params_all);
+
+    if (restart_list) {
+        filter_reload_parameters(params_restart, restart_list);
+    }
+    return params_restart;
+}
+
+static op_digest_t *
+lookup_op_digests(const char *key, GHashTable * local_rsc_params, action_t * action,
+                  resource_t * rsc, const char *op_version, gboolean restart,
+                  const char *restart_list)
+{
+    char *cache_key = NULL;
+    op_digest_t *digest = NULL;
+
+    if (op_digest_cache == NULL) {
+        op_digest_cache = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                g_hash_destroy_str, free_op_digest);
+    }
+
+    cache_key = op_digest_key(key, local_rsc_params, action, rsc, op_version,
+                              restart, restart_list);
+    digest = g_hash_table_lookup(op_digest_cache, cache_key);
+
+    if (digest == NULL) {
+        xmlNode *params_all = op_digest_params(local_rsc_params, action, rsc, op_version);
+
+        crm_malloc0(digest, sizeof(op_digest_t));
+        digest->digest_all_calc = calculate_operation_digest(params_all, op_version);
+
+        if (restart) {
+            xmlNode *params_restart = op_digest_restart_params(params_all, restart_list);
+
+            digest->digest_restart_calc = calculate_operation_digest(params_restart, op_version);
+            free_xml(params_restart);
+        }
+        free_xml(params_all);
+
+        crm_trace("Calculated digests for %s: %s %s", key,
+                  digest->digest_all_calc, crm_str(digest->digest_restart_calc));
+        g_hash_table_insert(op_digest_cache, cache_key, digest);
+
+    } else {
+        crm_free(cache_key);
+    }
+
+    digest->generation = op_digest_generation;
+    return digest;
+}
+
 static gboolean
 check_action_definition(resource_t * rsc, node_t * active_node, xmlNode * xml_op,
                         pe_working_set_t * data_set)
@@ -191,13 +432,12 @@ check_action_definition(resource_t * rsc, node_t * active_node, xmlNode * xml_op
     xmlNode *params_all = NULL;
     xmlNode *params_restart = NULL;
     GHashTable *local_rsc_params = NULL;
+    op_digest_t *digests = NULL;
 
-    char *digest_all_calc = NULL;
     const char *digest_all = NULL;
 
     const char *restart_list = NULL;
     const char *digest_restart = NULL;
-    char *digest_restart_calc = NULL;
 
     action_t *action = NULL;
     const char *task = crm_element_value(xml_op, XML_LRM_ATTR_TASK);
@@ -240,18 +480,13 @@ check_action_definition(resource_t * rsc, node_t * active_node, xmlNode * xml_op
 
     get_rsc_attributes(local_rsc_params, rsc, active_node, data_set);
 
-    params_all = create_xml_node(NULL, XML_TAG_PARAMS);
-    g_hash_table_foreach(local_rsc_params, hash2field, params_all);
-    g_hash_table_foreach(action->extra, hash2field, params_all);
-    g_hash_table_foreach(rsc->parameters, hash2field, params_all);
-    g_hash_table_foreach(action->meta, hash2metafield, params_all);
-
-    filter_action_parameters(params_all, op_version);
-    digest_all_calc = calculate_operation_digest(params_all, op_version);
     digest_all = crm_element_value(xml_op, XML_LRM_ATTR_OP_DIGEST);
     digest_restart = crm_element_value(xml_op, XML_LRM_ATTR_RESTART_DIGEST);
     restart_list = crm_element_value(xml_op, XML_LRM_ATTR_OP_RESTART);
 
+    digests = lookup_op_digests(key, local_rsc_params, action, rsc, op_version,
+                                digest_restart != NULL, restart_list);
+
     if (interval == 0 && safe_str_eq(task, RSC_STATUS)) {
         /* Reload based on the start action not a probe */
         task = RSC_START;
@@ -263,18 +498,14 @@ check_action_definition(resource_t * rsc, node_t * active_node, xmlNode * xml_op
 
     if (digest_restart) {
         /* Changes that force a restart */
-        params_restart = copy_xml(params_all);
-        if (restart_list) {
-            filter_reload_parameters(params_restart, restart_list);
-        }
-
-        digest_restart_calc = calculate_operation_digest(params_restart, op_version);
-        if (safe_str_neq(digest_restart_calc, digest_restart)) {
+        if (safe_str_neq(digests->digest_restart_calc, digest_restart)) {
             did_change = TRUE;
+            params_all = op_digest_params(local_rsc_params, action, rsc, op_version);
+            params_restart = op_digest_restart_params(params_all, restart_list);
             crm_log_xml_info(params_restart, "params:restart");
             crm_info("Parameters to %s on %s changed: was %s vs. now %s (restart:%s) %s",
                      key, active_node->details->uname,
-                     crm_str(digest_restart), digest_restart_calc,
+                     crm_str(digest_restart), digests->digest_restart_calc,
                      op_version, crm_element_value(xml_op, XML_ATTR_TRANSITION_MAGIC));
 
             key = generate_op_key(rsc->id, task, interval);
@@ -283,13 +514,16 @@ check_action_definition(resource_t * rsc, node_t * active_node, xmlNode * xml_op
         }
     }
 
-    if (safe_str_neq(digest_all_calc, digest_all)) {
+    if (safe_str_neq(digests->digest_all_calc, digest_all)) {
         /* Changes that can potentially be handled by a reload */
         did_change = TRUE;
+        if (params_all == NULL) {
+            params_all = op_digest_params(local_rsc_params, action, rsc, op_version);
+        }
         crm_log_xml_info(params_all, "params:reload");
         crm_info("Parameters to %s on %s changed: was %s vs. now %s (reload:%s) %s",
                  key, active_node->details->uname,
-                 crm_str(digest_all), digest_all_calc, op_version,
+                 crm_str(digest_all), digests->digest_all_calc, op_version,
                  crm_element_value(xml_op, XML_ATTR_TRANSITION_MAGIC));
 
         if (interval > 0) {
@@ -330,8 +564,6 @@ check_action_definition(resource_t * rsc, node_t * active_node, xmlNode * xml_op
   cleanup:
     free_xml(params_all);
     free_xml(params_restart);
-    crm_free(digest_all_calc);
-    crm_free(digest_restart_calc);
     g_hash_table_destroy(local_rsc_params);
 
     pe_free_action(action);
@@ -354,8 +586,6 @@ check_actions_for(xmlNode * rsc_entry, resource_t * rsc, node_t * node, pe_worki
     const char *task = NULL;
     const char *interval_s = NULL;
 
-    xmlNode *rsc_op = NULL;
-    GListPtr op_list = NULL;
     GListPtr sorted_op_list = NULL;
     gboolean is_probe = FALSE;
     gboolean did_change = FALSE;
@@ -378,13 +608,7 @@ check_actions_for(xmlNode * rsc_entry, resource_t * rsc, node_t * node, pe_worki
         DeleteRsc(rsc, node, FALSE, data_set);
     }
 
-    for (rsc_op = __xml_first_child(rsc_entry); rsc_op != NULL; rsc_op = __xml_next(rsc_op)) {
-        if (crm_str_eq((const char *)rsc_op->name, XML_LRM_TAG_RSC_OP, TRUE)) {
-            op_list = g_list_prepend(op_list, rsc_op);
-        }
-    }
-
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
+    sorted_op_list = pe_sorted_op_list(rsc_entry, data_set);
     calculate_active_ops(sorted_op_list, &start_index, &stop_index);
 
     for (gIter = sorted_op_list; gIter != NULL; gIter = gIter->next) {
@@ -495,16 +719,39 @@ find_rsc_list(GListPtr result, resource_t * rsc, const char *id, gboolean rename
     return result;
 }
 
+typedef struct check_entry_s {
+    node_t *node;
+    xmlNode *rsc_entry;
+    GListPtr resources;
+} check_entry_t;
+
+static void
+find_check_resources(gpointer data, gpointer user_data)
+{
+    check_entry_t *entry = data;
+    pe_working_set_t *data_set = user_data;
+
+    entry->resources = find_rsc_list(NULL, NULL, ID(entry->rsc_entry), TRUE, FALSE, data_set);
+}
+
 static void
 check_actions(pe_working_set_t * data_set)
 {
+    guint lpc = 0;
     const char *id = NULL;
     node_t *node = NULL;
     xmlNode *lrm_rscs = NULL;
     xmlNode *status = get_object_root(XML_CIB_TAG_STATUS, data_set->input);
 
     xmlNode *node_state = NULL;
+    GPtrArray *entries = g_ptr_array_new();
+    GPtrArray *rsc_entries = g_ptr_array_new();
 
+    /* Finding the resources and sorting their operations only reads the
+     * working set so, with pe-threads, that part is done in parallel.
+     * The checks themselves create actions and happen afterwards in the
+     * original order.
+     */
     for (node_state = __xml_first_child(status); node_state != NULL;
          node_state = __xml_next(node_state)) {
         if (crm_str_eq((const char *)node_state->name, XML_CIB_TAG_STATE, TRUE)) {
@@ -532,25 +779,43 @@ check_actions(pe_working_set_t * data_set)
                     if (crm_str_eq((const char *)rsc_entry->name, XML_LRM_TAG_RESOURCE, TRUE)) {
 
                         if (xml_has_children(rsc_entry)) {
-                            GListPtr gIter = NULL;
-                            GListPtr result = NULL;
+                            check_entry_t *entry = NULL;
                             const char *rsc_id = ID(rsc_entry);
 
-                            CRM_CHECK(rsc_id != NULL, return);
-
-                            result = find_rsc_list(NULL, NULL, rsc_id, TRUE, FALSE, data_set);
-                            for (gIter = result; gIter != NULL; gIter = gIter->next) {
-                                resource_t *rsc = (resource_t *) gIter->data;
+                            CRM_CHECK(rsc_id != NULL, goto check);
 
-                                check_actions_for(rsc_entry, rsc, node, data_set);
-                            }
-                            g_list_free(result);
+                            crm_malloc0(entry, sizeof(check_entry_t));
+                            entry->node = node;
+                            entry->rsc_entry = rsc_entry;
+                            g_ptr_array_add(entries, entry);
+                            g_ptr_array_add(rsc_entries, rsc_entry);
                         }
                     }
                 }
             }
         }
     }
+
+  check:
+    pe_run_parallel(data_set, entries, find_check_resources, data_set);
+    pe_prepare_op_lists(rsc_entries, data_set);
+
+    for (lpc = 0; lpc < entries->len; lpc++) {
+        GListPtr gIter = NULL;
+        check_entry_t *entry = g_ptr_array_index(entries, lpc);
+
+        for (gIter = entry->resources; gIter != NULL; gIter = gIter->next) {
+            resource_t *rsc = (resource_t *) gIter->data;
+
+            check_actions_for(entry->rsc_entry, rsc, entry->node, data_set);
+        }
+        g_list_free(entry->resources);
+        crm_free(entry);
+    }
+
+    pe_discard_op_lists(data_set);
+    g_ptr_array_free(rsc_entries, TRUE);
+    g_ptr_array_free(entries, TRUE);
 }
 
 static gboolean
@@ -775,6 +1040,7 @@ stage0(pe_working_set_t * data_set)
         cluster_status(data_set);
     }
 
+    expire_op_digests();
     set_alloc_actions(data_set);
     apply_system_health(data_set);
     unpack_constraints(cib_constraints, data_set);
@@ -1090,10 +1356,136 @@ sort_rsc_process_order(gconstpointer a, gconstpointer b, gpointer data)
     return rc;
 }
 
+/*
+ * Independent allocation components
+ *
+ * Resources only influence each other's placement through colocation
+ * constraints (and through being part of the same group or clone), so
+ * the top-level resources are split into the islands those constraints
+ * connect.  Allocation still happens in the usual order, since all
+ * components compete for the same nodes (num_resources and utilization),
+ * but the time spent on each island is reported so that expensive ones
+ * can be found.
+ */
+typedef struct alloc_component_s {
+    int id;
+    int resources;
+    resource_t *first;
+    double elapsed;
+} alloc_component_t;
+
+static resource_t *
+alloc_component_root(GHashTable * links, resource_t * rsc)
+{
+    resource_t *next = NULL;
+
+    rsc = uber_parent(rsc);
+    while ((next = g_hash_table_lookup(links, rsc)) != NULL) {
+        rsc = next;
+    }
+    return rsc;
+}
+
+static GHashTable *
+find_alloc_components(pe_working_set_t * data_set)
+{
+    int id = 0;
+    GListPtr gIter = NULL;
+    GHashTable *links = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable *components = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    for (gIter = data_set->colocation_constraints; gIter != NULL; gIter = gIter->next) {
+        rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
+        resource_t *lh = NULL;
+        resource_t *rh = NULL;
+
+        if (constraint->rsc_lh == NULL || constraint->rsc_rh == NULL) {
+            continue;
+        }
+
+        lh = alloc_component_root(links, constraint->rsc_lh);
+        rh = alloc_component_root(links, constraint->rsc_rh);
+        if (lh != rh) {
+            g_hash_table_insert(links, rh, lh);
+        }
+    }
+
+    /* Number them in allocation order so the report is stable */
+    for (gIter = data_set->resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        resource_t *root = alloc_component_root(links, rsc);
+        alloc_component_t *component = g_hash_table_lookup(components, root);
+
+        if (component == NULL) {
+            crm_malloc0(component, sizeof(alloc_component_t));
+            component->id = ++id;
+            component->first = rsc;
+            g_hash_table_insert(components, root, component);
+        }
+        component->resources++;
+        g_hash_table_insert(components, rsc, component);
+    }
+
+    /* Every top-level resource now maps straight to its component */
+    g_hash_table_destroy(links);
+    return components;
+}
+
+static void
+report_alloc_components(GHashTable * components, pe_working_set_t * data_set)
+{
+    int count = 0;
+    GListPtr gIter = NULL;
+    alloc_component_t *slowest = NULL;
+
+    for (gIter = data_set->resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        alloc_component_t *component = g_hash_table_lookup(components, rsc);
+
+        if (component->first != rsc) {
+            continue;
+        }
+
+        count++;
+        crm_debug("Allocation component %d (%s and %d other%s): %.3fs",
+                  component->id, rsc->id, component->resources - 1,
+                  component->resources == 2 ? "" : "s", component->elapsed);
+
+        if (slowest == NULL || component->elapsed > slowest->elapsed) {
+            slowest = component;
+        }
+    }
+
+    if (slowest) {
+        crm_info("Allocated %d resources in %d independent component%s, slowest: %d (%s, %.3fs)",
+                 g_list_length(data_set->resources), count, count == 1 ? "" : "s",
+                 slowest->id, slowest->first->id, slowest->elapsed);
+    }
+}
+
+static void
+free_alloc_components(GHashTable * components, pe_working_set_t * data_set)
+{
+    GListPtr gIter = NULL;
+
+    /* Backwards, so that each component's first resource is the last one we look it up for */
+    for (gIter = g_list_last(data_set->resources); gIter != NULL; gIter = gIter->prev) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        alloc_component_t *component = g_hash_table_lookup(components, rsc);
+
+        if (component->first == rsc) {
+            crm_free(component);
+        }
+    }
+    g_hash_table_destroy(components);
+}
+
 gboolean
 stage5(pe_working_set_t * data_set)
 {
     GListPtr gIter = NULL;
+    GTimer *timer = NULL;
+    GHashTable *components = NULL;
 
     if (safe_str_neq(data_set->placement_strategy, "default")) {
         GListPtr nodes = g_list_copy(data_set->nodes);
@@ -1116,14 +1508,24 @@ stage5(pe_working_set_t * data_set)
     crm_trace("Allocating services");
     /* Take (next) highest resource, assign it and create its actions */
 
+    components = find_alloc_components(data_set);
+    timer = g_timer_new();
+
     gIter = data_set->resources;
     for (; gIter != NULL; gIter = gIter->next) {
         resource_t *rsc = (resource_t *) gIter->data;
+        alloc_component_t *component = g_hash_table_lookup(components, rsc);
 
         crm_trace("Allocating: %s", rsc->id);
+        g_timer_start(timer);
         rsc->cmds->allocate(rsc, NULL, data_set);
+        component->elapsed += g_timer_elapsed(timer, NULL);
     }
 
+    report_alloc_components(components, data_set);
+    g_timer_destroy(timer);
+    free_alloc_components(components, data_set);
+
     gIter = data_set->nodes;
     for (; gIter != NULL; gIter = gIter->next) {
         node_t *node = (node_t *) gIter->data;
@@ -1506,8 +1908,6 @@ rsc_order_first(resource_t * lh_rsc, order_constraint_t * order, pe_working_set_
     g_list_free(lh_actions);
 }
 
-extern gboolean update_action(action_t * action);
-
 gboolean
 stage7(pe_working_set_t * data_set)
 {
@@ -1548,13 +1948,7 @@ stage7(pe_working_set_t * data_set)
     }
 
     crm_trace("Updating %d actions", g_list_length(data_set->actions));
-
-    gIter = data_set->actions;
-    for (; gIter != NULL; gIter = gIter->next) {
-        action_t *action = (action_t *) gIter->data;
-
-        update_action(action);
-    }
+    update_action_graph(data_set);
 
     crm_trace("Processing migrations");
 
@@ -2261,12 +2655,12 @@ cleanup_alloc_calculations(pe_working_set_t * data_set)
 
     crm_trace("deleting %d inter-resource cons: %p",
                 g_list_length(data_set->colocation_constraints), data_set->colocation_constraints);
-    slist_basic_destroy(data_set->colocation_constraints);
+    g_list_free(data_set->colocation_constraints);       /* arena allocated */
     data_set->colocation_constraints = NULL;
 
     crm_trace("deleting %d ticket deps: %p",
                 g_list_length(data_set->ticket_constraints), data_set->ticket_constraints);
-    slist_basic_destroy(data_set->ticket_constraints);
+    g_list_free(data_set->ticket_constraints);   /* arena allocated */
     data_set->ticket_constraints = NULL;
 
     cleanup_calculations(data_set);
@@ -656,10 +656,7 @@ rsc_colocation_new(const char *id, const char *node_attr, int score,
         return FALSE;
     }
 
-    crm_malloc0(new_con, sizeof(rsc_colocation_t));
-    if (new_con == NULL) {
-        return FALSE;
-    }
+    new_con = pe_arena_alloc(data_set, sizeof(rsc_colocation_t));
 
     if (state_lh == NULL || safe_str_eq(state_lh, RSC_ROLE_STARTED_S)) {
         state_lh = RSC_ROLE_UNKNOWN_S;
@@ -736,7 +733,7 @@ custom_action_order(resource_t * lh_rsc, char *lh_action_task, action_t * lh_act
         return -1;
     }
 
-    crm_malloc0(order, sizeof(order_constraint_t));
+    order = pe_arena_alloc(data_set, sizeof(order_constraint_t));
 
     order->id = data_set->order_id++;
     order->type = type;
@@ -2007,10 +2004,7 @@ rsc_ticket_new(const char *id, resource_t * rsc_lh, ticket_t * ticket,
         return FALSE;
     }
 
-    crm_malloc0(new_rsc_ticket, sizeof(rsc_ticket_t));
-    if (new_rsc_ticket == NULL) {
-        return FALSE;
-    }
+    new_rsc_ticket = pe_arena_alloc(data_set, sizeof(rsc_ticket_t));
 
     if (state_lh == NULL || safe_str_eq(state_lh, RSC_ROLE_STARTED_S)) {
         state_lh = RSC_ROLE_UNKNOWN_S;
@@ -31,9 +31,31 @@
 #include <lib/pengine/utils.h>
 #include <utils.h>
 
-gboolean update_action(action_t * action);
 gboolean rsc_update_action(action_t * first, action_t * then, enum pe_ordering type);
 
+/*
+ * update_action() used to call itself for every action affected by a
+ * change, and stage7() called it again for every action.  Deep ordering
+ * chains could overflow the stack that way, and the same actions were
+ * re-evaluated many times over.
+ *
+ * Now actions waiting to be updated are kept on a queue, and an action is
+ * only queued when it or one of its inputs changed.  Those go to the front,
+ * so actions are visited in the order the recursion used.  That matters
+ * because requires-any actions and clone interleaving are not monotonic:
+ * what they do depends on when they are evaluated.  An action that is
+ * already waiting is moved rather than queued twice.
+ */
+typedef struct update_queue_s {
+    GQueue *pending;
+    GList **queued;             /* each action's place in pending, by id */
+    int allocated;
+    int evaluations;
+} update_queue_t;
+
+/* Far more evaluations per action and ordering than any real graph needs */
+#define UPDATE_ACTION_MAX_PASSES 16
+
 static enum pe_action_flags
 get_action_flags(action_t * action, node_t * node)
 {
@@ -292,107 +314,175 @@ graph_update_action(action_t * first, action_t * then, node_t * node, enum pe_ac
     return changed;
 }
 
-gboolean
-update_action(action_t * then)
+static GList **
+update_queue_link(update_queue_t * queue, action_t * action)
 {
-    GListPtr lpc = NULL;
-    enum pe_graph_flags changed = pe_graph_none;
-    int last_flags = then->flags;
+    if (action->id >= queue->allocated) {
+        int old = queue->allocated;
 
-    crm_trace("Processing %s (%s %s %s)",
-              then->uuid,
-              is_set(then->flags, pe_action_optional) ? "optional" : "required",
-              is_set(then->flags, pe_action_runnable) ? "runnable" : "unrunnable",
-              is_set(then->flags,
-                     pe_action_pseudo) ? "pseudo" : then->node ? then->node->details->uname : "");
+        while (action->id >= queue->allocated) {
+            queue->allocated *= 2;
+        }
+        crm_realloc(queue->queued, queue->allocated * sizeof(GList *));
+        memset(queue->queued + old, 0, (queue->allocated - old) * sizeof(GList *));
+    }
+    return &queue->queued[action->id];
+}
 
+static void
+update_queue_push(update_queue_t * queue, action_t * action, gboolean first)
+{
+    GList **link = update_queue_link(queue, action);
 
-    if (is_set(then->flags, pe_action_requires_any)) {
-        clear_bit_inplace(then->flags, pe_action_runnable);
+    if (*link == NULL && first) {
+        g_queue_push_head(queue->pending, action);
+        *link = queue->pending->head;
+
+    } else if (*link == NULL) {
+        g_queue_push_tail(queue->pending, action);
+        *link = queue->pending->tail;
+
+    } else if (first) {
+        g_queue_unlink(queue->pending, *link);
+        g_queue_push_head_link(queue->pending, *link);
+    }
+}
+
+/*
+ * action changed: everything ordered after it, and it, need updating next.
+ * They are pushed in reverse so that they come off in list order.
+ */
+static void
+update_queue_dependants(update_queue_t * queue, action_t * action, gboolean self_first)
+{
+    GListPtr gIter = NULL;
+
+    if (self_first == FALSE) {
+        update_queue_push(queue, action, TRUE);
+    }
+    for (gIter = g_list_last(action->actions_after); gIter != NULL; gIter = gIter->prev) {
+        update_queue_push(queue, ((action_wrapper_t *) gIter->data)->action, TRUE);
     }
+    if (self_first) {
+        update_queue_push(queue, action, TRUE);
+    }
+}
 
-    for (lpc = then->actions_before; lpc != NULL; lpc = lpc->next) {
-        action_wrapper_t *other = (action_wrapper_t *) lpc->data;
-        action_t *first = other->action;
+/*
+ * Apply one of then's orderings.  Returns the action before it if that
+ * changed, in which case its dependants and then it need updating.
+ */
+static action_t *
+update_action_ordering(action_t * then, action_wrapper_t * other, enum pe_graph_flags *changed)
+{
+    action_t *first = other->action;
 
-        node_t *then_node = then->node;
-        node_t *first_node = first->node;
+    node_t *then_node = then->node;
+    node_t *first_node = first->node;
 
-        enum pe_action_flags then_flags = 0;
-        enum pe_action_flags first_flags = 0;
+    enum pe_action_flags then_flags = 0;
+    enum pe_action_flags first_flags = 0;
 
-        if (first->rsc && first->rsc->variant == pe_group && safe_str_eq(first->task, RSC_START)) {
-            first_node = first->rsc->fns->location(first->rsc, NULL, FALSE);
-            if (first_node) {
-                crm_trace("First: Found node %s for %s", first_node->details->uname, first->uuid);
-            }
+    if (first->rsc && first->rsc->variant == pe_group && safe_str_eq(first->task, RSC_START)) {
+        first_node = first->rsc->fns->location(first->rsc, NULL, FALSE);
+        if (first_node) {
+            crm_trace("First: Found node %s for %s", first_node->details->uname, first->uuid);
         }
+    }
 
-        if (then->rsc && then->rsc->variant == pe_group && safe_str_eq(then->task, RSC_START)) {
-            then_node = then->rsc->fns->location(then->rsc, NULL, FALSE);
-            if (then_node) {
-                crm_trace("Then: Found node %s for %s", then_node->details->uname, then->uuid);
-            }
+    if (then->rsc && then->rsc->variant == pe_group && safe_str_eq(then->task, RSC_START)) {
+        then_node = then->rsc->fns->location(then->rsc, NULL, FALSE);
+        if (then_node) {
+            crm_trace("Then: Found node %s for %s", then_node->details->uname, then->uuid);
         }
+    }
 
-        clear_bit_inplace(changed, pe_graph_updated_first);
+    clear_bit_inplace(*changed, pe_graph_updated_first);
 
-        if (first->rsc != then->rsc
-            && first->rsc != NULL && then->rsc != NULL && first->rsc != then->rsc->parent) {
-            first = rsc_expand_action(first);
-        }
-        if (first != other->action) {
-            crm_trace("Ordering %s afer %s instead of %s", then->uuid, first->uuid,
-                      other->action->uuid);
-        }
+    if (first->rsc != then->rsc
+        && first->rsc != NULL && then->rsc != NULL && first->rsc != then->rsc->parent) {
+        first = rsc_expand_action(first);
+    }
+    if (first != other->action) {
+        crm_trace("Ordering %s afer %s instead of %s", then->uuid, first->uuid,
+                  other->action->uuid);
+    }
 
-        first_flags = get_action_flags(first, then_node);
-        then_flags = get_action_flags(then, first_node);
+    first_flags = get_action_flags(first, then_node);
+    then_flags = get_action_flags(then, first_node);
 
-        crm_trace("Checking %s (%s %s %s) against %s (%s %s %s) 0x%.6x",
-                  then->uuid,
-                  is_set(then_flags, pe_action_optional) ? "optional" : "required",
-                  is_set(then_flags, pe_action_runnable) ? "runnable" : "unrunnable",
-                  is_set(then_flags,
-                         pe_action_pseudo) ? "pseudo" : then->node ? then->node->details->
-                  uname : "", first->uuid, is_set(first_flags,
-                                                  pe_action_optional) ? "optional" : "required",
-                  is_set(first_flags, pe_action_runnable) ? "runnable" : "unrunnable",
-                  is_set(first_flags,
+    crm_trace("Checking %s (%s %s %s) against %s (%s %s %s) 0x%.6x",
+              then->uuid,
+              is_set(then_flags, pe_action_optional) ? "optional" : "required",
+              is_set(then_flags, pe_action_runnable) ? "runnable" : "unrunnable",
+              is_set(then_flags,
+                     pe_action_pseudo) ? "pseudo" : then->node ? then->node->details->
+              uname : "", first->uuid, is_set(first_flags,
+                                              pe_action_optional) ? "optional" : "required",
+              is_set(first_flags, pe_action_runnable) ? "runnable" : "unrunnable",
+              is_set(first_flags,
+                     pe_action_pseudo) ? "pseudo" : first->node ? first->node->details->
+              uname : "", other->type);
+
+    if (first == other->action) {
+        clear_bit_inplace(first_flags, pe_action_pseudo);
+        *changed |= graph_update_action(first, then, then->node, first_flags, other->type);
+
+    } else if (order_actions(first, then, other->type)) {
+        /* Start again to get the new actions_before list */
+        *changed |= (pe_graph_updated_then | pe_graph_disable);
+    }
+
+    if (*changed & pe_graph_disable) {
+        crm_trace("Disabled constraint %s -> %s", other->action->uuid, then->uuid);
+        clear_bit_inplace(*changed, pe_graph_disable);
+        other->type = pe_order_none;
+    }
+
+    if (*changed & pe_graph_updated_first) {
+        crm_trace("Updated %s (first %s %s %s), processing dependants ",
+                  first->uuid,
+                  is_set(first->flags, pe_action_optional) ? "optional" : "required",
+                  is_set(first->flags, pe_action_runnable) ? "runnable" : "unrunnable",
+                  is_set(first->flags,
                          pe_action_pseudo) ? "pseudo" : first->node ? first->node->details->
-                  uname : "", other->type);
-
-        if (first == other->action) {
-            clear_bit_inplace(first_flags, pe_action_pseudo);
-            changed |= graph_update_action(first, then, then->node, first_flags, other->type);
+                  uname : "");
+        return first;
+    }
+    return NULL;
+}
 
-        } else if (order_actions(first, then, other->type)) {
-            /* Start again to get the new actions_before list */
-            changed |= (pe_graph_updated_then | pe_graph_disable);
-        }
+/*
+ * Update then from the actions ordered before it, queueing whatever that
+ * changed.  Requires-any actions are runnable again only if one of their
+ * inputs still is.
+ */
+static void
+update_action(action_t * then, update_queue_t * queue)
+{
+    GListPtr gIter = NULL;
+    int last_flags = then->flags;
+    enum pe_graph_flags changed = pe_graph_none;
 
-        if (changed & pe_graph_disable) {
-            crm_trace("Disabled constraint %s -> %s", other->action->uuid, then->uuid);
-            clear_bit_inplace(changed, pe_graph_disable);
-            other->type = pe_order_none;
-        }
+    crm_trace("Processing %s (%s %s %s)",
+              then->uuid,
+              is_set(then->flags, pe_action_optional) ? "optional" : "required",
+              is_set(then->flags, pe_action_runnable) ? "runnable" : "unrunnable",
+              is_set(then->flags,
+                     pe_action_pseudo) ? "pseudo" : then->node ? then->node->details->uname : "");
 
-        if (changed & pe_graph_updated_first) {
-            GListPtr lpc2 = NULL;
+    if (is_set(then->flags, pe_action_requires_any)) {
+        clear_bit_inplace(then->flags, pe_action_runnable);
+    }
 
-            crm_trace("Updated %s (first %s %s %s), processing dependants ",
-                      first->uuid,
-                      is_set(first->flags, pe_action_optional) ? "optional" : "required",
-                      is_set(first->flags, pe_action_runnable) ? "runnable" : "unrunnable",
-                      is_set(first->flags,
-                             pe_action_pseudo) ? "pseudo" : first->node ? first->node->details->
-                      uname : "");
-            for (lpc2 = first->actions_after; lpc2 != NULL; lpc2 = lpc2->next) {
-                action_wrapper_t *other = (action_wrapper_t *) lpc2->data;
+    /* order_actions() prepends, so new inputs are not visited here.
+     * Adding one sets pe_graph_updated_then, which queues then again.
+     */
+    for (gIter = then->actions_before; gIter != NULL; gIter = gIter->next) {
+        action_t *first = update_action_ordering(then, gIter->data, &changed);
 
-                update_action(other->action);
-            }
-            update_action(first);
+        if (first != NULL) {
+            update_queue_dependants(queue, first, FALSE);
         }
     }
 
@@ -412,16 +502,61 @@ update_action(action_t * then)
                   is_set(then->flags,
                          pe_action_pseudo) ? "pseudo" : then->node ? then->node->details->
                   uname : "");
+        update_queue_dependants(queue, then, TRUE);
+    }
+}
+
+/*
+ * Update every action from the actions ordered before it, and everything
+ * affected in turn, until nothing changes any more
+ */
+void
+update_action_graph(pe_working_set_t * data_set)
+{
+    int orderings = 0;
+    int max_evaluations = 0;
+    GListPtr gIter = NULL;
+    update_queue_t queue;
+
+    memset(&queue, 0, sizeof(update_queue_t));
+    queue.pending = g_queue_new();
+    queue.allocated = data_set->action_id + 1;
+    crm_malloc0(queue.queued, queue.allocated * sizeof(GList *));
+
+    for (gIter = data_set->actions; gIter != NULL; gIter = gIter->next) {
+        action_t *action = (action_t *) gIter->data;
+
+        orderings += g_list_length(action->actions_after);
+        update_queue_push(&queue, action, FALSE);
+    }
+    max_evaluations = UPDATE_ACTION_MAX_PASSES * (g_list_length(data_set->actions) + orderings);
 
-        update_action(then);
-        for (lpc = then->actions_after; lpc != NULL; lpc = lpc->next) {
-            action_wrapper_t *other = (action_wrapper_t *) lpc->data;
+    while (g_queue_is_empty(queue.pending) == FALSE) {
+        action_t *action = NULL;
 
-            update_action(other->action);
+        if (queue.evaluations == max_evaluations) {
+            action = g_queue_peek_head(queue.pending);
+            pe_proc_err("Action flags are still changing after %d updates (at %s),"
+                        " no actions will be scheduled", queue.evaluations, action->uuid);
+
+            /* None of them can be trusted, so run nothing this transition */
+            for (gIter = data_set->actions; gIter != NULL; gIter = gIter->next) {
+                update_action_flags(gIter->data, pe_action_runnable | pe_action_clear);
+            }
+            break;
         }
+
+        action = g_queue_pop_head(queue.pending);
+        *update_queue_link(&queue, action) = NULL;
+        queue.evaluations++;
+        update_action(action, &queue);
     }
 
-    return FALSE;
+    crm_trace("Updated %d actions and %d orderings with %d evaluations",
+              g_list_length(data_set->actions), orderings, queue.evaluations);
+
+    g_queue_free(queue.pending);
+    crm_free(queue.queued);
 }
 
 gboolean
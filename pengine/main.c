@@ -56,6 +56,7 @@ pe_ipc_created(qb_ipcs_connection_t *c)
 }
 
 gboolean process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* sender);
+void pe_archive_flush(void);
 
 static int32_t
 pe_ipc_dispatch(qb_ipcs_connection_t *c, void *data, size_t size)
@@ -207,5 +208,6 @@ void
 pengine_shutdown(int nsig)
 {
     mainloop_del_ipc_server(ipcs);
+    pe_archive_flush();
     exit(LSB_EXIT_OK);
 }
@@ -367,11 +367,18 @@ rsc_merge_weights(resource_t * rsc, const char *rhs, GHashTable * nodes, const c
         }
         clear_bit_inplace(flags, pe_weights_init);
 
-    } else {
+    } else if (is_set(flags, pe_weights_rollback)) {
         crm_trace("%s: Combining scores from %s", rhs, rsc->id);
         work = node_hash_dup(nodes);
         node_hash_update(work, rsc->allowed_nodes, attr, factor,
                          is_set(flags, pe_weights_positive));
+
+    } else {
+        /* We own nodes and can't be asked to go back to it, so there is no need for a copy */
+        crm_trace("%s: Combining scores from %s (in place)", rhs, rsc->id);
+        work = nodes;
+        node_hash_update(work, rsc->allowed_nodes, attr, factor,
+                         is_set(flags, pe_weights_positive));
     }
 
     if (is_set(flags, pe_weights_rollback) && can_run_any(work) == FALSE) {
@@ -419,7 +426,7 @@ rsc_merge_weights(resource_t * rsc, const char *rhs, GHashTable * nodes, const c
         }
     }
 
-    if (nodes) {
+    if (nodes && nodes != work) {
         g_hash_table_destroy(nodes);
     }
 
@@ -2958,6 +2965,7 @@ ReloadRsc(resource_t * rsc, action_t *stop, action_t *start, pe_working_set_t *
     crm_free(rewrite->task);
     rewrite->task = crm_strdup("reload");
     rewrite->uuid = generate_op_key(rsc->id, rewrite->task, 0);
+    pe_index_action(rewrite, data_set);
 }
 
 void
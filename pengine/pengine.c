@@ -25,6 +25,7 @@
 #include <crm/msg_xml.h>
 #include <crm/common/xml.h>
 #include <crm/common/msg.h>
+#include <crm/common/mainloop.h>
 
 #include <glib.h>
 
@@ -44,11 +45,18 @@ extern int transition_id;
 
 #define get_series() 	was_processing_error?1:was_processing_warning?2:3
 
+/* Write a complete copy of the input at least this often when archiving */
+#define PE_ARCHIVE_KEYFRAME_INTERVAL 50
+
 typedef struct series_s {
     int id;
     const char *name;
     const char *param;
     int wrap;
+
+    /* The last input appended to the series' archive */
+    xmlNode *last_input;
+    int since_keyframe;
 } series_t;
 
 series_t series[] = {
@@ -58,6 +66,116 @@ series_t series[] = {
     {0, "pe-input", "pe-input-series-max", 400},
 };
 
+typedef struct pe_archive_entry_s {
+    int series_id;
+    int sequence;
+    xmlNode *input;
+} pe_archive_entry_t;
+
+static GListPtr archive_queue = NULL;
+static crm_trigger_t *archive_writer = NULL;
+
+static char *
+pe_archive_name(int series_id)
+{
+    char *base = crm_concat(PE_STATE_DIR, series[series_id].name, '/');
+    char *archive = crm_concat(base, "archive", '.');
+
+    crm_free(base);
+    return archive;
+}
+
+static void
+pe_archive_write(pe_archive_entry_t * entry)
+{
+    xmlNode *base = NULL;
+    gboolean is_delta = FALSE;
+    series_t *s = &(series[entry->series_id]);
+    char *archive = pe_archive_name(entry->series_id);
+
+    if (entry->sequence == 0) {
+        /* The sequence wrapped (or this is a new series), start afresh but
+         * keep the previous archive around so its inputs can be extracted
+         */
+        char *previous = crm_concat(archive, "old", '.');
+
+        if (rename(archive, previous) < 0 && errno != ENOENT) {
+            crm_perror(LOG_WARNING, "Could not rotate %s", archive);
+        }
+        crm_free(previous);
+
+        free_xml(s->last_input);
+        s->last_input = NULL;
+    }
+
+    if (s->since_keyframe < PE_ARCHIVE_KEYFRAME_INTERVAL) {
+        base = s->last_input;
+    }
+
+    if (append_xml_archive(archive, entry->sequence, entry->input, base, &is_delta) < 0) {
+        crm_err("Could not archive PEngine Input %d to %s", entry->sequence, archive);
+        free_xml(entry->input);
+
+        /* Make sure the next entry is complete */
+        free_xml(s->last_input);
+        s->last_input = NULL;
+
+    } else {
+        crm_trace("Archived PEngine Input %d to %s as a %s", entry->sequence, archive,
+                  is_delta ? "delta" : "keyframe");
+        s->since_keyframe = is_delta ? s->since_keyframe + 1 : 0;
+
+        free_xml(s->last_input);
+        s->last_input = entry->input;
+    }
+
+    crm_free(archive);
+    crm_free(entry);
+}
+
+static int
+pe_archive_dispatch(gpointer user_data)
+{
+    /* One entry at a time so that new requests are not held up */
+    if (archive_queue != NULL) {
+        pe_archive_entry_t *entry = archive_queue->data;
+
+        archive_queue = g_list_delete_link(archive_queue, archive_queue);
+        pe_archive_write(entry);
+    }
+
+    if (archive_queue != NULL) {
+        mainloop_set_trigger(archive_writer);
+    }
+    return TRUE;
+}
+
+static void
+pe_archive_input(int series_id, int sequence, xmlNode * input)
+{
+    pe_archive_entry_t *entry = NULL;
+
+    crm_malloc0(entry, sizeof(pe_archive_entry_t));
+    entry->series_id = series_id;
+    entry->sequence = sequence;
+    entry->input = copy_xml(input);
+
+    if (archive_writer == NULL) {
+        archive_writer = mainloop_add_trigger(G_PRIORITY_LOW, pe_archive_dispatch, NULL);
+    }
+
+    archive_queue = g_list_append(archive_queue, entry);
+    mainloop_set_trigger(archive_writer);
+}
+
+void
+pe_archive_flush(void)
+{
+    while (archive_queue != NULL) {
+        pe_archive_dispatch(NULL);
+    }
+}
+
 gboolean process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* sender);
 
 gboolean
@@ -97,6 +215,7 @@ process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* send
         xmlNode *reply = NULL;
         gboolean is_repoke = FALSE;
         gboolean process = TRUE;
+        gboolean archive = FALSE;
 
 #if HAVE_BZLIB_H
         gboolean compress = TRUE;
@@ -113,6 +232,12 @@ process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* send
         graph_file = crm_strdup(CRM_STATE_DIR "/graph.XXXXXX");
         graph_file = mktemp(graph_file);
 
+        /* The working set is rebuilt from the input every time, even when
+         * only the status section changed.  Unpacking the status and
+         * allocating modify the resource, node and constraint objects, so
+         * they cannot be carried over into the next calculation until
+         * there is a way to reset them.
+         */
         set_working_set_defaults(&data_set);
 
         digest = calculate_xml_versioned_digest(xml_data, FALSE, FALSE, CRM_FEATURE_SET);
@@ -126,6 +251,7 @@ process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* send
         } else if (safe_str_eq(digest, last_digest)) {
             crm_trace("Input has not changed since last time, not saving to disk");
             is_repoke = TRUE;
+            crm_free(digest);
 
         } else {
             crm_free(last_digest);
@@ -152,12 +278,22 @@ process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* send
         }
 
         seq = get_last_sequence(PE_STATE_DIR, series[series_id].name);
+        archive = crm_is_true(pe_pref(data_set.config_hash, "pe-input-archive"));
 
         data_set.input = NULL;
         reply = create_reply(msg, data_set.graph);
         CRM_ASSERT(reply != NULL);
 
-        if (is_repoke == FALSE) {
+        if (is_repoke == FALSE && archive) {
+            char *archive_file = pe_archive_name(series_id);
+            int len = strlen(archive_file) + 16;
+
+            crm_free(filename);
+            crm_malloc0(filename, len);
+            snprintf(filename, len, "%s%c%d", archive_file, XML_ARCHIVE_SEPARATOR, seq);
+            crm_free(archive_file);
+
+        } else if (is_repoke == FALSE) {
             crm_free(filename);
             filename =
                 generate_series_filename(PE_STATE_DIR, series[series_id].name, seq, compress);
@@ -177,7 +313,12 @@ process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* send
         cleanup_alloc_calculations(&data_set);
 
         if (is_repoke == FALSE && series_wrap != 0) {
-            write_xml_file(xml_data, filename, compress);
+            if (archive) {
+                /* Appended once we are idle, the reply has already gone */
+                pe_archive_input(series_id, seq, xml_data);
+            } else {
+                write_xml_file(xml_data, filename, compress);
+            }
             write_last_sequence(PE_STATE_DIR, series[series_id].name, seq + 1, series_wrap);
         }
 
@@ -209,17 +350,29 @@ process_pe_message(xmlNode * msg, xmlNode * xml_data, qb_ipcs_connection_t* send
 
     } else if (strcasecmp(op, CRM_OP_QUIT) == 0) {
         crm_warn("Received quit message, terminating");
+        pe_archive_flush();
         exit(0);
     }
 
     return TRUE;
 }
 
+static size_t
+log_stage_usage(pe_working_set_t * data_set, const char *stage, size_t last)
+{
+    size_t used = pe_arena_used(data_set);
+
+    crm_debug("Stage %s: %lu bytes allocated from the working set arena (%lu total)",
+              stage, (unsigned long)(used - last), (unsigned long)used);
+    return used;
+}
+
 xmlNode *
 do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, ha_time_t * now)
 {
     GListPtr gIter = NULL;
     int rsc_log_level = LOG_INFO;
+    size_t arena_used = 0;
 
 /*	pe_debug_on(); */
 
@@ -236,8 +389,11 @@ do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, ha_time_t * no
         crm_trace("Already have status - reusing");
     }
 
+    arena_used = pe_arena_used(data_set);
+
     crm_trace("Calculate cluster status");
     stage0(data_set);
+    arena_used = log_stage_usage(data_set, "0", arena_used);
 
     gIter = data_set->resources;
     for (; gIter != NULL; gIter = gIter->next) {
@@ -251,24 +407,31 @@ do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, ha_time_t * no
 
     crm_trace("Applying placement constraints");
     stage2(data_set);
+    arena_used = log_stage_usage(data_set, "2", arena_used);
 
     crm_trace("Create internal constraints");
     stage3(data_set);
+    arena_used = log_stage_usage(data_set, "3", arena_used);
 
     crm_trace("Check actions");
     stage4(data_set);
+    arena_used = log_stage_usage(data_set, "4", arena_used);
 
     crm_trace("Allocate resources");
     stage5(data_set);
+    arena_used = log_stage_usage(data_set, "5", arena_used);
 
     crm_trace("Processing fencing and shutdown cases");
     stage6(data_set);
+    arena_used = log_stage_usage(data_set, "6", arena_used);
 
     crm_trace("Applying ordering constraints");
     stage7(data_set);
+    arena_used = log_stage_usage(data_set, "7", arena_used);
 
     crm_trace("Create transition graph");
     stage8(data_set);
+    arena_used = log_stage_usage(data_set, "8", arena_used);
 
     crm_trace("=#=#=#=#= Summary =#=#=#=#=");
     crm_trace("\t========= Set %d (Un-runnable) =========", -1);
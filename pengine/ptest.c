@@ -132,7 +132,7 @@ static struct crm_option long_options[] = {
 
     {"live-check",  0, 0, 'L', "Connect to the CIB and use the current contents as input"},
     {"xml-text",    1, 0, 'X', "Retrieve XML from the supplied string"},
-    {"xml-file",    1, 0, 'x', "Retrieve XML from the named file"},
+    {"xml-file",    1, 0, 'x', "Retrieve XML from the named file, or $archive@$sequence to extract a PE input from an archive"},
     /* {"xml-pipe",    0, 0, 'p', "Retrieve XML from stdin\n"}, */
     
     {"save-input",  1, 0, 'I', "\tSave the input to the named file"},
@@ -286,7 +286,11 @@ main(int argc, char **argv)
 
     } else if (xml_file != NULL) {
         source = xml_file;
-        cib_object = filename2xml(xml_file);
+        if (strchr(xml_file, XML_ARCHIVE_SEPARATOR) != NULL && access(xml_file, F_OK) != 0) {
+            cib_object = archive2xml(xml_file);
+        } else {
+            cib_object = filename2xml(xml_file);
+        }
 
     } else if (use_stdin) {
         source = "stdin";
@@ -34,7 +34,7 @@ pe_free_ordering(GListPtr constraints)
 
         crm_free(order->lh_action_task);
         crm_free(order->rh_action_task);
-        crm_free(order);
+        /* order itself belongs to the working set's arena */
     }
     if (constraints != NULL) {
         g_list_free(constraints);
@@ -51,8 +51,8 @@ pe_free_rsc_to_node(GListPtr constraints)
 
         iterator = iterator->next;
 
+        /* cons itself belongs to the working set's arena */
         slist_basic_destroy(cons->node_list_rh);
-        crm_free(cons);
     }
     if (constraints != NULL) {
         g_list_free(constraints);
@@ -73,7 +73,7 @@ rsc2node_new(const char *id, resource_t * rsc,
         CRM_CHECK(node_weight == 0, return NULL);
     }
 
-    crm_malloc0(new_con, sizeof(rsc_to_node_t));
+    new_con = pe_arena_alloc(data_set, sizeof(rsc_to_node_t));
     if (new_con != NULL) {
         new_con->id = id;
         new_con->rsc_lh = rsc;
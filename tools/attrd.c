@@ -52,6 +52,19 @@ gboolean need_shutdown = FALSE;
 GHashTable *attr_hash = NULL;
 cib_t *cib_conn = NULL;
 
+/*
+ * Updates queued by attrd_perform_update(), keyed by attribute name.
+ * Everything that becomes due while the mainloop is busy (eg. a full
+ * refresh, or a burst of dampening timers expiring together) is written
+ * to the CIB as a single modification when attrd_update_trigger runs.
+ */
+static GHashTable *pending_updates = NULL;
+static crm_trigger_t *attrd_update_trigger = NULL;
+
+/* Attributes waiting to be flushed to all hosts, keyed by name */
+static GHashTable *pending_flushes = NULL;
+static crm_trigger_t *attrd_flush_trigger = NULL;
+
 typedef struct attrd_client_s {
     char *user;
 } attrd_client_t;
@@ -77,6 +90,8 @@ void attrd_local_callback(xmlNode * msg);
 gboolean attrd_timer_callback(void *user_data);
 gboolean attrd_trigger_update(attr_hash_entry_t * hash_entry);
 void attrd_perform_update(attr_hash_entry_t * hash_entry);
+static int attrd_flush_updates(gpointer user_data);
+static int attrd_send_flushes(gpointer user_data);
 
 static void
 free_hash_entry(gpointer data)
@@ -290,6 +305,37 @@ find_hash_entry(xmlNode * msg)
     return hash_entry;
 }
 
+static void
+attrd_cluster_update_one(xmlNode * xml, const char *from)
+{
+    attr_hash_entry_t *hash_entry = NULL;
+    const char *ignore = crm_element_value(xml, F_ATTRD_IGNORE_LOCALLY);
+
+    if (ignore == NULL || safe_str_neq(from, attrd_uname)) {
+        hash_entry = find_hash_entry(xml);
+        stop_attrd_timer(hash_entry);
+        attrd_perform_update(hash_entry);
+    }
+}
+
+/* Apply a flush from a peer, either a single attribute or a coalesced set */
+static void
+attrd_cluster_update(xmlNode * xml, const char *from)
+{
+    xmlNode *child = NULL;
+
+    if (crm_element_value(xml, F_ATTRD_ATTRIBUTE) != NULL) {
+        attrd_cluster_update_one(xml, from);
+        return;
+    }
+
+    for (child = __xml_first_child(xml); child != NULL; child = __xml_next(child)) {
+        if (safe_str_eq(crm_element_name(child), F_ATTRD_UPDATE)) {
+            attrd_cluster_update_one(child, from);
+        }
+    }
+}
+
 #if SUPPORT_HEARTBEAT
 static void
 attrd_ha_connection_destroy(gpointer user_data)
@@ -312,22 +358,18 @@ attrd_ha_connection_destroy(gpointer user_data)
 static void
 attrd_ha_callback(HA_Message * msg, void *private_data)
 {
-    attr_hash_entry_t *hash_entry = NULL;
     xmlNode *xml = convert_ha_message(NULL, msg, __FUNCTION__);
     const char *from = crm_element_value(xml, F_ORIG);
     const char *op = crm_element_value(xml, F_ATTRD_TASK);
     const char *host = crm_element_value(xml, F_ATTRD_HOST);
-    const char *ignore = crm_element_value(xml, F_ATTRD_IGNORE_LOCALLY);
 
     if (host != NULL && safe_str_eq(host, attrd_uname)) {
         crm_info("Update relayed from %s", from);
         attrd_local_callback(xml);
 
-    } else if (ignore == NULL || safe_str_neq(from, attrd_uname)) {
+    } else {
         crm_info("%s message from %s", op, from);
-        hash_entry = find_hash_entry(xml);
-        stop_attrd_timer(hash_entry);
-        attrd_perform_update(hash_entry);
+        attrd_cluster_update(xml, from);
     }
     free_xml(xml);
 }
@@ -348,10 +390,8 @@ attrd_ais_dispatch(AIS_Message * wrapper, char *data, int sender)
     }
 
     if (xml != NULL) {
-        attr_hash_entry_t *hash_entry = NULL;
         const char *op = crm_element_value(xml, F_ATTRD_TASK);
         const char *host = crm_element_value(xml, F_ATTRD_HOST);
-        const char *ignore = crm_element_value(xml, F_ATTRD_IGNORE_LOCALLY);
 
         crm_xml_add_int(xml, F_SEQ, wrapper->id);
         crm_xml_add(xml, F_ORIG, wrapper->sender.uname);
@@ -360,11 +400,9 @@ attrd_ais_dispatch(AIS_Message * wrapper, char *data, int sender)
             crm_notice("Update relayed from %s", wrapper->sender.uname);
             attrd_local_callback(xml);
 
-        } else if (ignore == NULL || safe_str_neq(wrapper->sender.uname, attrd_uname)) {
+        } else {
             crm_trace("%s message from %s", op, wrapper->sender.uname);
-            hash_entry = find_hash_entry(xml);
-            stop_attrd_timer(hash_entry);
-            attrd_perform_update(hash_entry);
+            attrd_cluster_update(xml, wrapper->sender.uname);
         }
 
         free_xml(xml);
@@ -486,6 +524,11 @@ cib_connect(void *user_data)
     crm_info("Sending full refresh");
     g_hash_table_foreach(attr_hash, update_for_hash_entry, NULL);
 
+    if (g_hash_table_size(pending_updates) > 0) {
+        /* Anything that was waiting for the connection */
+        mainloop_set_trigger(attrd_update_trigger);
+    }
+
     return FALSE;
 }
 
@@ -523,6 +566,10 @@ main(int argc, char **argv)
     }
 
     attr_hash = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL, free_hash_entry);
+    pending_updates = g_hash_table_new(crm_str_hash, g_str_equal);
+    attrd_update_trigger = mainloop_add_trigger(G_PRIORITY_LOW, attrd_flush_updates, NULL);
+    pending_flushes = g_hash_table_new(crm_str_hash, g_str_equal);
+    attrd_flush_trigger = mainloop_add_trigger(G_PRIORITY_LOW, attrd_send_flushes, NULL);
 
     crm_info("Starting up");
 
@@ -594,6 +641,8 @@ main(int argc, char **argv)
         cib_delete(cib_conn);
     }
 
+    g_hash_table_destroy(pending_flushes);
+    g_hash_table_destroy(pending_updates);
     g_hash_table_destroy(attr_hash);
     crm_free(attrd_uuid);
     empty_uuid_cache();
@@ -606,12 +655,34 @@ struct attrd_callback_s {
     char *value;
 };
 
+static struct attrd_callback_s *
+attrd_new_callback_data(attr_hash_entry_t * hash_entry)
+{
+    struct attrd_callback_s *data = NULL;
+
+    crm_malloc0(data, sizeof(struct attrd_callback_s));
+    data->attr = crm_strdup(hash_entry->id);
+    if (hash_entry->value != NULL) {
+        data->value = crm_strdup(hash_entry->value);
+    }
+    return data;
+}
+
 static void
-attrd_cib_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data)
+attrd_free_callback_data(gpointer user_data)
 {
-    attr_hash_entry_t *hash_entry = NULL;
     struct attrd_callback_s *data = user_data;
 
+    crm_free(data->value);
+    crm_free(data->attr);
+    crm_free(data);
+}
+
+static void
+attrd_update_result(int call_id, int rc, struct attrd_callback_s *data)
+{
+    attr_hash_entry_t *hash_entry = NULL;
+
     if (data->value == NULL && rc == cib_NOTEXISTS) {
         rc = cib_ok;
     }
@@ -641,28 +712,34 @@ attrd_cib_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *u
             crm_err("Update %d for %s=%s failed: %s",
                     call_id, data->attr, data->value, cib_error2string(rc));
     }
+}
 
-    crm_free(data->value);
-    crm_free(data->attr);
-    crm_free(data);
+static void
+attrd_cib_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data)
+{
+    attrd_update_result(call_id, rc, user_data);
+    attrd_free_callback_data(user_data);
 }
 
-void
-attrd_perform_update(attr_hash_entry_t * hash_entry)
+static void
+attrd_cib_batch_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data)
 {
-    int rc = cib_ok;
-    struct attrd_callback_s *data = NULL;
-    const char *user_name = NULL;
+    GListPtr gIter = NULL;
+    GListPtr updates = user_data;
 
-    if (hash_entry == NULL) {
-        return;
+    for (gIter = updates; gIter != NULL; gIter = gIter->next) {
+        attrd_update_result(call_id, rc, gIter->data);
+        attrd_free_callback_data(gIter->data);
+    }
+    g_list_free(updates);
+}
 
-    } else if (cib_conn == NULL) {
-        crm_info("Delaying operation %s=%s: cib not connected", hash_entry->id,
-                 crm_str(hash_entry->value));
-        return;
+static void
+attrd_perform_single_update(attr_hash_entry_t * hash_entry)
+{
+    int rc = cib_ok;
+    const char *user_name = NULL;
 
-    }
 #if ENABLE_ACL
     if (hash_entry->user) {
         user_name = hash_entry->user;
@@ -707,14 +784,309 @@ attrd_perform_update(attr_hash_entry_t * hash_entry)
         }
     }
 
-    crm_malloc0(data, sizeof(struct attrd_callback_s));
-    data->attr = crm_strdup(hash_entry->id);
-    if (hash_entry->value != NULL) {
-        data->value = crm_strdup(hash_entry->value);
+    add_cib_op_callback(cib_conn, rc, FALSE, attrd_new_callback_data(hash_entry),
+                        attrd_cib_callback);
+}
+
+/* Whether new attribute sets need the <attributes> wrapper of the 0.6 schema */
+static gboolean
+attrd_use_attributes_tag(const char *user_name)
+{
+    const char *value = NULL;
+    xmlNode *cib_top = NULL;
+    gboolean use_attributes_tag = FALSE;
+
+    cib_conn->cmds->delegated_variant_op(cib_conn, CIB_OP_QUERY, NULL, "/cib", NULL, &cib_top,
+                                         cib_sync_call | cib_scope_local | cib_xpath |
+                                         cib_no_children, user_name);
+
+    value = crm_element_value(cib_top, "ignore_dtd");
+    if (value != NULL) {
+        use_attributes_tag = TRUE;
+
+    } else {
+        value = crm_element_value(cib_top, XML_ATTR_VALIDATION);
+        if (value && strstr(value, "-0.6")) {
+            use_attributes_tag = TRUE;
+        }
     }
-    add_cib_op_callback(cib_conn, rc, FALSE, data, attrd_cib_callback);
+    free_xml(cib_top);
+    return use_attributes_tag;
+}
 
-    return;
+/*
+ * Locate the nvpair for hash_entry amongst our existing transient
+ * attributes, using the same matching rules as update_attr_delegate()
+ */
+static xmlNode *
+attrd_find_nvpair(xmlNode * xml, attr_hash_entry_t * hash_entry, int *matches)
+{
+    xmlNode *child = NULL;
+    xmlNode *match = NULL;
+    const char *name = crm_element_name(xml);
+
+    if (safe_str_eq(name, XML_CIB_TAG_NVPAIR)) {
+        const char *set_id = ID(xml->parent);
+
+        if (safe_str_eq(crm_element_name(xml->parent), XML_TAG_ATTRS)) {
+            set_id = ID(xml->parent->parent);
+        }
+
+        if (safe_str_eq(crm_element_value(xml, XML_NVPAIR_ATTR_NAME), hash_entry->id)
+            && (hash_entry->uuid == NULL || safe_str_eq(ID(xml), hash_entry->uuid))
+            && (hash_entry->set == NULL || safe_str_eq(set_id, hash_entry->set))) {
+            (*matches)++;
+            return xml;
+        }
+        return NULL;
+    }
+
+    for (child = __xml_first_child(xml); child != NULL; child = __xml_next(child)) {
+        xmlNode *found = attrd_find_nvpair(child, hash_entry, matches);
+
+        if (match == NULL) {
+            match = found;
+        }
+    }
+    return match;
+}
+
+/*
+ * Write a group of attributes (all belonging to user_name) with one CIB
+ * call: a single query for the existing ids followed by a single modify
+ * of our transient_attributes.  Anything that can't be expressed that
+ * way is passed to attrd_perform_single_update() instead.
+ */
+static void
+attrd_perform_batch(GListPtr entries, const char *user_name)
+{
+    int rc = cib_ok;
+    int lpc = 0;
+    int use_attributes_tag = -1;
+    static int xpath_max = 1024;
+    char *xpath = NULL;
+    xmlNode *current = NULL;
+    xmlNode *update = NULL;
+    xmlNode *attrs = NULL;
+    GListPtr gIter = NULL;
+    GListPtr callbacks = NULL;
+
+    if (entries == NULL) {
+        return;
+
+    } else if (entries->next == NULL) {
+        attrd_perform_single_update(entries->data);
+        return;
+    }
+
+    crm_malloc0(xpath, xpath_max);
+    snprintf(xpath, xpath_max, "%s//%s[@id='%s']//%s", get_object_path(XML_CIB_TAG_STATUS),
+             XML_CIB_TAG_STATE, attrd_uuid, XML_TAG_TRANSIENT_NODEATTRS);
+    rc = cib_conn->cmds->delegated_variant_op(cib_conn, CIB_OP_QUERY, NULL, xpath, NULL, &current,
+                                              cib_sync_call | cib_scope_local | cib_xpath,
+                                              user_name);
+    crm_free(xpath);
+
+    if ((rc != cib_ok && rc != cib_NOTEXISTS)
+        || (current != NULL && safe_str_neq(crm_element_name(current), XML_TAG_TRANSIENT_NODEATTRS))) {
+        crm_info("Sending %d updates individually: %s", g_list_length(entries),
+                 cib_error2string(rc));
+        for (gIter = entries; gIter != NULL; gIter = gIter->next) {
+            attrd_perform_single_update(gIter->data);
+        }
+        free_xml(current);
+        return;
+    }
+
+    update = create_xml_node(NULL, XML_CIB_TAG_STATE);
+    crm_xml_add(update, XML_ATTR_ID, attrd_uuid);
+    attrs = create_xml_node(update, XML_TAG_TRANSIENT_NODEATTRS);
+    crm_xml_add(attrs, XML_ATTR_ID, attrd_uuid);
+
+    for (gIter = entries; gIter != NULL; gIter = gIter->next) {
+        int matches = 0;
+        attr_hash_entry_t *hash_entry = gIter->data;
+        xmlNode *match = NULL;
+        xmlNode *set = NULL;
+        xmlNode *nvpair = NULL;
+        gboolean wrapped = FALSE;
+        const char *set_tag = XML_TAG_ATTR_SETS;
+        char *set_id = NULL;
+        char *attr_id = NULL;
+
+        if (current) {
+            match = attrd_find_nvpair(current, hash_entry, &matches);
+        }
+
+        if (matches > 1) {
+            /* Let update_attr_delegate() report the ambiguity */
+            attrd_perform_single_update(hash_entry);
+            continue;
+
+        } else if (match) {
+            xmlNode *parent = match->parent;
+
+            if (safe_str_eq(crm_element_name(parent), XML_TAG_ATTRS)) {
+                parent = parent->parent;
+                wrapped = TRUE;
+            }
+            set_tag = crm_element_name(parent);
+            set_id = crm_strdup(ID(parent));
+            attr_id = crm_strdup(ID(match));
+
+        } else {
+            xmlNode *existing = NULL;
+
+            if (hash_entry->set) {
+                set_id = crm_strdup(hash_entry->set);
+            } else {
+                set_id = crm_concat(XML_CIB_TAG_STATUS, attrd_uuid, '-');
+            }
+
+            if (hash_entry->uuid) {
+                attr_id = crm_strdup(hash_entry->uuid);
+            } else {
+                attr_id = crm_concat(set_id, hash_entry->id, '-');
+
+                /* Minimal attempt at sanitizing automatic IDs */
+                for (lpc = 0; attr_id[lpc] != 0; lpc++) {
+                    if (attr_id[lpc] == ':') {
+                        attr_id[lpc] = '.';
+                    }
+                }
+            }
+
+            if (current) {
+                existing = find_entity(current, set_tag, set_id);
+            }
+
+            if (existing) {
+                wrapped = (find_xml_node(existing, XML_TAG_ATTRS, FALSE) != NULL);
+
+            } else {
+                if (use_attributes_tag < 0) {
+                    use_attributes_tag = attrd_use_attributes_tag(user_name);
+                }
+                wrapped = use_attributes_tag;
+            }
+        }
+
+        set = find_entity(attrs, set_tag, set_id);
+        if (set == NULL) {
+            set = create_xml_node(attrs, set_tag);
+            crm_xml_add(set, XML_ATTR_ID, set_id);
+        }
+
+        if (wrapped) {
+            xmlNode *wrapper = find_xml_node(set, XML_TAG_ATTRS, FALSE);
+
+            if (wrapper == NULL) {
+                wrapper = create_xml_node(set, XML_TAG_ATTRS);
+            }
+            set = wrapper;
+        }
+
+        nvpair = create_xml_node(set, XML_CIB_TAG_NVPAIR);
+        crm_xml_add(nvpair, XML_ATTR_ID, attr_id);
+        crm_xml_add(nvpair, XML_NVPAIR_ATTR_NAME, hash_entry->id);
+        crm_xml_add(nvpair, XML_NVPAIR_ATTR_VALUE, hash_entry->value);
+
+        if (safe_str_neq(hash_entry->value, hash_entry->stored_value)) {
+            crm_notice("Batching update: %s=%s", hash_entry->id, hash_entry->value);
+        } else {
+            crm_trace("Batching update: %s=%s", hash_entry->id, hash_entry->value);
+        }
+
+        callbacks = g_list_prepend(callbacks, attrd_new_callback_data(hash_entry));
+        crm_free(set_id);
+        crm_free(attr_id);
+    }
+
+    if (callbacks != NULL) {
+        crm_log_xml_trace(update, "Batch");
+        rc = cib_conn->cmds->delegated_variant_op(cib_conn, CIB_OP_MODIFY, NULL,
+                                                  XML_CIB_TAG_STATUS, update, NULL,
+                                                  cib_quorum_override, user_name);
+        if (rc < 0) {
+            crm_err("Batch update for %d attributes failed: %s (%d)",
+                    g_list_length(callbacks), cib_error2string(rc), rc);
+        } else {
+            crm_info("Sent batch update %d for %d attributes", rc, g_list_length(callbacks));
+        }
+        add_cib_op_callback(cib_conn, rc, FALSE, callbacks, attrd_cib_batch_callback);
+    }
+
+    free_xml(update);
+    free_xml(current);
+}
+
+static gboolean
+attrd_update_batchable(attr_hash_entry_t * hash_entry)
+{
+    return hash_entry->value != NULL && safe_str_eq(hash_entry->section, XML_CIB_TAG_STATUS);
+}
+
+static int
+attrd_flush_updates(gpointer user_data)
+{
+    GHashTableIter iter;
+    attr_hash_entry_t *hash_entry = NULL;
+
+    if (cib_conn == NULL) {
+        /* cib_connect() sets the trigger again once we have a connection */
+        crm_info("Delaying %d updates: cib not connected", g_hash_table_size(pending_updates));
+        return TRUE;
+    }
+
+    /* One batch per user, so that ACLs continue to apply per-update */
+    while (g_hash_table_size(pending_updates) > 0) {
+        gboolean first = TRUE;
+        const char *user_name = NULL;
+        GListPtr batch = NULL;
+
+        g_hash_table_iter_init(&iter, pending_updates);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & hash_entry)) {
+            if (first) {
+                user_name = hash_entry->user;
+                first = FALSE;
+
+            } else if (safe_str_neq(user_name, hash_entry->user)) {
+                continue;
+            }
+
+            g_hash_table_iter_remove(&iter);
+            if (attrd_update_batchable(hash_entry)) {
+                batch = g_list_prepend(batch, hash_entry);
+            } else {
+                attrd_perform_single_update(hash_entry);
+            }
+        }
+
+        attrd_perform_batch(batch, user_name);
+        g_list_free(batch);
+    }
+
+    return TRUE;
+}
+
+void
+attrd_perform_update(attr_hash_entry_t * hash_entry)
+{
+    if (hash_entry == NULL) {
+        return;
+
+    } else if (cib_conn == NULL) {
+        crm_info("Delaying operation %s=%s: cib not connected", hash_entry->id,
+                 crm_str(hash_entry->value));
+        return;
+    }
+
+    /* The value is read when the batch is written, so a later change
+     * in the same batch simply replaces this one
+     */
+    crm_trace("Queueing %s=%s", hash_entry->id, crm_str(hash_entry->value));
+    g_hash_table_replace(pending_updates, hash_entry->id, hash_entry);
+    mainloop_set_trigger(attrd_update_trigger);
 }
 
 void
@@ -821,38 +1193,107 @@ attrd_timer_callback(void *user_data)
     return TRUE;                /* Always return true, removed cleanly by stop_attrd_timer() */
 }
 
-gboolean
-attrd_trigger_update(attr_hash_entry_t * hash_entry)
+static void
+attrd_add_flush_fields(xmlNode * xml, attr_hash_entry_t * hash_entry)
 {
-    xmlNode *msg = NULL;
+    crm_xml_add(xml, F_ATTRD_ATTRIBUTE, hash_entry->id);
+    crm_xml_add(xml, F_ATTRD_SET, hash_entry->set);
+    crm_xml_add(xml, F_ATTRD_SECTION, hash_entry->section);
+    crm_xml_add(xml, F_ATTRD_DAMPEN, hash_entry->dampen);
+    crm_xml_add(xml, F_ATTRD_VALUE, hash_entry->value);
+#if ENABLE_ACL
+    if (hash_entry->user) {
+        crm_xml_add(xml, F_ATTRD_USER, hash_entry->user);
+    }
+#endif
 
-    /* send HA message to everyone */
-    crm_notice("Sending flush op to all hosts for: %s (%s)",
-               hash_entry->id, crm_str(hash_entry->value));
-    log_hash_entry(LOG_DEBUG_2, hash_entry, "Sending flush op to all hosts for:");
+    if (hash_entry->timeout <= 0) {
+        crm_xml_add(xml, F_ATTRD_IGNORE_LOCALLY, hash_entry->value);
+    }
+}
+
+static xmlNode *
+attrd_new_flush_message(void)
+{
+    xmlNode *msg = create_xml_node(NULL, __FUNCTION__);
 
-    msg = create_xml_node(NULL, __FUNCTION__);
     crm_xml_add(msg, F_TYPE, T_ATTRD);
     crm_xml_add(msg, F_ORIG, attrd_uname);
     crm_xml_add(msg, F_ATTRD_TASK, "flush");
-    crm_xml_add(msg, F_ATTRD_ATTRIBUTE, hash_entry->id);
-    crm_xml_add(msg, F_ATTRD_SET, hash_entry->set);
-    crm_xml_add(msg, F_ATTRD_SECTION, hash_entry->section);
-    crm_xml_add(msg, F_ATTRD_DAMPEN, hash_entry->dampen);
-    crm_xml_add(msg, F_ATTRD_VALUE, hash_entry->value);
-#if ENABLE_ACL
-    if (hash_entry->user) {
-        crm_xml_add(msg, F_ATTRD_USER, hash_entry->user);
+    return msg;
+}
+
+/*
+ * Send everything queued by attrd_trigger_update() to all hosts.
+ *
+ * A lone attribute uses the original one-attribute message, anything more
+ * goes out as a single message with one F_ATTRD_UPDATE child per attribute.
+ * Peers that predate coalescing drop the latter, so it is only used once
+ * PCMK_attrd_coalesce=yes has been set after every node is upgraded.
+ */
+static int
+attrd_send_flushes(gpointer user_data)
+{
+    int count = 0;
+    xmlNode *msg = NULL;
+    GHashTableIter iter;
+    attr_hash_entry_t *hash_entry = NULL;
+    static const char *coalesce = NULL;
+
+    count = g_hash_table_size(pending_flushes);
+    if (count == 0) {
+        return TRUE;
+    }
+
+    if (coalesce == NULL) {
+        coalesce = getenv("PCMK_attrd_coalesce");
+        if (coalesce == NULL) {
+            coalesce = "no";
+        }
+    }
+
+    if (count > 1 && crm_is_true(coalesce)) {
+        crm_notice("Sending flush op to all hosts for %d attributes", count);
+        msg = attrd_new_flush_message();
     }
-#endif
+
+    g_hash_table_iter_init(&iter, pending_flushes);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & hash_entry)) {
+        if (msg) {
+            crm_info("Flushing %s (%s)", hash_entry->id, crm_str(hash_entry->value));
+            attrd_add_flush_fields(create_xml_node(msg, F_ATTRD_UPDATE), hash_entry);
+
+        } else {
+            xmlNode *single = attrd_new_flush_message();
+
+            crm_notice("Sending flush op to all hosts for: %s (%s)",
+                       hash_entry->id, crm_str(hash_entry->value));
+            attrd_add_flush_fields(single, hash_entry);
+            send_cluster_message(NULL, crm_msg_attrd, single, FALSE);
+            free_xml(single);
+        }
+        g_hash_table_iter_remove(&iter);
+    }
+
+    if (msg) {
+        send_cluster_message(NULL, crm_msg_attrd, msg, FALSE);
+        free_xml(msg);
+    }
+    return TRUE;
+}
+
+gboolean
+attrd_trigger_update(attr_hash_entry_t * hash_entry)
+{
+    log_hash_entry(LOG_DEBUG_2, hash_entry, "Queueing flush op to all hosts for:");
 
     if (hash_entry->timeout <= 0) {
-        crm_xml_add(msg, F_ATTRD_IGNORE_LOCALLY, hash_entry->value);
         attrd_perform_update(hash_entry);
     }
 
-    send_cluster_message(NULL, crm_msg_attrd, msg, FALSE);
-    free_xml(msg);
+    /* Sent from attrd_send_flushes(), with whatever else is due this iteration */
+    g_hash_table_replace(pending_flushes, hash_entry->id, hash_entry);
+    mainloop_set_trigger(attrd_flush_trigger);
 
     return TRUE;
 }
@@ -55,6 +55,7 @@ gboolean quiet = FALSE;
 extern void cleanup_alloc_calculations(pe_working_set_t * data_set);
 
 extern xmlNode *do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, ha_time_t * now);
+extern size_t pe_arena_used(pe_working_set_t * data_set);
 
 char *use_date = NULL;
 static ha_time_t *
@@ -1037,6 +1038,13 @@ setup_input(const char *input, const char *output)
     } else if (safe_str_eq(input, "-")) {
         cib_object = filename2xml(NULL);
 
+    } else if (strchr(input, XML_ARCHIVE_SEPARATOR) != NULL && access(input, F_OK) != 0) {
+        cib_object = archive2xml(input);
+        if (cib_object == NULL) {
+            fprintf(stderr, "Could not extract %s\n", input);
+            exit(3);
+        }
+
     } else {
         cib_object = filename2xml(input);
     }
@@ -1091,6 +1099,7 @@ static struct crm_option long_options[] = {
     {"show-scores",   0, 0, 's', "Show allocation scores"},
     {"show-utilization",   0, 0, 'U', "Show utilization information"},
     {"profile",       1, 0, 'P', "Run all tests in the named directory to create profiling data"},
+    {"threads",       1, 0, 'T', "\tProcess the status section with this many threads (overrides pe-threads)"},
 
     {"-spacer-",     0, 0, '-', "\nSynthetic Cluster Events:"},
     {"node-up",      1, 0, 'u', "\tBring a node online"},
@@ -1115,7 +1124,7 @@ static struct crm_option long_options[] = {
     
     {"-spacer-",    0, 0, '-', "\nData Source:"},
     {"live-check",  0, 0, 'L', "\tConnect to the CIB and use the current contents as input"},
-    {"xml-file",    1, 0, 'x', "\tRetrieve XML from the named file"},
+    {"xml-file",    1, 0, 'x', "\tRetrieve XML from the named file, or $archive@$sequence to extract a PE input from an archive"},
     {"xml-pipe",    0, 0, 'p', "\tRetrieve XML from stdin"},
     
     {0, 0, 0, 0}
@@ -1149,6 +1158,8 @@ profile_one(const char *xml_file)
     data_set.input = cib_object;
     data_set.now = get_date();
     do_calculations(&data_set, cib_object, NULL);
+    printf("  %lu bytes allocated from the working set arena\n",
+           (unsigned long)pe_arena_used(&data_set));
 
     cleanup_alloc_calculations(&data_set);
 }
@@ -1356,6 +1367,9 @@ main(int argc, char **argv)
             case 'P':
                 test_dir = optarg;
                 break;
+            case 'T':
+                pe_set_threads(crm_parse_int(optarg, "1"));
+                break;
             default:
                 ++argerr;
                 break;
@@ -101,6 +101,21 @@ gboolean log_updates = FALSE;
 long last_refresh = 0;
 crm_trigger_t *refresh_trigger = NULL;
 
+/* The cluster state last unpacked from current_cib, kept between refreshes
+ *
+ * Only diffs limited to transient node attributes and CIB header fields
+ * are patched into it (see mon_patch_status()).  Anything else, including
+ * every change to resource history, unpacks the whole CIB again, and the
+ * display is always redrawn in full.
+ */
+static pe_working_set_t mon_data_set;
+static gboolean mon_data_set_valid = FALSE;
+static gboolean mon_needs_unpack = TRUE;
+static long mon_data_set_built = 0;
+
+/* Node attributes referenced by rules in the configuration */
+static GHashTable *mon_rule_attrs = NULL;
+
 /*
  * 1.3.6.1.4.1.32723 has been assigned to the project by IANA
  * http://www.iana.org/assignments/enterprise-numbers
@@ -247,6 +262,7 @@ cib_connect(gboolean full)
         }
 
         current_cib = get_cib_copy(cib);
+        mon_needs_unpack = TRUE;
         mon_refresh_display(NULL);
 
         if (full) {
@@ -2116,6 +2132,232 @@ handle_rsc_op(xmlNode * rsc_op)
     crm_free(task);
 }
 
+static void
+mon_collect_rule_attrs(xmlNode * xml)
+{
+    xmlNode *child = NULL;
+
+    if (safe_str_eq(crm_element_name(xml), XML_TAG_EXPRESSION)) {
+        const char *attr = crm_element_value(xml, XML_EXPR_ATTR_ATTRIBUTE);
+
+        if (attr != NULL) {
+            g_hash_table_replace(mon_rule_attrs, crm_strdup(attr), crm_strdup(attr));
+        }
+    }
+
+    for (child = __xml_first_child(xml); child != NULL; child = __xml_next(child)) {
+        mon_collect_rule_attrs(child);
+    }
+}
+
+/* Whether unpacking interprets a node attribute beyond storing it */
+static gboolean
+mon_attr_needs_unpack(const char *name)
+{
+    if (name == NULL
+        || safe_str_eq(name, "standby")
+        || safe_str_eq(name, "terminate")
+        || safe_str_eq(name, XML_CIB_ATTR_SHUTDOWN)
+        || strstr(name, "fail-count-") == name || strstr(name, "last-failure-") == name) {
+        return TRUE;
+    }
+    return g_hash_table_lookup(mon_rule_attrs, name) != NULL;
+}
+
+static xmlNode *
+mon_known_node_state(const char *id)
+{
+    xmlNode *status = get_object_root(XML_CIB_TAG_STATUS, mon_data_set.input);
+
+    if (id == NULL || status == NULL) {
+        return NULL;
+    }
+    return find_entity(status, XML_CIB_TAG_STATE, id);
+}
+
+/* Anything but the debug origin that differs from the unpacked node_state */
+static gboolean
+mon_node_state_changed(xmlNode * diff_state, gboolean added)
+{
+    xmlAttrPtr xIter = NULL;
+    xmlNode *known = mon_known_node_state(ID(diff_state));
+
+    if (known == NULL || crm_element_value(diff_state, XML_DIFF_MARKER) != NULL) {
+        return TRUE;
+    }
+
+    for (xIter = diff_state->properties; xIter; xIter = xIter->next) {
+        const char *name = (const char *)xIter->name;
+
+        if (safe_str_eq(name, XML_ATTR_ID) || safe_str_eq(name, XML_ATTR_ORIGIN)) {
+            continue;
+
+        } else if (added == FALSE) {
+            /* Only changed values are listed in the removed half */
+            return TRUE;
+
+        } else if (safe_str_neq(crm_element_value(diff_state, name),
+                                crm_element_value(known, name))) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Apply a changed transient attribute directly to the node it belongs to */
+static gboolean
+mon_patch_node_attr(xmlNode * nvpair)
+{
+    int sets = 0;
+    node_t *node = NULL;
+    xmlNode *xml = NULL;
+    xmlNode *known = NULL;
+    const char *name = crm_element_value(nvpair, XML_NVPAIR_ATTR_NAME);
+    const char *value = crm_element_value(nvpair, XML_NVPAIR_ATTR_VALUE);
+
+    if (mon_attr_needs_unpack(name) || value == NULL
+        || safe_str_eq(crm_element_value(nvpair, XML_DIFF_MARKER), "removed:top")) {
+        return FALSE;
+    }
+
+    /* Whole attribute sets coming and going are left to the unpack */
+    for (xml = nvpair->parent; xml != NULL; xml = xml->parent) {
+        if (safe_str_eq(crm_element_name(xml), XML_CIB_TAG_STATE)) {
+            break;
+
+        } else if (crm_element_value(xml, XML_DIFF_MARKER) != NULL) {
+            return FALSE;
+        }
+    }
+
+    if (xml == NULL) {
+        return FALSE;
+    }
+
+    node = pe_find_node_id(mon_data_set.nodes, ID(xml));
+    known = find_xml_node(mon_known_node_state(ID(xml)), XML_TAG_TRANSIENT_NODEATTRS, FALSE);
+    if (node == NULL || known == NULL) {
+        return FALSE;
+    }
+
+    /* With a single unconditional set, the value read from it is the value */
+    for (xml = __xml_first_child(known); xml != NULL; xml = __xml_next(xml)) {
+        if (safe_str_eq(crm_element_name(xml), XML_TAG_ATTR_SETS)) {
+            if (find_xml_node(xml, XML_TAG_RULE, FALSE) != NULL) {
+                return FALSE;
+            }
+            sets++;
+        }
+    }
+    if (sets != 1) {
+        return FALSE;
+    }
+
+    crm_trace("Patching %s=%s on %s", name, value, node->details->uname);
+    g_hash_table_replace(node->details->attrs, crm_strdup(name), crm_strdup(value));
+    return TRUE;
+}
+
+/*
+ * Bring mon_data_set up to date with a diff that has already been applied
+ * to current_cib, where that can be done without unpacking the status
+ * section again.  Changes to transient node attributes that nothing in
+ * the unpack depends on are written into the node directly; header
+ * fields are copied over.  Anything else (configuration, resource
+ * history, node membership, tickets, quorum) needs a full unpack.
+ *
+ * Returns FALSE if mon_data_set has to be rebuilt
+ */
+static gboolean
+mon_patch_status(xmlNode * diff)
+{
+    int lpc = 0;
+    GListPtr gIter = NULL;
+    gboolean patched = TRUE;
+    xmlNode *added = NULL;
+    xmlNode *removed = NULL;
+    cib_diff_class_t *classes = NULL;
+
+    const char *header[] = {
+        XML_ATTR_NUMUPDATES,
+        XML_CIB_ATTR_WRITTEN,
+        XML_ATTR_UPDATE_ORIG,
+        XML_ATTR_UPDATE_CLIENT,
+        XML_ATTR_UPDATE_USER,
+    };
+
+    if (mon_data_set_valid == FALSE || diff == NULL) {
+        return FALSE;
+    }
+
+    added = find_xml_node(find_xml_node(diff, XML_TAG_DIFF_ADDED, FALSE), XML_TAG_CIB, FALSE);
+    removed = find_xml_node(find_xml_node(diff, XML_TAG_DIFF_REMOVED, FALSE), XML_TAG_CIB, FALSE);
+
+    if (added == NULL) {
+        return FALSE;
+
+    } else if ((removed != NULL && crm_element_value(removed, XML_ATTR_HAVE_QUORUM) != NULL)
+        || (removed != NULL && crm_element_value(removed, XML_ATTR_DC_UUID) != NULL)
+        || safe_str_neq(crm_element_value(added, XML_ATTR_HAVE_QUORUM),
+                        crm_element_value(mon_data_set.input, XML_ATTR_HAVE_QUORUM))
+        || safe_str_neq(crm_element_value(added, XML_ATTR_DC_UUID),
+                        crm_element_value(mon_data_set.input, XML_ATTR_DC_UUID))) {
+        return FALSE;
+    }
+
+    classes = cib_diff_classify(diff);
+    if (classes->config_changed) {
+        crm_trace("Configuration changed, unpacking");
+        patched = FALSE;
+
+    } else if (classes->added[cib_diff_tickets] || classes->removed[cib_diff_tickets]) {
+        crm_trace("Tickets changed, unpacking");
+        patched = FALSE;
+
+    } else if (classes->added[cib_diff_lrm_resource] || classes->removed[cib_diff_lrm_resource]
+               || classes->added[cib_diff_lrm_rsc_op] || classes->removed[cib_diff_lrm_rsc_op]) {
+        /* Unpacking an operation creates actions and constraints and can
+         * change node state, none of which can be undone for one resource
+         */
+        crm_trace("Resource history changed, unpacking");
+        patched = FALSE;
+    }
+
+    for (gIter = classes->removed[cib_diff_node_state]; patched && gIter; gIter = gIter->next) {
+        patched = (mon_node_state_changed(gIter->data, FALSE) == FALSE);
+    }
+    for (gIter = classes->added[cib_diff_node_state]; patched && gIter; gIter = gIter->next) {
+        patched = (mon_node_state_changed(gIter->data, TRUE) == FALSE);
+    }
+
+    /* A value that changed is listed in both halves, a deleted one only here */
+    for (gIter = classes->removed[cib_diff_transient_nvpairs]; patched && gIter;
+         gIter = gIter->next) {
+        const char *id = ID((xmlNode *) gIter->data);
+
+        patched = (id != NULL
+                   && cib_diff_find_added(classes, cib_diff_transient_nvpairs, id) != NULL);
+    }
+    for (gIter = classes->added[cib_diff_transient_nvpairs]; patched && gIter;
+         gIter = gIter->next) {
+        patched = mon_patch_node_attr(gIter->data);
+    }
+    cib_diff_class_free(classes);
+
+    if (patched == FALSE) {
+        return FALSE;
+    }
+
+    for (lpc = 0; lpc < DIMOF(header); lpc++) {
+        const char *value = crm_element_value(added, header[lpc]);
+
+        if (value != NULL) {
+            crm_xml_add(mon_data_set.input, header[lpc], value);
+        }
+    }
+    return TRUE;
+}
+
 void
 crm_diff_update(const char *event, xmlNode * msg)
 {
@@ -2154,11 +2396,15 @@ crm_diff_update(const char *event, xmlNode * msg)
             crm_debug("Update didn't apply, requesting full copy: %s", cib_error2string(rc));
             free_xml(current_cib);
             current_cib = NULL;
+
+        } else if (mon_needs_unpack == FALSE && mon_patch_status(diff) == FALSE) {
+            mon_needs_unpack = TRUE;
         }
     }
 
     if (current_cib == NULL) {
         current_cib = get_cib_copy(cib);
+        mon_needs_unpack = TRUE;
     }
 
     if (log_diffs && diff) {
@@ -2171,21 +2417,15 @@ crm_diff_update(const char *event, xmlNode * msg)
 
     if (diff && (crm_mail_to || snmp_target || external_agent)) {
         /* Process operation updates */
-        xmlXPathObject *xpathObj =
-            xpath_search(diff,
-                         "//" F_CIB_UPDATE_RESULT "//" XML_TAG_DIFF_ADDED "//" XML_LRM_TAG_RSC_OP);
-        if (xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-            int lpc = 0, max = xpathObj->nodesetval->nodeNr;
+        cib_diff_class_t *classes = cib_diff_classify(diff);
+        GListPtr gIter = classes->added[cib_diff_lrm_rsc_op];
 
-            for (lpc = 0; lpc < max; lpc++) {
-                xmlNode *rsc_op = getXpathResult(xpathObj, lpc);
+        for (; gIter != NULL; gIter = gIter->next) {
+            xmlNode *rsc_op = (xmlNode *) gIter->data;
 
-                handle_rsc_op(rsc_op);
-            }
-        }
-        if (xpathObj) {
-            xmlXPathFreeObject(xpathObj);
+            handle_rsc_op(rsc_op);
         }
+        cib_diff_class_free(classes);
     }
 
     if ((now - last_refresh) > (reconnect_msec / 1000)) {
@@ -2198,13 +2438,15 @@ crm_diff_update(const char *event, xmlNode * msg)
     free_xml(cib_last);
 }
 
-gboolean
-mon_refresh_display(gpointer user_data)
+static gboolean
+mon_unpack(void)
 {
     xmlNode *cib_copy = copy_xml(current_cib);
-    pe_working_set_t data_set;
 
-    last_refresh = time(NULL);
+    if (mon_data_set_valid) {
+        cleanup_calculations(&mon_data_set);
+        mon_data_set_valid = FALSE;
+    }
 
     if (cli_config_update(&cib_copy, NULL, FALSE) == FALSE) {
         if (cib) {
@@ -2218,17 +2460,45 @@ mon_refresh_display(gpointer user_data)
         return FALSE;
     }
 
-    set_working_set_defaults(&data_set);
-    data_set.input = cib_copy;
-    cluster_status(&data_set);
+    set_working_set_defaults(&mon_data_set);
+    mon_data_set.input = cib_copy;
+    cluster_status(&mon_data_set);
+
+    if (mon_rule_attrs == NULL) {
+        mon_rule_attrs = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                               g_hash_destroy_str, g_hash_destroy_str);
+    }
+    g_hash_table_remove_all(mon_rule_attrs);
+    mon_collect_rule_attrs(get_object_root(XML_CIB_TAG_CONFIGURATION, cib_copy));
+
+    mon_data_set_valid = TRUE;
+    mon_needs_unpack = FALSE;
+    mon_data_set_built = time(NULL);
+    return TRUE;
+}
+
+gboolean
+mon_refresh_display(gpointer user_data)
+{
+    last_refresh = time(NULL);
+
+    /* Failure expiry and date rules are only evaluated while unpacking,
+     * so a patched model is never used for longer than the refresh interval
+     */
+    if (mon_data_set_valid == FALSE || mon_needs_unpack
+        || (last_refresh - mon_data_set_built) > (reconnect_msec / 1000)) {
+        if (mon_unpack() == FALSE) {
+            return FALSE;
+        }
+    }
 
     if (as_html_file || web_cgi) {
-        if (print_html_status(&data_set, as_html_file, web_cgi) != 0) {
+        if (print_html_status(&mon_data_set, as_html_file, web_cgi) != 0) {
             fprintf(stderr, "Critical: Unable to output html file\n");
             clean_up(LSB_EXIT_GENERIC);
         }
     } else if (as_xml) {
-        if (print_xml_status(&data_set) != 0) {
+        if (print_xml_status(&mon_data_set) != 0) {
             fprintf(stderr, "Critical: Unable to output xml file\n");
             clean_up(LSB_EXIT_GENERIC);
         }
@@ -2236,16 +2506,15 @@ mon_refresh_display(gpointer user_data)
         /* do nothing */
 
     } else if (simple_status) {
-        print_simple_status(&data_set);
+        print_simple_status(&mon_data_set);
         if (has_warnings) {
             clean_up(LSB_EXIT_GENERIC);
         }
 
     } else {
-        print_status(&data_set);
+        print_status(&mon_data_set);
     }
 
-    cleanup_calculations(&data_set);
     return TRUE;
 }
 